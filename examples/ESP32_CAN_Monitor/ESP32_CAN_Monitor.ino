@@ -0,0 +1,116 @@
+/*
+
+This example monitors the broadcast traffic of the vehicle's CAN bus ("AT MA") instead of
+sending OBD requests. Frames are parsed into a ring buffer as they arrive and printed from
+loop(). The ELM327 forwards every frame as text and can't keep up with a busy bus ("BUFFER FULL"),
+so planMonitorFilters() finds the "AT CF"/"AT CM" filter that passes the wanted IDs with the least
+extra traffic. An ID passes if it matches the filter in every bit set in the mask.
+
+Every 10 seconds the monitor is stopped to read the battery voltage, then restarted.
+
+*/
+
+#include "BluetoothSerial.h"
+#include "ELMduino.h"
+
+BluetoothSerial SerialBT;
+#define ELM_PORT SerialBT
+#define DEBUG_PORT Serial
+
+ELM327 myELM327;
+canFrame frames[32];
+uint32_t lastVoltage = 0;
+
+// 11-bit IDs to monitor
+const uint32_t wantedIds[] = { 0x7E8, 0x7E9, 0x7EA };
+monitorWindow window;
+
+void startMonitor()
+{
+    if (!myELM327.startMonitor(frames, 32, window))
+        DEBUG_PORT.println("Couldn't start the monitor");
+}
+
+void setup()
+{
+    DEBUG_PORT.begin(115200);
+    // SerialBT.setPin("1234");
+    ELM_PORT.begin("ArduHUD", true);
+
+    if (!ELM_PORT.connect("OBDII"))
+    {
+        DEBUG_PORT.println("Couldn't connect to OBD scanner - Phase 1");
+        while (1)
+            ;
+    }
+
+    if (!myELM327.begin(ELM_PORT, false, 2000))
+    {
+        DEBUG_PORT.println("Couldn't connect to OBD scanner - Phase 2");
+        while (1)
+            ;
+    }
+
+    DEBUG_PORT.println("Connected to ELM327");
+
+    // A single window - the ELM327 holds one filter/mask pair at a time
+    myELM327.planMonitorFilters(wantedIds, 3, false, &window, 1);
+
+    DEBUG_PORT.print("AT CF ");
+    DEBUG_PORT.print(window.filter, HEX);
+    DEBUG_PORT.print(", AT CM ");
+    DEBUG_PORT.print(window.mask, HEX);
+    DEBUG_PORT.print(" - passes ");
+    DEBUG_PORT.print(window.passRatio * 100, 3);
+    DEBUG_PORT.println("% of the IDs");
+
+    startMonitor();
+}
+
+void loop()
+{
+    canFrame frame;
+
+    myELM327.pollMonitor();
+
+    while (myELM327.readFrame(frame))
+    {
+        DEBUG_PORT.print(frame.timestamp_ms);
+        DEBUG_PORT.print(" ");
+        DEBUG_PORT.print(frame.id, HEX);
+        DEBUG_PORT.print(":");
+
+        for (uint8_t i = 0; i < frame.len; i++)
+        {
+            DEBUG_PORT.print(" ");
+            DEBUG_PORT.print(frame.data[i], HEX);
+        }
+
+        DEBUG_PORT.println();
+    }
+
+    if (!myELM327.isMonitoring() || ((millis() - lastVoltage) > 10000))
+    {
+        // Stops the monitor - batteryVoltage() couldn't be sent otherwise
+        myELM327.stopMonitor();
+
+        float voltage;
+
+        do
+        {
+            voltage = myELM327.batteryVoltage();
+        } while (myELM327.nb_rx_state == ELM_GETTING_MSG);
+
+        if (myELM327.nb_rx_state == ELM_SUCCESS)
+        {
+            DEBUG_PORT.print("Battery voltage: ");
+            DEBUG_PORT.println(voltage);
+        }
+
+        DEBUG_PORT.print("Dropped frames: ");
+        DEBUG_PORT.println(myELM327.Monitor_Stats.dropped);
+
+        lastVoltage = millis();
+        startMonitor();
+    }
+}
@@ -0,0 +1,99 @@
+/*
+
+This example logs a heavy-duty (J1939) vehicle without sending requests: all broadcast frames
+are monitored, reassembled into J1939 messages (multi-packet DM1 fault lists included) and the
+common SPNs are decoded. Requires an ELM327 that supports J1939 (protocol A).
+
+*/
+
+#include "BluetoothSerial.h"
+#include "ELMduino.h"
+
+BluetoothSerial SerialBT;
+#define ELM_PORT SerialBT
+#define DEBUG_PORT Serial
+
+ELM327 myELM327;
+canFrame frames[64];
+j1939Transfer tpTransfers[J1939_TP_SESSIONS];
+sampledValue spnValues[NUM_J1939_SPNS];
+uint32_t lastPrint = 0;
+
+void setup()
+{
+    DEBUG_PORT.begin(115200);
+    // SerialBT.setPin("1234");
+    ELM_PORT.begin("ArduHUD", true);
+
+    if (!ELM_PORT.connect("OBDII"))
+    {
+        DEBUG_PORT.println("Couldn't connect to OBD scanner - Phase 1");
+        while (1)
+            ;
+    }
+
+    if (!myELM327.begin(ELM_PORT, false, 2000, SAE_J1939_29_BIT_250_KBAUD))
+    {
+        DEBUG_PORT.println("Couldn't connect to OBD scanner - Phase 2");
+        while (1)
+            ;
+    }
+
+    DEBUG_PORT.println("Connected to ELM327");
+    myELM327.setJ1939Transfers(tpTransfers, J1939_TP_SESSIONS);
+    myELM327.startMonitor(frames, 64);
+}
+
+void loop()
+{
+    canFrame     frame;
+    j1939Message message;
+
+    myELM327.pollMonitor();
+
+    while (myELM327.readFrame(frame))
+    {
+        if (!myELM327.processJ1939Frame(frame, message))
+            continue;
+
+        if (message.pgn == J1939_PGN_DM1)
+        {
+            j1939DTC dtcs[8];
+            uint16_t lamps;
+            uint8_t  numDtcs = myELM327.parseDM1(message, dtcs, 8, lamps);
+
+            for (uint8_t i = 0; i < numDtcs; i++)
+            {
+                DEBUG_PORT.print("DM1 from ");
+                DEBUG_PORT.print(message.source, HEX);
+                DEBUG_PORT.print(": SPN ");
+                DEBUG_PORT.print(dtcs[i].spn);
+                DEBUG_PORT.print(" FMI ");
+                DEBUG_PORT.println(dtcs[i].fmi);
+            }
+        }
+        else
+            myELM327.decodeSPNs(message, spnValues);
+    }
+
+    if (!myELM327.isMonitoring())
+    {
+        // The ELM327 stopped on its own ("BUFFER FULL") - restart it
+        myELM327.stopMonitor();
+        myELM327.startMonitor(frames, 64);
+    }
+
+    if ((millis() - lastPrint) > 1000)
+    {
+        lastPrint = millis();
+
+        DEBUG_PORT.print("RPM: ");
+        DEBUG_PORT.print(spnValues[J1939_ENGINE_SPEED].value);
+        DEBUG_PORT.print(", coolant: ");
+        DEBUG_PORT.print(spnValues[J1939_COOLANT_TEMP].value);
+        DEBUG_PORT.print(", speed: ");
+        DEBUG_PORT.print(spnValues[J1939_VEHICLE_SPEED].value);
+        DEBUG_PORT.print(", fuel rate: ");
+        DEBUG_PORT.println(spnValues[J1939_FUEL_RATE].value);
+    }
+}
@@ -0,0 +1,79 @@
+/*
+
+This example finds the ECUs that answer engine RPM (i.e. the engine and hybrid ECUs of a hybrid
+car) with headers on, then schedules RPM separately for each of them. Each ECU is queried with
+its own physical header, so only one ECU answers and no query waits for further responses.
+Requires an ISO 15765 (CAN) vehicle.
+
+*/
+
+#include "BluetoothSerial.h"
+#include "ELMduino.h"
+
+BluetoothSerial SerialBT;
+#define ELM_PORT SerialBT
+#define DEBUG_PORT Serial
+
+ELM327 myELM327;
+
+void setup()
+{
+    DEBUG_PORT.begin(115200);
+    // SerialBT.setPin("1234");
+    ELM_PORT.begin("ArduHUD", true);
+
+    if (!ELM_PORT.connect("OBDII"))
+    {
+        DEBUG_PORT.println("Couldn't connect to OBD scanner - Phase 1");
+        while (1)
+            ;
+    }
+
+    if (!myELM327.begin(ELM_PORT, false, 2000))
+    {
+        DEBUG_PORT.println("Couldn't connect to OBD scanner - Phase 2");
+        while (1)
+            ;
+    }
+
+    DEBUG_PORT.println("Connected to ELM327");
+
+    if (!myELM327.setECUDemux(true))
+    {
+        DEBUG_PORT.println("Not a CAN vehicle");
+        while (1)
+            ;
+    }
+
+    // One broadcast query - every ECU that knows the PID answers
+    do
+        myELM327.rpm();
+    while (myELM327.nb_rx_state == ELM_GETTING_MSG);
+
+    for (uint8_t i = 0; i < myELM327.ECU_Responses.numECUs; i++)
+    {
+        uint32_t ecu = myELM327.ECU_Responses.ecus[i].id;
+
+        DEBUG_PORT.print("ECU ");
+        DEBUG_PORT.print(ecu, HEX);
+        DEBUG_PORT.print(": ");
+        DEBUG_PORT.print(myELM327.ecuValue(ecu));
+        DEBUG_PORT.println(" rpm");
+
+        myELM327.schedulePID(ENGINE_RPM, 10, ecu);
+    }
+}
+
+void loop()
+{
+    int8_t index = myELM327.poll();
+
+    if (index >= 0)
+    {
+        DEBUG_PORT.print("ECU ");
+        DEBUG_PORT.print(myELM327.schedule[index].ecu, HEX);
+        DEBUG_PORT.print(": ");
+        DEBUG_PORT.print(myELM327.schedule[index].value);
+        DEBUG_PORT.println(" rpm");
+    }
+}
@@ -0,0 +1,72 @@
+/*
+
+This example shows how to store the ELM327 session (detected protocol, supported PIDs,
+header and timeouts) in the ESP32's NVS and restore it at the next boot. Restoring a
+session skips the protocol search, so the first data arrives much sooner. If the stored
+session doesn't work anymore (i.e. different vehicle), ELMduino falls back to the normal
+protocol search.
+
+*/
+
+#include "BluetoothSerial.h"
+#include "Preferences.h"
+#include "ELMduino.h"
+
+BluetoothSerial SerialBT;
+#define ELM_PORT SerialBT
+#define DEBUG_PORT Serial
+
+ELM327 myELM327;
+Preferences prefs;
+
+bool loadSession(uint8_t* data, uint16_t len)
+{
+    return prefs.getBytes("session", data, len) == len;
+}
+
+bool storeSession(const uint8_t* data, uint16_t len)
+{
+    return prefs.putBytes("session", data, len) == len;
+}
+
+void setup()
+{
+    DEBUG_PORT.begin(115200);
+    prefs.begin("elmduino", false);
+    // SerialBT.setPin("1234");
+    ELM_PORT.begin("ArduHUD", true);
+
+    if (!ELM_PORT.connect("OBDII"))
+    {
+        DEBUG_PORT.println("Couldn't connect to OBD scanner - Phase 1");
+        while (1)
+            ;
+    }
+
+    if (!myELM327.begin(ELM_PORT, true, 2000, '0', 128, 0, loadSession))
+    {
+        DEBUG_PORT.println("Couldn't connect to OBD scanner - Phase 2");
+        while (1)
+            ;
+    }
+
+    DEBUG_PORT.print("Connected to ELM327 in ");
+    DEBUG_PORT.print(myELM327.Init_Times.total_ms);
+    DEBUG_PORT.println("ms");
+
+    // Store the (possibly new) session for the next boot
+    myELM327.saveSession(storeSession);
+}
+
+void loop()
+{
+    float rpm = myELM327.rpm();
+
+    if (myELM327.nb_rx_state == ELM_SUCCESS)
+    {
+        DEBUG_PORT.print("rpm: ");
+        DEBUG_PORT.println(rpm);
+    }
+    else if (myELM327.nb_rx_state != ELM_GETTING_MSG)
+        myELM327.printError();
+}
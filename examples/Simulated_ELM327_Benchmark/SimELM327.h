@@ -0,0 +1,393 @@
+/*
+
+Simulated ELM327 for the Simulated_ELM327_Benchmark example and the host build in
+extras/host. A Stream that answers AT commands and a few OBD queries the way an ELM327
+would:
+ - Configurable reply latency per OBD protocol
+ - Echo (AT E0/E1), spaces (AT S0/S1) and headers (AT H0/H1)
+ - Multi-frame (ISO-TP) replies, e.g. the VIN
+ - Multi-PID requests
+ - Serial link speed and the "AT BRD" baud rate handshake (see negotiateBaud())
+ - Some common clone quirks
+
+*/
+
+#pragma once
+
+#include "Arduino.h"
+
+// Canned ECU replies: request (without response count) and reply data bytes
+struct simReply {
+    const char *request;
+    const char *data;
+};
+
+const simReply SIM_REPLIES[] = {
+    {"0100", "4100BE3FA813"},
+    {"0120", "412090058000"},
+    {"0140", "4140FED08400"},
+    {"0105", "41057B"},
+    {"010C", "410C1AF8"},
+    {"010D", "410D32"},
+    {"0111", "411133"},
+    {"011F", "411F411F"}, // Run time 16671 s - the data reads like a second response header
+    {"03",   "43010133"},
+    {"010C0D05", "410C1AF80D32057B"}, // Multi-PID request - 8 data bytes, so 2 ISO-TP frames
+    {"010D11",   "410D321133"},
+    {"0902", "4902013144344750303052353542313233343536"}, // VIN "1D4GP00R55B123456"
+};
+
+class SimELM327 : public Stream
+{
+public:
+    // Reply latency in ms for protocols '1' to 'C' - index 0 is used while searching
+    uint16_t latency_ms[13] = {100, 60, 60, 50, 50, 50, 10, 10, 10, 10, 20, 10, 10};
+
+    // Clone quirks
+    bool quirkStuckEcho  = false; // Ignores AT E0
+    bool quirkSearching  = false; // Prints "SEARCHING..." before the first OBD reply
+    bool quirkNoBlankLine = false; // Ends replies with "\r>" instead of "\r\r>"
+
+    // Serial link - with baud = 0 replies arrive all at once
+    uint32_t baud     = 0;      // Rate of the ELM327 side
+    uint32_t hostBaud = 0;      // Rate of the host side - see setSimHostBaud()
+    uint32_t maxBaud  = 250000; // Fastest rate the adapter's UART works at
+
+    // Baud rate handshake faults
+    const char *brdId     = "ELM327 v1.5"; // ID sent at the new rate
+    bool        brdLoseCR = false;         // The confirming CR gets lost, so no prompt follows
+
+    uint32_t numCommands = 0;
+
+    void reset()
+    {
+        echo = true;
+        spaces = true;
+        headers = false;
+        searched = false;
+        protocol = '0';
+        cmdLen = 0;
+        replyLen = 0;
+        replyIdx = 0;
+    }
+
+    size_t write(uint8_t c) override
+    {
+        // Only a CR at the new rate completes the baud rate handshake
+        if (brdState == BRD_WAIT_CR)
+        {
+            serviceBaudSwitch();
+
+            if ((brdState == BRD_WAIT_CR) && (c == '\r') && linkWorks(brdBaud) && !brdLoseCR)
+            {
+                baud = brdBaud;
+                brdState = BRD_IDLE;
+                startReply("OK\r\r>", 0);
+            }
+
+            return 1;
+        }
+
+        if (c == '\r')
+        {
+            cmd[cmdLen] = '\0';
+
+            if (cmdLen)
+                strcpy(lastCmd, cmd);
+
+            handleCommand(cmdLen ? cmd : lastCmd);
+            cmdLen = 0;
+        }
+        else if (c != ' ' && cmdLen < sizeof(cmd) - 1)
+            cmd[cmdLen++] = toupper(c);
+
+        return 1;
+    }
+
+    int available() override
+    {
+        serviceBaudSwitch();
+
+        int32_t elapsed_us = micros() - readyAt_us;
+
+        if (elapsed_us < 0)
+            return 0;
+
+        // 10 bits per char
+        uint16_t numSent = replyLen;
+
+        if (baud && ((uint64_t)elapsed_us * baud / 10000000UL) < numSent)
+            numSent = (uint64_t)elapsed_us * baud / 10000000UL;
+
+        return (numSent > replyIdx) ? numSent - replyIdx : 0;
+    }
+
+    int read() override
+    {
+        if (!available())
+            return -1;
+
+        char c = reply[replyIdx++];
+
+        // Chars sent at a rate the host isn't using (or the UART can't reach) are garbage
+        return linkWorks(baud) ? c : 0xF0;
+    }
+
+    int peek() override
+    {
+        if (!available())
+            return -1;
+
+        return reply[replyIdx];
+    }
+
+    void flush() override {}
+
+private:
+    bool     echo     = true;
+    bool     spaces   = true;
+    bool     headers  = false;
+    bool     searched = false;
+    char     protocol = '0';
+    char     cmd[32];
+    char     lastCmd[32] = {0};
+    uint8_t  cmdLen   = 0;
+    char     reply[256];
+    uint16_t replyLen = 0;
+    uint16_t replyIdx = 0;
+    uint32_t readyAt_us = 0;
+
+    // "AT BRD" handshake
+    enum { BRD_IDLE, BRD_SEND_OK, BRD_WAIT_CR } brdState = BRD_IDLE;
+    uint32_t brdBaud     = 0;
+    uint32_t prevBaud    = 0;
+    uint32_t brdDeadline = 0;
+    uint8_t  brt         = 0x0F; // Handshake timeout in units of 5 ms
+
+    // UARTs tolerate a few percent of baud rate difference
+    bool linkWorks(uint32_t elmBaud)
+    {
+        uint32_t difference = (elmBaud > hostBaud) ? elmBaud - hostBaud : hostBaud - elmBaud;
+
+        return !elmBaud || !hostBaud || ((difference * 100 <= hostBaud * 3) && (elmBaud <= maxBaud));
+    }
+
+    void startReply(const char *str, uint16_t latency)
+    {
+        replyLen = 0;
+        replyIdx = 0;
+        append(str);
+        readyAt_us = micros() + latency * 1000UL;
+    }
+
+    // The ELM327 switches once "OK" is sent, then sends its ID at the new rate and waits
+    // for a CR. Without one, it goes back to the previous rate and prints a prompt
+    void serviceBaudSwitch()
+    {
+        if ((brdState == BRD_SEND_OK) && (replyIdx == replyLen))
+        {
+            baud = brdBaud;
+            brdState = BRD_WAIT_CR;
+            startReply(brdId, 0);
+            append("\r");
+            brdDeadline = millis() + 10000UL * replyLen / baud + brt * 5;
+        }
+        else if ((brdState == BRD_WAIT_CR) && ((int32_t)(millis() - brdDeadline) > 0))
+        {
+            baud = prevBaud;
+            brdState = BRD_IDLE;
+            startReply("\r>", 0);
+        }
+    }
+
+    void append(const char *str)
+    {
+        while (*str && replyLen < sizeof(reply) - 1)
+            reply[replyLen++] = *str++;
+    }
+
+    void appendBytes(const char *hex, uint8_t numBytes)
+    {
+        for (uint8_t i = 0; i < numBytes; i++)
+        {
+            char byteStr[4] = {hex[2 * i], hex[2 * i + 1], ' ', '\0'};
+
+            if (!spaces || i == numBytes - 1)
+                byteStr[2] = '\0';
+
+            append(byteStr);
+        }
+    }
+
+    void appendHeader(uint8_t pci)
+    {
+        char header[10];
+
+        snprintf(header, sizeof(header), spaces ? "7E8 %02X " : "7E8%02X", pci);
+        append(header);
+    }
+
+    // Formats the reply data the way an ELM327 on a CAN protocol does, splitting it
+    // into ISO-TP frames if it doesn't fit in a single frame
+    void appendData(const char *data)
+    {
+        uint8_t numBytes = strlen(data) / 2;
+
+        if (numBytes <= 7)
+        {
+            if (headers)
+                appendHeader(numBytes);
+
+            appendBytes(data, numBytes);
+            append("\r");
+            return;
+        }
+
+        char line[8];
+
+        if (!headers)
+        {
+            snprintf(line, sizeof(line), "%03X\r", numBytes);
+            append(line);
+        }
+
+        for (uint8_t frame = 0, idx = 0; idx < numBytes; frame++)
+        {
+            uint8_t frameBytes = (frame == 0) ? 6 : 7;
+
+            if (frameBytes > numBytes - idx)
+                frameBytes = numBytes - idx;
+
+            if (headers)
+            {
+                appendHeader(frame == 0 ? 0x10 : 0x20 | (frame & 0xF));
+
+                if (frame == 0)
+                {
+                    snprintf(line, sizeof(line), spaces ? "%02X " : "%02X", numBytes);
+                    append(line);
+                }
+            }
+            else
+            {
+                snprintf(line, sizeof(line), spaces ? "%X: " : "%X:", frame & 0xF);
+                append(line);
+            }
+
+            appendBytes(data + 2 * idx, frameBytes);
+            append("\r");
+            idx += frameBytes;
+        }
+    }
+
+    const char *findReply(const char *request)
+    {
+        for (uint8_t i = 0; i < sizeof(SIM_REPLIES) / sizeof(SIM_REPLIES[0]); i++)
+        {
+            uint8_t len = strlen(SIM_REPLIES[i].request);
+
+            // Allow the optional response count digit after the request
+            if (!strncmp(request, SIM_REPLIES[i].request, len) && strlen(request) <= len + 1u)
+                return SIM_REPLIES[i].data;
+        }
+
+        return NULL;
+    }
+
+    void handleCommand(const char *command)
+    {
+        numCommands++;
+        replyLen = 0;
+        replyIdx = 0;
+
+        if (echo || quirkStuckEcho)
+        {
+            append(command);
+            append("\r");
+        }
+
+        uint16_t latency = 0;
+
+        if (!strncmp(command, "AT", 2))
+        {
+            const char *at = command + 2;
+
+            if (!strcmp(at, "Z") || !strcmp(at, "WS") || !strcmp(at, "D"))
+            {
+                reset();
+                append("\r\rELM327 v1.5\r");
+            }
+            else if (!strcmp(at, "I"))
+                append("ELM327 v1.5\r");
+            else if (!strncmp(at, "BRD", 3))
+            {
+                uint8_t divisor = strtol(at + 3, NULL, 16);
+
+                if (divisor < 8)
+                    append("?\r");
+                else
+                {
+                    // "OK" without a prompt, then the rate switch - see serviceBaudSwitch()
+                    append("OK\r");
+                    prevBaud = baud;
+                    brdBaud  = 4000000UL / divisor;
+                    brdState = BRD_SEND_OK;
+                    readyAt_us = micros() + txTime_us(command);
+                    return;
+                }
+            }
+            else if (!strcmp(at, "DPN"))
+            {
+                char dpn[4] = {'A', protocol == '0' ? '6' : protocol, '\r', '\0'};
+                append(dpn);
+            }
+            else
+            {
+                if (!strcmp(at, "E0") || !strcmp(at, "E1"))
+                    echo = at[1] == '1';
+                else if (!strcmp(at, "S0") || !strcmp(at, "S1"))
+                    spaces = at[1] == '1';
+                else if (!strcmp(at, "H0") || !strcmp(at, "H1"))
+                    headers = at[1] == '1';
+                else if (!strncmp(at, "SP", 2) || !strncmp(at, "TP", 2))
+                    protocol = (at[2] == 'A') ? at[3] : at[2];
+                else if (!strncmp(at, "BRT", 3))
+                    brt = strtol(at + 3, NULL, 16);
+
+                append("OK\r");
+            }
+        }
+        else
+        {
+            char activeProtocol = (protocol == '0') ? '6' : protocol;
+
+            latency = latency_ms[(activeProtocol <= '9') ? activeProtocol - '0' : activeProtocol - 'A' + 10];
+
+            if (!searched)
+            {
+                latency += latency_ms[0];
+                searched = true;
+
+                if (quirkSearching)
+                    append("SEARCHING...\r");
+            }
+
+            const char *data = findReply(command);
+
+            if (data)
+                appendData(data);
+            else
+                append("NO DATA\r");
+        }
+
+        // Every reply line ends with a CR - the prompt follows a blank line
+        append(quirkNoBlankLine ? ">" : "\r>");
+        readyAt_us = micros() + latency * 1000UL + txTime_us(command);
+    }
+
+    // Time to receive a command and its CR
+    uint32_t txTime_us(const char *command)
+    {
+        return baud ? (strlen(command) + 1) * 10000000UL / baud : 0;
+    }
+};
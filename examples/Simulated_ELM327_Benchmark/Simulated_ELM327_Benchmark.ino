@@ -0,0 +1,453 @@
+/*
+
+This example runs ELMduino against a simulated ELM327 instead of a real
+adapter and car, so library changes can be benchmarked on the bench.
+
+The simulator (see SimELM327.h) is a Stream that answers AT commands and a
+few OBD queries the way an ELM327 would. It supports:
+ - Configurable reply latency per OBD protocol
+ - Echo (AT E0/E1), spaces (AT S0/S1) and headers (AT H0/H1)
+ - Multi-frame (ISO-TP) replies, e.g. the VIN
+ - A reply whose data reads like a second response header (run time)
+ - Serial link speed and the "AT BRD" baud rate handshake (see negotiateBaud())
+ - Some common clone quirks
+
+The benchmark times the standard PID path (processPID()), multi-PID requests
+(processPIDs()), currentDTCCodes() and get_vin_blocking(), also with headers
+on, with the clone quirks, with repeatQueries on and on K-Line (where each PID
+of a multi-PID request is queried on its own). It reports queries per second, microseconds per query and
+the free memory before and after each run, and checks the decoded values.
+It also prints the size of the ELM327 and ELM327Static objects and the lowest
+free stack (ESP32 only).
+The receive benchmark counts the calls to rpm() and the microseconds each query
+takes with bulkReceive off (one char per get_response() call) and on (everything
+available drained per call), with replies arriving all at once and at 38400 baud
+with 1 ms of other work in loop() between the calls.
+A micro-benchmark compares the response decoding of findResponse() with the
+nibble-at-a-time decoder it used before, and the floating point value of a
+PID with its fixed-point value (see readFixed()).
+
+Run it once with zero latency to see the CPU cost of each path. Then run it
+with realistic latencies to see the throughput you can expect in a car, and
+at each baud rate the simulated adapter can be switched to.
+
+The same sketch builds and runs on a Linux/macOS host - see extras/host.
+
+*/
+
+#include "ELMduino.h"
+#include "SimELM327.h"
+
+#define DEBUG_PORT Serial
+
+const uint16_t NUM_ITERATIONS = 200;
+const uint16_t NUM_DECODES    = 10000;
+
+SimELM327 sim;
+uint16_t  numFailures = 0;
+
+// Switches the host side of the link - with a real adapter this would be i.e.
+// ELM_PORT.updateBaudRate(baud) (ESP32) or ELM_PORT.begin(baud)
+bool setSimHostBaud(const uint32_t &baud)
+{
+    sim.hostBaud = baud;
+    return true;
+}
+
+// Comment out to benchmark the heap allocated buffers of ELM327
+#define USE_STATIC_BUFFERS
+
+#ifdef USE_STATIC_BUFFERS
+ELM327Static<128> myELM327;
+#else
+ELM327 myELM327;
+#endif
+
+int freeStack()
+{
+#if defined(ESP32)
+    return uxTaskGetStackHighWaterMark(NULL);
+#else
+    return -1;
+#endif
+}
+
+int freeMemory()
+{
+#if defined(ESP32) || defined(ESP8266)
+    return ESP.getFreeHeap();
+#elif defined(__AVR__)
+    extern int __heap_start, *__brkval;
+    int top;
+    return (int)&top - (__brkval == 0 ? (int)&__heap_start : (int)__brkval);
+#else
+    return -1;
+#endif
+}
+
+void printResult(const __FlashStringHelper *name, uint32_t elapsed_us, uint16_t numQueries, int freeBefore)
+{
+    DEBUG_PORT.print(name);
+    DEBUG_PORT.print(F(": "));
+    DEBUG_PORT.print(numQueries * 1000000.0 / elapsed_us);
+    DEBUG_PORT.print(F(" queries/s, "));
+    DEBUG_PORT.print((float)elapsed_us / numQueries);
+    DEBUG_PORT.print(F(" us/query, free memory "));
+    DEBUG_PORT.print(freeBefore);
+    DEBUG_PORT.print(F(" -> "));
+    DEBUG_PORT.println(freeMemory());
+}
+
+// Reports a wrong result - the numbers of a run that decodes garbage are meaningless
+void check(bool ok, const __FlashStringHelper *what)
+{
+    if (ok)
+        return;
+
+    numFailures++;
+    DEBUG_PORT.print(F("FAILED: "));
+    DEBUG_PORT.println(what);
+}
+
+// canBus - whether the library detected a CAN protocol, so processPIDs() sends a whole
+// batch in one query instead of one query per PID
+void runBenchmarks(uint16_t numIterations, bool canBus = true)
+{
+    uint32_t start;
+    int freeBefore;
+    char vin[18] = {0};
+    float rpm = 0;
+    uint16_t runTime = 0;
+    int8_t status;
+
+    // Standard PID path - rpm() -> processPID()
+    freeBefore = freeMemory();
+    start = micros();
+
+    for (uint16_t i = 0; i < numIterations; i++)
+    {
+        do
+        {
+            rpm = myELM327.rpm();
+        } while (myELM327.nb_rx_state == ELM_GETTING_MSG);
+    }
+
+    printResult(F("processPID()      "), micros() - start, numIterations, freeBefore);
+    check((myELM327.nb_rx_state == ELM_SUCCESS) && (rpm == 1726), F("rpm"));
+
+    // Data bytes that read like the response header must still decode as data
+    do
+    {
+        runTime = myELM327.runTime();
+    } while (myELM327.nb_rx_state == ELM_GETTING_MSG);
+
+    check((myELM327.nb_rx_state == ELM_SUCCESS) && (runTime == 16671), F("run time (data reads like the header)"));
+
+    // Multi-PID path - processPIDs() -> parseBatchResponse(). The PIDs' byte counts and
+    // scaling come from the PID descriptor table
+    pidRequest batch[] = {{ENGINE_RPM}, {VEHICLE_SPEED}, {ENGINE_COOLANT_TEMP}};
+    pidRequest pair[]  = {{VEHICLE_SPEED}, {THROTTLE_POSITION}};
+    uint8_t    numBatch = sizeof(batch) / sizeof(batch[0]);
+    uint32_t   numCommands;
+
+    freeBefore = freeMemory();
+    start = micros();
+    numCommands = sim.numCommands;
+
+    for (uint16_t i = 0; i < numIterations; i++)
+    {
+        do
+        {
+            myELM327.processPIDs(SERVICE_01, batch, numBatch);
+        } while (myELM327.nb_rx_state == ELM_GETTING_MSG);
+    }
+
+    numCommands = sim.numCommands - numCommands;
+
+    printResult(F("processPIDs()     "), micros() - start, numIterations, freeBefore);
+    check((myELM327.nb_rx_state == ELM_SUCCESS) &&
+          batch[0].valid && (batch[0].value == 1726) &&
+          batch[1].valid && (batch[1].value == 50) &&
+          batch[2].valid && (batch[2].value == 83), F("batch (multi-frame reply)"));
+    check(numCommands == (uint32_t)numIterations * (canBus ? 1 : numBatch), F("batch queries sent"));
+
+    do
+    {
+        myELM327.processPIDs(SERVICE_01, pair, sizeof(pair) / sizeof(pair[0]));
+    } while (myELM327.nb_rx_state == ELM_GETTING_MSG);
+
+    check((myELM327.nb_rx_state == ELM_SUCCESS) &&
+          pair[0].valid && (pair[0].value == 50) &&
+          pair[1].valid && (fabs(pair[1].value - 20) < 0.01), F("batch (single frame reply)"));
+
+    // DTC path
+    freeBefore = freeMemory();
+    start = micros();
+
+    for (uint16_t i = 0; i < numIterations; i++)
+        myELM327.currentDTCCodes();
+
+    printResult(F("currentDTCCodes() "), micros() - start, numIterations, freeBefore);
+    check((myELM327.DTC_Response.codesFound == 1) && !strcmp(myELM327.DTC_Response.codes[0], "P0133"), F("DTC"));
+
+    // Multi-frame path
+    freeBefore = freeMemory();
+    start = micros();
+
+    for (uint16_t i = 0; i < numIterations; i++)
+        status = myELM327.get_vin_blocking(vin);
+
+    printResult(F("get_vin_blocking()"), micros() - start, numIterations, freeBefore);
+    check((status == ELM_SUCCESS) && !strcmp(vin, "1D4GP00R55B123456"), F("VIN"));
+
+    DEBUG_PORT.print(F("Last VIN: "));
+    DEBUG_PORT.println(vin);
+    DEBUG_PORT.print(F("Lowest free stack so far: "));
+    DEBUG_PORT.println(freeStack());
+}
+
+// The nibble-at-a-time decoder findResponse() used before the lookup table, kept
+// here as the reference for the decode benchmark
+uint64_t legacyDecode(const char *reply, const char *header)
+{
+    const char *firstHead = strstr(reply, header);
+
+    if (!firstHead)
+        return 0;
+
+    const char *secondHead  = strstr(firstHead + 1, header);
+    uint8_t     firstDatum  = (firstHead - reply) + strlen(header);
+    uint8_t     numPayChars = secondHead ? (secondHead - reply) - firstDatum : strlen(reply) - firstDatum;
+    uint64_t    response    = 0;
+
+    for (uint8_t i = 0; i < numPayChars; i++)
+    {
+        char    c      = reply[firstDatum + i];
+        uint8_t nibble = (c >= 'A') ? c - 'A' + 10 : c - '0';
+
+        response = response | ((uint64_t)nibble << (4 * (numPayChars - i - 1)));
+    }
+
+    return response;
+}
+
+void printDecodeResult(const __FlashStringHelper *name, uint32_t elapsed_us)
+{
+    DEBUG_PORT.print(name);
+    DEBUG_PORT.print(F(": "));
+    DEBUG_PORT.print((float)elapsed_us / NUM_DECODES, 3);
+    DEBUG_PORT.print(F(" us/decode"));
+#ifdef F_CPU
+    DEBUG_PORT.print(F(", "));
+    DEBUG_PORT.print((float)elapsed_us * (F_CPU / 1000000L) / NUM_DECODES, 1);
+    DEBUG_PORT.print(F(" cycles/decode"));
+#endif
+    DEBUG_PORT.println();
+}
+
+// Decodes the same rpm reply with the old and the current decoder - no serial I/O involved
+void runDecodeBenchmark()
+{
+    volatile uint64_t sink;
+    uint32_t start;
+
+    // Sets up the expected header of findResponse() and leaves an rpm reply in the payload
+    do
+    {
+        myELM327.rpm();
+    } while (myELM327.nb_rx_state == ELM_GETTING_MSG);
+
+    start = micros();
+
+    for (uint16_t i = 0; i < NUM_DECODES; i++)
+        sink = legacyDecode(myELM327.payload, "410C");
+
+    printDecodeResult(F("Legacy decode   "), micros() - start);
+
+    start = micros();
+
+    for (uint16_t i = 0; i < NUM_DECODES; i++)
+        sink = myELM327.findResponse();
+
+    printDecodeResult(F("findResponse()  "), micros() - start);
+
+    // Value of the decoded bytes - floating point vs fixed-point (rpm * 4)
+    volatile double  valueSink;
+    volatile int32_t fixedSink;
+
+    start = micros();
+
+    for (uint16_t i = 0; i < NUM_DECODES; i++)
+        valueSink = myELM327.conditionResponse(2, 1.0 / 4.0);
+
+    printDecodeResult(F("Float value     "), micros() - start);
+
+    start = micros();
+
+    for (uint16_t i = 0; i < NUM_DECODES; i++)
+        fixedSink = myELM327.fixedValue(ENGINE_RPM);
+
+    printDecodeResult(F("Fixed value     "), micros() - start);
+    (void)sink;
+    (void)valueSink;
+    (void)fixedSink;
+}
+
+// Calls to rpm() and time per query with the one-char-per-call and the bulk receive path
+void runReceiveBenchmark()
+{
+    const uint32_t LINK_BAUDS[] = {0, 38400};
+    const uint32_t WORK_US[]    = {0, 1000}; // Time the rest of loop() takes per call
+
+    for (uint8_t b = 0; b < sizeof(LINK_BAUDS) / sizeof(LINK_BAUDS[0]); b++)
+    {
+        sim.baud     = LINK_BAUDS[b];
+        sim.hostBaud = LINK_BAUDS[b];
+
+        for (uint8_t bulk = 0; bulk < 2; bulk++)
+        {
+            uint32_t numCalls = 0;
+            uint32_t start;
+            float    rpm = 0;
+
+            myELM327.bulkReceive = bulk;
+            start = micros();
+
+            for (uint16_t i = 0; i < NUM_ITERATIONS; i++)
+            {
+                do
+                {
+                    rpm = myELM327.rpm();
+                    numCalls++;
+
+                    uint32_t workStart = micros();
+
+                    while ((myELM327.nb_rx_state == ELM_GETTING_MSG) && ((micros() - workStart) < WORK_US[b]));
+                } while (myELM327.nb_rx_state == ELM_GETTING_MSG);
+            }
+
+            uint32_t elapsed_us = micros() - start;
+
+            DEBUG_PORT.print(bulk ? F("Bulk receive on,  ") : F("Bulk receive off, "));
+
+            if (LINK_BAUDS[b])
+            {
+                DEBUG_PORT.print(LINK_BAUDS[b]);
+                DEBUG_PORT.print(F(" baud, "));
+                DEBUG_PORT.print(WORK_US[b]);
+                DEBUG_PORT.print(F(" us loop(): "));
+            }
+            else
+                DEBUG_PORT.print(F("no link limit: "));
+
+            DEBUG_PORT.print((float)numCalls / NUM_ITERATIONS);
+            DEBUG_PORT.print(F(" calls/query, "));
+            DEBUG_PORT.print((float)elapsed_us / NUM_ITERATIONS);
+            DEBUG_PORT.println(F(" us/query"));
+            check((myELM327.nb_rx_state == ELM_SUCCESS) && (rpm == 1726), F("rpm"));
+        }
+    }
+
+    myELM327.bulkReceive = true;
+    sim.baud     = 0;
+    sim.hostBaud = 0;
+}
+
+void setup()
+{
+    DEBUG_PORT.begin(115200);
+
+    if (!myELM327.begin(sim, false, 1000))
+    {
+        DEBUG_PORT.println(F("Couldn't connect to the simulated ELM327"));
+        while (1);
+    }
+
+    DEBUG_PORT.print(F("sizeof(ELM327): "));
+    DEBUG_PORT.print(sizeof(ELM327));
+    DEBUG_PORT.print(F(", sizeof(ELM327Static<128>): "));
+    DEBUG_PORT.println(sizeof(ELM327Static<128>));
+
+    // CPU cost only - the simulator answers immediately
+    for (uint8_t i = 0; i < sizeof(sim.latency_ms) / sizeof(sim.latency_ms[0]); i++)
+        sim.latency_ms[i] = 0;
+
+    DEBUG_PORT.println(F("\nZero latency, no spaces:"));
+    runBenchmarks(NUM_ITERATIONS);
+
+    DEBUG_PORT.println(F("\nReceive path:"));
+    runReceiveBenchmark();
+
+    DEBUG_PORT.println(F("\nResponse decoding:"));
+    runDecodeBenchmark();
+
+    DEBUG_PORT.println(F("\nZero latency, spaces and headers on:"));
+    myELM327.sendCommand_Blocking("AT S1");
+    check(myELM327.setECUDemux(true), F("setECUDemux(true)"));
+    runBenchmarks(NUM_ITERATIONS);
+    myELM327.setECUDemux(false);
+    myELM327.sendCommand_Blocking("AT S0");
+
+    // The quirks of cheap clones - SEARCHING... is only printed after a reset
+    DEBUG_PORT.println(F("\nZero latency, clone quirks (stuck echo, SEARCHING..., no blank line):"));
+    sim.quirkStuckEcho   = true;
+    sim.quirkSearching   = true;
+    sim.quirkNoBlankLine = true;
+    check(myELM327.initializeELM(), F("initializeELM() with quirks"));
+    runBenchmarks(NUM_ITERATIONS);
+    sim.quirkStuckEcho   = false;
+    sim.quirkSearching   = false;
+    sim.quirkNoBlankLine = false;
+    check(myELM327.initializeELM(), F("initializeELM()"));
+
+    // Throughput with typical CAN (10 ms) and K-Line (50 ms) ECU reply times
+    DEBUG_PORT.println(F("\nISO 15765-4 CAN, 10 ms reply latency:"));
+    sim.latency_ms[6] = 10;
+    runBenchmarks(NUM_ITERATIONS / 10);
+
+    // Serial link speed - adapters usually boot at 38400 baud. The simulated UART can't
+    // reach 500000 baud, so that handshake fails and the link falls back
+    const uint32_t BAUD_RATES[] = {38400, 57600, 115200, 230400, 500000};
+    uint32_t currentBaud = BAUD_RATES[0];
+
+    sim.baud = currentBaud;
+    sim.hostBaud = currentBaud;
+
+    for (uint8_t i = 0; i < sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0]); i++)
+    {
+        DEBUG_PORT.print(F("\nISO 15765-4 CAN, 10 ms reply latency, "));
+        DEBUG_PORT.print(BAUD_RATES[i]);
+        DEBUG_PORT.println(F(" baud:"));
+
+        if ((BAUD_RATES[i] != currentBaud) && !myELM327.negotiateBaud(currentBaud, BAUD_RATES[i], setSimHostBaud))
+        {
+            DEBUG_PORT.print(F("Not achievable, staying at "));
+            DEBUG_PORT.println(currentBaud);
+            continue;
+        }
+
+        currentBaud = BAUD_RATES[i];
+        runBenchmarks(NUM_ITERATIONS / 10);
+    }
+
+    // Back-to-back identical queries sent as a lone CR - matters most on slow links
+    DEBUG_PORT.print(F("\nISO 15765-4 CAN, 10 ms reply latency, "));
+    DEBUG_PORT.print(currentBaud);
+    DEBUG_PORT.println(F(" baud, repeated queries:"));
+    myELM327.repeatQueries = true;
+    runBenchmarks(NUM_ITERATIONS / 10);
+    myELM327.repeatQueries = false;
+
+    DEBUG_PORT.println(F("\nISO 14230-4 KWP, 50 ms reply latency:"));
+    check(myELM327.initializeELM(ISO_14230_FAST_INIT), F("initializeELM(ISO_14230_FAST_INIT)"));
+    sim.latency_ms[5] = 50;
+    runBenchmarks(NUM_ITERATIONS / 10, false);
+
+    DEBUG_PORT.print(F("\nDone, "));
+    DEBUG_PORT.print(numFailures);
+    DEBUG_PORT.println(F(" failure(s)"));
+}
+
+void loop()
+{
+}
@@ -0,0 +1,77 @@
+#include "ELMduino.h"
+
+
+
+
+#define ELM_PORT Serial1
+
+
+
+
+const bool DEBUG        = true;
+const int  TIMEOUT      = 2000;
+const bool HALT_ON_FAIL = false;
+
+
+
+
+ELM327 myELM327;
+
+
+
+
+// On CAN vehicles all of these PIDs are requested with a single query ("010C0D05111").
+// On other protocols, ELMduino requests them one at a time.
+pidRequest requests[] = {
+  // pid,                 numExpectedBytes, scaleFactor,   bias
+  { ENGINE_RPM,           2,                1.0 / 4.0,     0     },
+  { VEHICLE_SPEED,        1,                1,             0     },
+  { ENGINE_COOLANT_TEMP,  1,                1,             -40.0 },
+  { THROTTLE_POSITION,    1,                100.0 / 255.0, 0     }
+};
+const uint8_t NUM_REQUESTS = sizeof(requests) / sizeof(requests[0]);
+
+
+
+
+void setup()
+{
+  Serial.begin(115200);
+  ELM_PORT.begin(115200);
+
+  Serial.println("Attempting to connect to ELM327...");
+
+  if (!myELM327.begin(ELM_PORT, DEBUG, TIMEOUT))
+  {
+    Serial.println("Couldn't connect to OBD scanner");
+
+    if (HALT_ON_FAIL)
+      while (1);
+  }
+
+  Serial.println("Connected to ELM327");
+}
+
+
+
+
+void loop()
+{
+  myELM327.processPIDs(SERVICE_01, requests, NUM_REQUESTS);
+
+  if (myELM327.nb_rx_state == ELM_SUCCESS)
+  {
+    for (uint8_t i = 0; i < NUM_REQUESTS; i++)
+    {
+      if (requests[i].valid)
+      {
+        Serial.print("PID 0x");
+        Serial.print(requests[i].pid, HEX);
+        Serial.print(": ");
+        Serial.println(requests[i].value);
+      }
+    }
+  }
+  else if (myELM327.nb_rx_state != ELM_GETTING_MSG)
+    myELM327.printError();
+}
@@ -0,0 +1,66 @@
+#include "ELMduino.h"
+
+
+
+
+#define ELM_PORT Serial1
+
+
+
+
+const bool DEBUG        = false;
+const int  TIMEOUT      = 2000;
+const bool HALT_ON_FAIL = false;
+
+
+
+
+ELM327 myELM327;
+
+
+
+
+void setup()
+{
+  Serial.begin(115200);
+  ELM_PORT.begin(115200);
+
+  Serial.println("Attempting to connect to ELM327...");
+
+  if (!myELM327.begin(ELM_PORT, DEBUG, TIMEOUT))
+  {
+    Serial.println("Couldn't connect to OBD scanner");
+
+    if (HALT_ON_FAIL)
+      while (1);
+  }
+
+  Serial.println("Connected to ELM327");
+
+  // Each PID is polled at its own rate (in Hz) - no state machine needed
+  myELM327.schedulePID(ENGINE_RPM,            20);
+  myELM327.schedulePID(VEHICLE_SPEED,         5);
+  myELM327.schedulePID(ENGINE_COOLANT_TEMP,   0.2);
+  myELM327.schedulePID(FUEL_TANK_LEVEL_INPUT, 0.05);
+}
+
+
+
+
+void loop()
+{
+  int8_t updated = myELM327.poll();
+
+  if (updated >= 0)
+  {
+    Serial.print("PID 0x");
+    Serial.print(myELM327.schedule[updated].pid, HEX);
+    Serial.print(": ");
+    Serial.print(myELM327.schedule[updated].value);
+    Serial.print(" (");
+    Serial.print(myELM327.schedule[updated].achievedRate);
+    Serial.print(" of ");
+    Serial.print(myELM327.schedule[updated].rate);
+    Serial.println(" Hz)");
+  }
+}
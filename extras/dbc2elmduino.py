@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""
+Converts the signal definitions of a DBC file into the precompiled tables ELMduino decodes
+broadcast CAN frames with - see ELM327::setSignalTable() and ELM327::decodeFrame().
+
+Usage:
+    python3 dbc2elmduino.py vehicle.dbc -o vehicle_signals.h [--ids 0C9,1E9] [--prefix VEH]
+
+The generated header holds <PREFIX>_MESSAGES, <PREFIX>_SIGNALS, their sizes and a constant
+with the index of each signal, which is also its index in the sampledValue array:
+
+    #include "vehicle_signals.h"
+
+    sampledValue values[VEH_NUM_SIGNALS];
+
+    myELM327.setSignalTable(VEH_MESSAGES, VEH_NUM_MESSAGES, VEH_SIGNALS, values);
+    ...
+    myELM327.decodeFrames();
+    float rpm = values[VEH_ECM_STATUS_ENGINESPEED].value;
+
+Multiplexed signals and signals longer than 32 bits are skipped.
+"""
+
+import argparse
+import re
+import sys
+
+MAX_MESSAGES = 32  # SIGNAL_MAX_MESSAGES
+MAX_SIGNALS  = 255
+
+MESSAGE_RE = re.compile(r'^BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+)\s+(\w+)')
+SIGNAL_RE  = re.compile(r'^SG_\s+(\w+)\s*(\w*)\s*:\s*(\d+)\|(\d+)@([01])([+-])\s*'
+                        r'\(\s*([^,\s]+)\s*,\s*([^)\s]+)\s*\)\s*\[[^\]]*\]\s*"([^"]*)"')
+
+
+def shift(start_bit, length, big_endian):
+    """Same as dbcShift() in ELMduino.h"""
+    if big_endian:
+        return 64 - ((start_bit // 8) * 8 + (7 - start_bit % 8)) - length
+    return start_bit
+
+
+def parse(lines, wanted_ids):
+    messages = []
+    message  = None
+
+    for number, line in enumerate(lines, 1):
+        line = line.strip()
+        match = MESSAGE_RE.match(line)
+
+        if match:
+            dbc_id   = int(match.group(1))
+            can_id   = dbc_id & 0x1FFFFFFF
+            extended = bool(dbc_id & 0x80000000)  # Bit 31 marks 29-bit IDs
+            message  = None
+
+            if (wanted_ids is None) or (can_id in wanted_ids):
+                message = {'id': can_id, 'extended': extended, 'name': match.group(2), 'signals': []}
+                messages.append(message)
+            continue
+
+        if not line.startswith('SG_'):
+            continue
+
+        match = SIGNAL_RE.match(line)
+
+        if not match:
+            print('line {}: can\'t parse "{}"'.format(number, line), file=sys.stderr)
+            continue
+
+        if message is None:
+            continue
+
+        name, mux, start, length, order, sign, scale, offset, unit = match.groups()
+        start, length = int(start), int(length)
+        big_endian = order == '0'
+
+        if mux:
+            print('{}.{}: multiplexed signal skipped'.format(message['name'], name), file=sys.stderr)
+            continue
+
+        if not 1 <= length <= 32:
+            print('{}.{}: {} bits, skipped'.format(message['name'], name, length), file=sys.stderr)
+            continue
+
+        bit_shift = shift(start, length, big_endian)
+
+        if not 0 <= bit_shift <= 64 - length:
+            print('{}.{}: doesn\'t fit in 8 bytes, skipped'.format(message['name'], name), file=sys.stderr)
+            continue
+
+        message['signals'].append({'name': name,
+                                   'start': start,
+                                   'length': length,
+                                   'shift': bit_shift,
+                                   'big_endian': big_endian,
+                                   'signed': sign == '-',
+                                   'scale': float(scale),
+                                   'offset': float(offset),
+                                   'unit': unit})
+
+    return [m for m in messages if m['signals']]
+
+
+def hex_id(message):
+    return '{:08X}'.format(message['id']) if message['extended'] else '{:03X}'.format(message['id'])
+
+
+def identifier(*parts):
+    return '_'.join(re.sub(r'[^A-Za-z0-9]+', '_', part).strip('_').upper() for part in parts)
+
+
+def generate(messages, prefix, source):
+    out = ['// Generated by dbc2elmduino.py from {} - do not edit'.format(source),
+           '#pragma once',
+           '#include "ELMduino.h"',
+           '',
+           'const canSignal {}_SIGNALS[] = {{'.format(prefix)]
+    names = []
+    index = 0
+
+    for message in messages:
+        message['first'] = index
+
+        for signal in message['signals']:
+            flags = []
+            if signal['big_endian']:
+                flags.append('SIGNAL_BIG_ENDIAN')
+            if signal['signed']:
+                flags.append('SIGNAL_SIGNED')
+
+            out.append('    {{ {:2d}, {:2d}, {}, {}f, {}f }}, // {} {}.{} - start bit {} [{}]'.format(
+                signal['shift'], signal['length'], ' | '.join(flags) or '0',
+                repr(signal['scale']), repr(signal['offset']),
+                hex_id(message), message['name'], signal['name'], signal['start'], signal['unit']))
+            names.append((identifier(prefix, message['name'], signal['name']), index))
+            index += 1
+
+    out += ['};',
+            '',
+            'const canMessage {}_MESSAGES[] = {{'.format(prefix)]
+
+    for message in messages:
+        out.append('    {{ 0x{}, {:3d}, {:2d}, {} }}, // {}'.format(
+            hex_id(message), message['first'], len(message['signals']),
+            'true' if message['extended'] else 'false', message['name']))
+
+    out += ['};',
+            '',
+            'constexpr uint8_t {}_NUM_MESSAGES = {};'.format(prefix, len(messages)),
+            'constexpr uint8_t {}_NUM_SIGNALS  = {};'.format(prefix, index),
+            '',
+            '// Index of each signal in {0}_SIGNALS and the sampledValue array'.format(prefix)]
+    out += ['constexpr uint8_t {} = {};'.format(name, i) for name, i in names]
+
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert a DBC file into ELMduino signal tables')
+    parser.add_argument('dbc', help='DBC file to convert')
+    parser.add_argument('-o', '--output', help='Header to write (default: stdout)')
+    parser.add_argument('--ids', help='Comma separated hex CAN IDs to keep (default: all)')
+    parser.add_argument('--prefix', default='DBC', help='Prefix of the generated names')
+    args = parser.parse_args()
+
+    wanted_ids = None
+
+    if args.ids:
+        wanted_ids = {int(can_id, 16) for can_id in args.ids.split(',')}
+
+    with open(args.dbc, encoding='latin-1') as dbc:
+        messages = parse(dbc.readlines(), wanted_ids)
+
+    if len(messages) > MAX_MESSAGES:
+        sys.exit('{} messages with signals - ELMduino takes up to {}, select some with --ids'.format(
+            len(messages), MAX_MESSAGES))
+
+    if sum(len(m['signals']) for m in messages) > MAX_SIGNALS:
+        sys.exit('More than {} signals - select some messages with --ids'.format(MAX_SIGNALS))
+
+    header = generate(messages, identifier(args.prefix), args.dbc)
+
+    if args.output:
+        with open(args.output, 'w') as output:
+            output.write(header)
+    else:
+        sys.stdout.write(header)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,121 @@
+#include "Arduino.h"
+
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial;
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+unsigned long millis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield()
+{
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+    size_t n = 0;
+
+    while (size--)
+        n += write(*buffer++);
+
+    return n;
+}
+
+size_t Print::print(long value, int base)
+{
+    if ((base == DEC) && (value < 0))
+        return print('-') + print((unsigned long)-value, base);
+
+    return print((unsigned long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    return print((unsigned long long)value, base);
+}
+
+size_t Print::print(long long value, int base)
+{
+    if ((base == DEC) && (value < 0))
+        return print('-') + print((unsigned long long)-value, base);
+
+    return print((unsigned long long)value, base);
+}
+
+size_t Print::print(unsigned long long value, int base)
+{
+    char buffer[72];
+
+    if (base == HEX)
+        snprintf(buffer, sizeof(buffer), "%llX", value);
+    else if (base == 8)
+        snprintf(buffer, sizeof(buffer), "%llo", value);
+    else if (base == 2)
+    {
+        uint8_t len = 0;
+
+        do
+        {
+            buffer[len++] = '0' + (value & 1);
+            value >>= 1;
+        } while (value);
+
+        for (uint8_t i = 0; i < len / 2; i++)
+        {
+            char c = buffer[i];
+            buffer[i] = buffer[len - 1 - i];
+            buffer[len - 1 - i] = c;
+        }
+
+        buffer[len] = '\0';
+    }
+    else
+        snprintf(buffer, sizeof(buffer), "%llu", value);
+
+    return write(buffer);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char buffer[64];
+
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+    return write(buffer);
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    // Arduino line ends are CRLF - the terminal only needs the LF
+    if (c != '\r')
+        fputc(c, stdout);
+
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        write(buffer[i]);
+
+    return size;
+}
+
+void HardwareSerial::flush()
+{
+    fflush(stdout);
+}
@@ -0,0 +1,9 @@
+// Host build of examples/Simulated_ELM327_Benchmark - see CMakeLists.txt
+#include "Simulated_ELM327_Benchmark.ino"
+
+int main()
+{
+    setup();
+
+    return numFailures ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+// Host test of the "AT BRD" baud rate handshake of ELM327::negotiateBaud() against the
+// simulated ELM327 - see CMakeLists.txt
+#include "ELMduino.h"
+#include "SimELM327.h"
+
+const uint32_t START_BAUD  = 38400;
+const uint32_t TARGET_BAUD = 115200;
+
+SimELM327 sim;
+ELM327    myELM327;
+uint16_t  numFailures = 0;
+bool      refuseBaud  = false;
+uint32_t  lastHostBaud = 0;
+
+// Host side of the link - refuses to switch if refuseBaud is set
+bool setSimHostBaud(const uint32_t &baud)
+{
+    lastHostBaud = baud;
+
+    if (refuseBaud && (baud != START_BAUD))
+        return false;
+
+    sim.hostBaud = baud;
+    return true;
+}
+
+void check(bool ok, const char *name, const char *what)
+{
+    if (ok)
+        return;
+
+    numFailures++;
+    Serial.print("FAILED: ");
+    Serial.print(name);
+    Serial.print(" - ");
+    Serial.println(what);
+}
+
+// The ELM327 runs at 4 MHz / divisor, i.e. 114285 baud for 115200
+bool sameRate(uint32_t elmBaud, uint32_t baud)
+{
+    uint32_t difference = (elmBaud > baud) ? elmBaud - baud : baud - elmBaud;
+
+    return (difference * 100) <= (baud * 3);
+}
+
+// Runs one handshake from START_BAUD and checks the rate both sides end up at and that
+// the ELM327 still answers queries
+void runCase(const char *name, bool expectSwitch)
+{
+    sim.baud     = START_BAUD;
+    sim.hostBaud = START_BAUD;
+    lastHostBaud = 0;
+
+    bool     switched  = myELM327.negotiateBaud(START_BAUD, TARGET_BAUD, setSimHostBaud);
+    uint32_t finalBaud = expectSwitch ? TARGET_BAUD : START_BAUD;
+
+    check(switched == expectSwitch, name, "negotiateBaud() result");
+    check(sim.hostBaud == finalBaud, name, "host baud rate");
+    check(sameRate(sim.baud, finalBaud), name, "ELM327 baud rate");
+    check(lastHostBaud == finalBaud, name, "last setHostBaud() call");
+
+    float rpm = 0;
+
+    do
+    {
+        rpm = myELM327.rpm();
+    } while (myELM327.nb_rx_state == ELM_GETTING_MSG);
+
+    check((myELM327.nb_rx_state == ELM_SUCCESS) && (rpm == 1726), name, "query after the handshake");
+
+    Serial.print(name);
+    Serial.println(switched ? ": switched" : ": fell back");
+}
+
+int main()
+{
+    if (!myELM327.begin(sim, false, 1000))
+    {
+        Serial.println("Couldn't connect to the simulated ELM327");
+        return 1;
+    }
+
+    for (uint8_t i = 0; i < sizeof(sim.latency_ms) / sizeof(sim.latency_ms[0]); i++)
+        sim.latency_ms[i] = 0;
+
+    runCase("Successful switch", true);
+
+    sim.brdId = "OBDII v2.1";
+    runCase("Wrong AT I echo", false);
+    sim.brdId = "ELM327 v1.5";
+
+    sim.brdLoseCR = true;
+    runCase("No prompt after the switch", false);
+    sim.brdLoseCR = false;
+
+    refuseBaud = true;
+    runCase("Callback refuses", false);
+    refuseBaud = false;
+
+    // The adapter's UART can't reach the rate
+    sim.maxBaud = 100000;
+    runCase("Rate out of reach", false);
+
+    Serial.print("Done, ");
+    Serial.print(numFailures);
+    Serial.println(" failure(s)");
+
+    return numFailures ? 1 : 0;
+}
@@ -0,0 +1,138 @@
+// Host test of ELM327::decodeFrame() with the signal tables extras/dbc2elmduino.py generates
+// from test.dbc (test_signals.h, generated at build time) and with hand-made tables - see
+// CMakeLists.txt
+#include "ELMduino.h"
+#include "test_signals.h"
+
+ELM327       myELM327;
+sampledValue values[TEST_NUM_SIGNALS];
+uint16_t     numFailures = 0;
+
+void check(bool ok, const char *name, const char *what)
+{
+    if (ok)
+        return;
+
+    numFailures++;
+    Serial.print("FAILED: ");
+    Serial.print(name);
+    Serial.print(" - ");
+    Serial.println(what);
+}
+
+bool near(double value, double expected)
+{
+    return fabs(value - expected) < 0.001;
+}
+
+uint8_t decode(uint32_t id, bool extended, const uint8_t data[], uint8_t len)
+{
+    canFrame frame;
+
+    frame.id           = id;
+    frame.timestamp_ms = millis();
+    frame.extended     = extended;
+    frame.len          = len;
+    memcpy(frame.data, data, len);
+
+    return myELM327.decodeFrame(frame);
+}
+
+// DBC start bits of Motorola signals count from the MSB of each byte
+void testShift()
+{
+    const char *name = "dbcShift()";
+
+    check(dbcShift(7, 16, true) == 48, name, "bytes 0-1, big endian");
+    check(dbcShift(39, 16, true) == 16, name, "bytes 4-5, big endian");
+    check(dbcShift(3, 10, true) == 50, name, "10 bits from bit 3 of byte 0, big endian");
+    check(dbcShift(12, 4, true) == 49, name, "bits 12-9, big endian");
+    check(dbcShift(7, 64, true) == 0, name, "whole frame, big endian");
+    check(dbcShift(24, 12, false) == 24, name, "little endian");
+}
+
+void testGeneratedTable()
+{
+    const char *name = "Generated table";
+
+    check((TEST_NUM_MESSAGES == 4) && (TEST_NUM_SIGNALS == 7), name, "multiplexed signal or message without signals kept");
+    check(myELM327.setSignalTable(TEST_MESSAGES, TEST_NUM_MESSAGES, TEST_SIGNALS, values), name, "table refused");
+
+    // 1726 rpm, 83 degC, -100 Nm (12-bit raw -200)
+    const uint8_t ecm[8] = {0x1A, 0xF8, 0x7B, 0x38, 0x0F, 0x00, 0x00, 0x00};
+
+    check(decode(0x0C9, false, ecm, sizeof(ecm)) == 3, name, "ECM_Status signals decoded");
+    check(near(values[TEST_ECM_STATUS_ENGINESPEED].value, 1726), name, "big endian EngineSpeed");
+    check(near(values[TEST_ECM_STATUS_COOLANTTEMP].value, 83), name, "CoolantTemp offset");
+    check((values[TEST_ECM_STATUS_TORQUE].fixedValue == -200) && near(values[TEST_ECM_STATUS_TORQUE].value, -100), name, "signed Torque");
+    check(values[TEST_EXT_STATUS_SPEED].samples == 0, name, "11-bit frame decoded as the 29-bit message with its ID");
+
+    // 29-bit frame with the same ID, 50 km/h
+    const uint8_t ext[8] = {0x88, 0x13, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+    check(decode(0x0C9, true, ext, sizeof(ext)) == 1, name, "Ext_Status signals decoded");
+    check(near(values[TEST_EXT_STATUS_SPEED].value, 50), name, "Ext_Status Speed");
+    check(values[TEST_ECM_STATUS_ENGINESPEED].samples == 1, name, "29-bit frame decoded as the 11-bit message with its ID");
+
+    // 1366 kPa across bytes 0-1, -123.4 deg in bytes 4-5
+    const uint8_t chassis[8] = {0x0A, 0xAC, 0x00, 0x00, 0xFB, 0x2E, 0x07, 0x00};
+
+    check(decode(0x1F4, false, chassis, sizeof(chassis)) == 2, name, "Chassis signals decoded");
+    check((values[TEST_CHASSIS_PRESSURE].fixedValue == 683) && near(values[TEST_CHASSIS_PRESSURE].value, 1366), name, "big endian Pressure across bytes");
+    check((values[TEST_CHASSIS_STEERINGANGLE].fixedValue == -1234) && near(values[TEST_CHASSIS_STEERINGANGLE].value, -123.4), name, "big endian signed SteeringAngle");
+
+    const uint8_t ccvs1[8] = {0xFF, 0x00, 0x32, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+    check(decode(0x18FEF100, true, ccvs1, sizeof(ccvs1)) == 1, name, "CCVS1 signals decoded");
+    check(near(values[TEST_CCVS1_WHEELSPEED].value, 50), name, "CCVS1 WheelSpeed");
+
+    check(decode(0x1F4, true, chassis, sizeof(chassis)) == 0, name, "29-bit frame of an 11-bit message ID decoded");
+    check(decode(0x3E8, false, chassis, sizeof(chassis)) == 0, name, "message without signals decoded");
+}
+
+void testHandMadeTable()
+{
+    const char *name = "Hand-made table";
+
+    // A signed 32-bit signal and an unsigned one in a single byte
+    const canSignal signals[] = {
+        { 0, 32, SIGNAL_SIGNED, 1.0f, 0.0f },
+        { dbcShift(12, 4, true), 4, SIGNAL_BIG_ENDIAN, 1.0f, 0.0f },
+    };
+    const canMessage messages[]    = {{0x200, 0, 2}};
+    const canMessage duplicates[]  = {{0x200, 0, 1}, {0x200, 1, 1}};
+    const canMessage badMessages[] = {{0x200, 0, 1, true}};
+    const canSignal  badSignal[]   = {{ 40, 32, 0, 1.0f, 0.0f }};
+
+    check(!myELM327.setSignalTable(duplicates, 2, signals, values), name, "duplicate ID accepted");
+    check(!myELM327.setSignalTable(badMessages, 1, badSignal, values), name, "signal past the end of the frame accepted");
+    check(myELM327.setSignalTable(messages, 1, signals, values), name, "table refused");
+
+    const uint8_t minusOne[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00};
+
+    check(decode(0x200, false, minusOne, sizeof(minusOne)) == 2, name, "signals decoded");
+    check(values[0].fixedValue == -1, name, "signed 32-bit signal");
+    check(values[1].fixedValue == 0xF, name, "4-bit big endian signal");
+
+    // Bits past the end of a short frame read as 0
+    const uint8_t shortFrame[2] = {0xFF, 0x0A};
+
+    decode(0x200, false, shortFrame, sizeof(shortFrame));
+    check(values[0].fixedValue == 0x0AFF, name, "short frame");
+    check(values[1].fixedValue == 0x5, name, "4-bit big endian signal of a short frame");
+
+    check(!myELM327.setSignalTable(nullptr, 0, nullptr, nullptr) && (decode(0x200, false, shortFrame, 2) == 0), name, "cleared table decodes");
+}
+
+int main()
+{
+    testShift();
+    testGeneratedTable();
+    testHandMadeTable();
+
+    Serial.print("Done, ");
+    Serial.print(numFailures);
+    Serial.println(" failure(s)");
+
+    return numFailures ? 1 : 0;
+}
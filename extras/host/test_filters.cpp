@@ -0,0 +1,148 @@
+// Host test of ELM327::planMonitorFilters() - the "AT CF"/"AT CM" windows planned for lists
+// of CAN IDs, with and without a bus sample. See CMakeLists.txt
+#include "ELMduino.h"
+
+ELM327        myELM327;
+monitorWindow windows[4];
+uint16_t      numFailures = 0;
+
+void check(bool ok, const char *name, const char *what)
+{
+    if (ok)
+        return;
+
+    numFailures++;
+    Serial.print("FAILED: ");
+    Serial.print(name);
+    Serial.print(" - ");
+    Serial.println(what);
+}
+
+bool passes(const monitorWindow &window, uint32_t id)
+{
+    return (id & window.mask) == window.filter;
+}
+
+// Every requested ID passes a window and the windows account for all of them
+void checkCoverage(const char *name, const uint32_t ids[], uint8_t numIds, uint8_t numWindows)
+{
+    uint8_t counted = 0;
+
+    for (uint8_t w = 0; w < numWindows; w++)
+        counted += windows[w].numIds;
+
+    check(counted == numIds, name, "IDs counted by the windows");
+
+    for (uint8_t i = 0; i < numIds; i++)
+    {
+        bool passed = false;
+
+        for (uint8_t w = 0; w < numWindows; w++)
+            passed |= passes(windows[w], ids[i]);
+
+        check(passed, name, "requested ID doesn't pass");
+    }
+}
+
+// Index of the window with the given filter/mask, -1 if none
+int8_t findWindow(uint8_t numWindows, uint32_t filter, uint32_t mask)
+{
+    for (uint8_t w = 0; w < numWindows; w++)
+    {
+        if ((windows[w].filter == filter) && (windows[w].mask == mask))
+            return w;
+    }
+
+    return -1;
+}
+
+void testFreeMerges()
+{
+    const char    *name   = "Free merges";
+    const uint32_t pair[] = {0x7E8, 0x7E9};
+    const uint32_t quad[] = {0x7E8, 0x7E9, 0x7EA, 0x7EB};
+    const uint32_t ext[]  = {0x18DAF110, 0x18DAF111};
+
+    check(myELM327.planMonitorFilters(pair, 2, false, windows, 4) == 1, name, "7E8/7E9 not in one window");
+    check((windows[0].filter == 0x7E8) && (windows[0].mask == 0x7FE) && !windows[0].extended, name, "7E8/7E9 window");
+    check((windows[0].numIds == 2) && (windows[0].passRatio == 2 / 2048.0f), name, "7E8/7E9 ID count or pass ratio");
+
+    check(myELM327.planMonitorFilters(quad, 4, false, windows, 4) == 1, name, "7E8 to 7EB not in one window");
+    check((windows[0].filter == 0x7E8) && (windows[0].mask == 0x7FC), name, "7E8 to 7EB window");
+
+    check(myELM327.planMonitorFilters(ext, 2, true, windows, 4) == 1, name, "29-bit pair not in one window");
+    check((windows[0].filter == 0x18DAF110) && (windows[0].mask == 0x1FFFFFFE) && windows[0].extended, name, "29-bit window");
+}
+
+void testMaxWindows()
+{
+    const char    *name  = "maxWindows";
+    const uint32_t ids[] = {0x100, 0x7E8, 0x7E9, 0x3F0};
+    uint8_t        numWindows;
+
+    // 100 and 3F0 only share a window when they have to
+    check(myELM327.planMonitorFilters(ids, 4, false, windows, 4) == 3, name, "windows without a limit");
+
+    for (uint8_t maxWindows = 1; maxWindows <= 3; maxWindows++)
+    {
+        numWindows = myELM327.planMonitorFilters(ids, 4, false, windows, maxWindows);
+
+        check(numWindows == maxWindows, name, "number of windows");
+        checkCoverage(name, ids, 4, numWindows);
+    }
+
+    // A single window only checks the bits all IDs agree on (bits 8, 2 and 1)
+    myELM327.planMonitorFilters(ids, 4, false, windows, 1);
+    check((windows[0].filter == 0x100) && (windows[0].mask == 0x106), name, "single window");
+}
+
+// 100 can share a window with 103 (passing 100-103) or with 10C (passing 100, 104, 108 and
+// 10C) - the same number of possible IDs, so only the bus sample tells them apart
+void testBusSample()
+{
+    const char    *name     = "Bus sample";
+    const uint32_t ids[]    = {0x100, 0x103, 0x10C};
+    const uint32_t busIds[] = {0x101, 0x101, 0x101, 0x101, 0x101, 0x100, 0x100, 0x10C, 0x200, 0x200};
+    uint8_t        numWindows;
+    int8_t         w;
+
+    numWindows = myELM327.planMonitorFilters(ids, 3, false, windows, 2);
+    w = findWindow(numWindows, 0x100, 0x7FC);
+    check((numWindows == 2) && (w >= 0), name, "100/103 not merged without a sample");
+    check((w >= 0) && (windows[w].passRatio == 4 / 2048.0f), name, "pass ratio without a sample");
+    checkCoverage(name, ids, 3, numWindows);
+
+    // The busy 101 would pass the 100/103 window
+    numWindows = myELM327.planMonitorFilters(ids, 3, false, windows, 2, busIds, sizeof(busIds) / sizeof(busIds[0]));
+    w = findWindow(numWindows, 0x100, 0x7F3);
+    check((numWindows == 2) && (w >= 0), name, "100/10C not merged with a sample");
+    check((w >= 0) && (windows[w].passRatio == 0.3f), name, "pass ratio of the 100/10C window");
+    checkCoverage(name, ids, 3, numWindows);
+
+    w = findWindow(numWindows, 0x103, 0x7FF);
+    check((w >= 0) && (windows[w].passRatio == 0), name, "pass ratio of the 103 window");
+}
+
+void testInvalid()
+{
+    const char    *name   = "Invalid IDs";
+    const uint32_t wide[] = {0x7E8, 0x18DAF110};
+
+    check(myELM327.planMonitorFilters(wide, 2, false, windows, 4) == 0, name, "29-bit ID planned as 11-bit");
+    check(myELM327.planMonitorFilters(wide, 0, false, windows, 4) == 0, name, "no IDs");
+    check(myELM327.planMonitorFilters(wide, 1, false, windows, 0) == 0, name, "no windows");
+}
+
+int main()
+{
+    testFreeMerges();
+    testMaxWindows();
+    testBusSample();
+    testInvalid();
+
+    Serial.print("Done, ");
+    Serial.print(numFailures);
+    Serial.println(" failure(s)");
+
+    return numFailures ? 1 : 0;
+}
@@ -0,0 +1,293 @@
+// Host test of the J1939 message handling of ELM327 - transport protocol reassembly in
+// processJ1939Frame(), decodeSPNs() and parseDM1() - on hand-made frame sequences. See
+// CMakeLists.txt
+#include "ELMduino.h"
+
+// Transport protocol control bytes the library only passes over
+const uint8_t TP_CM_CTS  = 17;
+const uint8_t TP_CM_EOMA = 19;
+
+// Source 0x00 (engine) sends to 0xF9 (service tool) or to everyone (BAM)
+const uint32_t BAM_CM_ID   = 0x1CECFF00;
+const uint32_t BAM_DT_ID   = 0x1CEBFF00;
+const uint32_t RTS_CM_ID   = 0x1CECF900;
+const uint32_t RTS_DT_ID   = 0x1CEBF900;
+const uint32_t REPLY_CM_ID = 0x1CEC00F9; // CTS, end of message ACK and aborts of the receiver
+
+// DM1 with 4 faults - 18 bytes, so 3 packets with 3 bytes of padding in the last one
+const uint8_t DM1_DATA[] = {
+    0x04, 0xFF,             // Amber warning lamp on
+    0x6E, 0x00, 0x03, 0x01, // SPN 110 FMI 3, 1 occurrence
+    0xBE, 0x00, 0x02, 0x05, // SPN 190 FMI 2, 5 occurrences
+    0xB4, 0xA0, 0xA4, 0x7F, // SPN 0x5A0B4 FMI 4, 127 occurrences
+    0x5B, 0x00, 0x1F, 0x02  // SPN 91 FMI 31, 2 occurrences
+};
+const uint16_t DM1_LEN      = sizeof(DM1_DATA);
+const uint8_t  DM1_PACKETS  = (DM1_LEN + 6) / 7;
+
+ELM327        myELM327;
+j1939Transfer transfers[2];
+canFrame      frame;   // The data of a single frame message points into the frame
+j1939Message  message;
+uint16_t      numFailures = 0;
+
+void check(bool ok, const char *name, const char *what)
+{
+    if (ok)
+        return;
+
+    numFailures++;
+    Serial.print("FAILED: ");
+    Serial.print(name);
+    Serial.print(" - ");
+    Serial.println(what);
+}
+
+bool feed(uint32_t id, uint32_t time_ms, const uint8_t data[], uint8_t len)
+{
+    frame.id           = id;
+    frame.timestamp_ms = time_ms;
+    frame.extended     = true;
+    frame.len          = len;
+    memcpy(frame.data, data, len);
+
+    return myELM327.processJ1939Frame(frame, message);
+}
+
+// TP.CM frame: control byte, 3 control specific bytes, 0xFF and the transferred PGN
+bool sendCM(uint32_t id, uint32_t time_ms, uint8_t control, uint8_t b1, uint8_t b2, uint8_t b3, uint32_t pgn = J1939_PGN_DM1)
+{
+    const uint8_t data[8] = {control, b1, b2, b3, 0xFF, (uint8_t)pgn, (uint8_t)(pgn >> 8), (uint8_t)(pgn >> 16)};
+
+    return feed(id, time_ms, data, sizeof(data));
+}
+
+bool sendAnnounce(uint32_t id, uint32_t time_ms, uint8_t control)
+{
+    return sendCM(id, time_ms, control, DM1_LEN & 0xFF, DM1_LEN >> 8, DM1_PACKETS);
+}
+
+// TP.DT packet of DM1_DATA, padded with 0xFF
+bool sendDT(uint32_t id, uint32_t time_ms, uint8_t sequence)
+{
+    uint8_t data[8] = {sequence, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+    for (uint8_t i = 0; (i < 7) && (((sequence - 1) * 7 + i) < DM1_LEN); i++)
+        data[i + 1] = DM1_DATA[(sequence - 1) * 7 + i];
+
+    return feed(id, time_ms, data, sizeof(data));
+}
+
+void checkDM1Message(const char *name)
+{
+    check(message.pgn == J1939_PGN_DM1, name, "PGN");
+    check(message.source == 0x00, name, "source");
+    check(message.priority == 7, name, "priority");
+    check((message.len == DM1_LEN) && !memcmp(message.data, DM1_DATA, DM1_LEN), name, "data");
+}
+
+void testBAM()
+{
+    const char *name = "BAM";
+
+    myELM327.setJ1939Transfers(transfers, 2);
+    check(!sendAnnounce(BAM_CM_ID, 0, J1939_TP_CM_BAM), name, "announcement completes a message");
+    check(!sendDT(BAM_DT_ID, 50, 1), name, "packet 1 completes the message");
+    check(!sendDT(BAM_DT_ID, 100, 2), name, "packet 2 completes the message");
+    check(sendDT(BAM_DT_ID, 150, 3), name, "last packet doesn't complete the message");
+    checkDM1Message(name);
+    check(message.timestamp_ms == 150, name, "timestamp");
+
+    j1939DTC dtcs[5];
+    uint16_t lamps = 0;
+
+    check(myELM327.parseDM1(message, dtcs, 5, lamps) == 4, name, "number of DTCs");
+    check(lamps == 0xFF04, name, "lamps");
+    check((dtcs[0].spn == 110) && (dtcs[0].fmi == 3) && (dtcs[0].occurrences == 1), name, "DTC 1");
+    check((dtcs[1].spn == 190) && (dtcs[1].fmi == 2) && (dtcs[1].occurrences == 5), name, "DTC 2");
+    check((dtcs[2].spn == 0x5A0B4) && (dtcs[2].fmi == 4) && (dtcs[2].occurrences == 127), name, "DTC 3 (19-bit SPN)");
+    check((dtcs[3].spn == 91) && (dtcs[3].fmi == 31) && (dtcs[3].occurrences == 2), name, "DTC 4");
+    check(myELM327.parseDM1(message, dtcs, 2, lamps) == 2, name, "maxDtcs");
+}
+
+void testRTSCTS()
+{
+    const char *name = "RTS/CTS";
+
+    myELM327.setJ1939Transfers(transfers, 2);
+    check(!sendAnnounce(RTS_CM_ID, 0, J1939_TP_CM_RTS), name, "RTS completes a message");
+    check(!sendCM(REPLY_CM_ID, 10, TP_CM_CTS, DM1_PACKETS, 1, 0xFF), name, "CTS completes a message");
+    check(!sendDT(RTS_DT_ID, 20, 1), name, "packet 1 completes the message");
+    check(!sendDT(RTS_DT_ID, 30, 2), name, "packet 2 completes the message");
+    check(sendDT(RTS_DT_ID, 40, 3), name, "last packet doesn't complete the message");
+    checkDM1Message(name);
+    check(!sendAnnounce(REPLY_CM_ID, 50, TP_CM_EOMA), name, "end of message ACK completes a message");
+}
+
+// The receiver asks for packet 2 again - the repeat is dropped and the transfer goes on
+void testRepeatAfterCTS()
+{
+    const char *name = "Packet repeated after a CTS";
+
+    myELM327.setJ1939Transfers(transfers, 2);
+    sendAnnounce(RTS_CM_ID, 0, J1939_TP_CM_RTS);
+    sendCM(REPLY_CM_ID, 10, TP_CM_CTS, 2, 1, 0xFF);
+    sendDT(RTS_DT_ID, 20, 1);
+    sendDT(RTS_DT_ID, 30, 2);
+    sendCM(REPLY_CM_ID, 40, TP_CM_CTS, 2, 2, 0xFF);
+    check(!sendDT(RTS_DT_ID, 50, 2), name, "repeated packet completes the message");
+    check(sendDT(RTS_DT_ID, 60, 3), name, "last packet doesn't complete the message");
+    checkDM1Message(name);
+}
+
+void testLostPacket()
+{
+    const char *name = "Lost packet";
+
+    myELM327.setJ1939Transfers(transfers, 2);
+    sendAnnounce(BAM_CM_ID, 0, J1939_TP_CM_BAM);
+    sendDT(BAM_DT_ID, 50, 1);
+    check(!sendDT(BAM_DT_ID, 100, 3), name, "packet 3 completes the message");
+    check(!sendDT(BAM_DT_ID, 150, 2), name, "late packet 2 completes the message");
+    check(!sendDT(BAM_DT_ID, 200, 3), name, "packet 3 of the dropped transfer completes the message");
+
+    // A new announcement starts over
+    sendAnnounce(BAM_CM_ID, 250, J1939_TP_CM_BAM);
+    sendDT(BAM_DT_ID, 300, 1);
+    sendDT(BAM_DT_ID, 350, 2);
+    check(sendDT(BAM_DT_ID, 400, 3), name, "next transfer isn't completed");
+}
+
+void testAbort(const char *name, uint32_t abortId)
+{
+    myELM327.setJ1939Transfers(transfers, 2);
+    sendAnnounce(RTS_CM_ID, 0, J1939_TP_CM_RTS);
+    sendCM(REPLY_CM_ID, 10, TP_CM_CTS, DM1_PACKETS, 1, 0xFF);
+    sendDT(RTS_DT_ID, 20, 1);
+
+    // The abort of another PGN leaves the transfer alone
+    sendCM(abortId, 25, J1939_TP_CM_ABORT, 1, 0xFF, 0xFF, 0xFEE5);
+    sendDT(RTS_DT_ID, 30, 2);
+
+    sendCM(abortId, 35, J1939_TP_CM_ABORT, 1, 0xFF, 0xFF);
+    check(!sendDT(RTS_DT_ID, 40, 3), name, "aborted transfer completes the message");
+}
+
+void testTimeout()
+{
+    const char *name = "Timeout";
+
+    myELM327.setJ1939Transfers(transfers, 2);
+    sendAnnounce(BAM_CM_ID, 0, J1939_TP_CM_BAM);
+    sendDT(BAM_DT_ID, 50, 1);
+    check(!sendDT(BAM_DT_ID, 51 + J1939_TP_TIMEOUT, 2), name, "packet after J1939_TP_TIMEOUT completes the message");
+    check(!sendDT(BAM_DT_ID, 100 + J1939_TP_TIMEOUT, 3), name, "timed out transfer completes the message");
+
+    sendAnnounce(BAM_CM_ID, 2000, J1939_TP_CM_BAM);
+    sendDT(BAM_DT_ID, 2050, 1);
+    check(!sendDT(BAM_DT_ID, 2050 + J1939_TP_TIMEOUT, 2), name, "packet just in time completes the message");
+    check(sendDT(BAM_DT_ID, 2100 + J1939_TP_TIMEOUT, 3), name, "transfer with a packet just in time isn't completed");
+}
+
+// Three BAM senders and two slots - the third takes the slot of the sender heard from last
+// the longest time ago
+void testSlotReuse()
+{
+    const char *name = "Least recently used slot";
+
+    myELM327.setJ1939Transfers(transfers, 2);
+    sendAnnounce(BAM_CM_ID | 0x01, 0, J1939_TP_CM_BAM);
+    sendAnnounce(BAM_CM_ID | 0x02, 10, J1939_TP_CM_BAM);
+    sendDT(BAM_DT_ID | 0x01, 20, 1);
+    sendAnnounce(BAM_CM_ID | 0x03, 30, J1939_TP_CM_BAM);
+
+    check(!sendDT(BAM_DT_ID | 0x02, 40, 1), name, "evicted transfer continues");
+
+    sendDT(BAM_DT_ID | 0x01, 50, 2);
+    check(sendDT(BAM_DT_ID | 0x01, 60, 3) && (message.source == 0x01), name, "transfer of source 0x01 isn't completed");
+
+    sendDT(BAM_DT_ID | 0x03, 70, 1);
+    sendDT(BAM_DT_ID | 0x03, 80, 2);
+    check(sendDT(BAM_DT_ID | 0x03, 90, 3) && (message.source == 0x03), name, "transfer of source 0x03 isn't completed");
+
+    // Without a buffer, transfers are dropped
+    myELM327.setJ1939Transfers(nullptr, 0);
+    sendAnnounce(BAM_CM_ID, 100, J1939_TP_CM_BAM);
+    sendDT(BAM_DT_ID, 110, 1);
+    sendDT(BAM_DT_ID, 120, 2);
+    check(!sendDT(BAM_DT_ID, 130, 3), name, "transfer completed without a buffer");
+}
+
+void testSingleFrame()
+{
+    const char *name = "Single frame";
+
+    // EEC1 of source 0x00 at priority 3: torque 155 - 125 = 30 %, 0x1C20 * 0.125 = 900 rpm
+    const uint8_t eec1[8]   = {0xF0, 0x7D, 0x9B, 0x20, 0x1C, 0xFF, 0xFF, 0xFF};
+    const uint8_t noSpeed[8] = {0xF0, 0x7D, 0x9B, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    sampledValue  values[NUM_J1939_SPNS];
+
+    memset(values, 0, sizeof(values));
+
+    check(feed(0x0CF00400, 10, eec1, sizeof(eec1)), name, "EEC1 isn't a message");
+    check((message.pgn == 0xF004) && (message.source == 0x00) && (message.priority == 3) && (message.len == 8), name, "EEC1 PGN, source, priority or length");
+    check(myELM327.decodeSPNs(message, values) == 2, name, "number of EEC1 SPNs");
+    check((values[J1939_ENGINE_SPEED].fixedValue == 0x1C20) && (values[J1939_ENGINE_SPEED].value == 900), name, "engine speed");
+    check(values[J1939_ENGINE_TORQUE].value == 30, name, "engine torque");
+
+    // 0xFFFF - not available
+    feed(0x0CF00400, 20, noSpeed, sizeof(noSpeed));
+    check(myELM327.decodeSPNs(message, values) == 1, name, "SPN marked not available decoded");
+    check((values[J1939_ENGINE_SPEED].value == 900) && (values[J1939_ENGINE_SPEED].samples == 1), name, "engine speed not kept");
+
+    canFrame obdFrame = {0x7E8, 30, false, 8, {0}};
+
+    check(!myELM327.processJ1939Frame(obdFrame, message), name, "11-bit frame is a J1939 message");
+}
+
+void testDM1Contents()
+{
+    const char *name = "DM1";
+
+    j1939DTC     dtcs[4];
+    uint16_t     lamps = 0;
+    j1939Message dm1   = {J1939_PGN_DM1, 0x00, 6, 0, nullptr, 0};
+
+    // No active faults - a single all zero DTC
+    const uint8_t noFault[8] = {0x00, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF};
+
+    dm1.data = noFault;
+    dm1.len  = sizeof(noFault);
+    check(myELM327.parseDM1(dm1, dtcs, 4, lamps) == 0, name, "no fault DM1 has faults");
+    check(lamps == 0xFF00, name, "lamps of the no fault DM1");
+
+    // A fault and a DTC of padding, i.e. the data of several frames of a requested DM1
+    const uint8_t padded[10] = {0x04, 0xFF, 0x6E, 0x00, 0x03, 0x01, 0xFF, 0xFF, 0xFF, 0xFF};
+
+    dm1.data = padded;
+    dm1.len  = sizeof(padded);
+    check((myELM327.parseDM1(dm1, dtcs, 4, lamps) == 1) && (dtcs[0].spn == 110) && (dtcs[0].fmi == 3), name, "padding taken for a fault");
+
+    dm1.pgn = 0xFECB;
+    check(myELM327.parseDM1(dm1, dtcs, 4, lamps) == 0, name, "DM2 parsed as a DM1");
+}
+
+int main()
+{
+    testBAM();
+    testRTSCTS();
+    testRepeatAfterCTS();
+    testLostPacket();
+    testAbort("Abort by the sender", RTS_CM_ID);
+    testAbort("Abort by the receiver", REPLY_CM_ID);
+    testTimeout();
+    testSlotReuse();
+    testSingleFrame();
+    testDM1Contents();
+
+    Serial.print("Done, ");
+    Serial.print(numFailures);
+    Serial.println(" failure(s)");
+
+    return numFailures ? 1 : 0;
+}
@@ -0,0 +1,68 @@
+// Host test of ELM327::findResponse() on a payload copied in by the caller instead of
+// received from the ELM327, i.e. without the streaming parser's line positions - see
+// CMakeLists.txt
+#include "ELMduino.h"
+#include "SimELM327.h"
+
+SimELM327 sim;
+ELM327    myELM327;
+uint16_t  numFailures = 0;
+
+void check(bool ok, const char *name, const char *what)
+{
+    if (ok)
+        return;
+
+    numFailures++;
+    Serial.print("FAILED: ");
+    Serial.print(name);
+    Serial.print(" - ");
+    Serial.println(what);
+}
+
+// Queries the PID so findResponse() expects its header, then decodes the given payload
+// in place of the reply
+void runCase(const char *name, uint8_t pid, const char *reply, const uint8_t expected[], uint8_t expectedLen)
+{
+    myELM327.queryPID(SERVICE_01, pid);
+
+    while (myELM327.get_response() == ELM_GETTING_MSG);
+
+    // Leaves no response for the streaming parser to hand findResponse()
+    myELM327.sendCommand_Blocking("AT I");
+
+    strcpy(myELM327.payload, reply);
+    myELM327.findResponse();
+
+    check(myELM327.responseDataLen == expectedLen, name, "number of data bytes");
+
+    if (myELM327.responseDataLen == expectedLen)
+        check(!memcmp(myELM327.responseData, expected, expectedLen), name, "data bytes");
+}
+
+int main()
+{
+    if (!myELM327.begin(sim, false, 1000))
+    {
+        Serial.println("Couldn't connect to the simulated ELM327");
+        return 1;
+    }
+
+    for (uint8_t i = 0; i < sizeof(sim.latency_ms) / sizeof(sim.latency_ms[0]); i++)
+        sim.latency_ms[i] = 0;
+
+    const uint8_t headerData[]  = {0x41, 0x0C};
+    const uint8_t rpmData[]     = {0x1A, 0xF8};
+    const uint8_t bitmapData[]  = {0x84, 0x10, 0x00, 0x13};
+
+    runCase("Data equals the header", ENGINE_RPM, "410C410C", headerData, sizeof(headerData));
+    runCase("Repeated response", ENGINE_RPM, "410C1AF8410C1AF8", rpmData, sizeof(rpmData));
+    runCase("Repeated response on its own line", ENGINE_RPM, "410C1AF8\r410C1B00", rpmData, sizeof(rpmData));
+    runCase("Header straddles data bytes", SUPPORTED_PIDS_1_20, "410084100013", bitmapData, sizeof(bitmapData));
+
+    Serial.print("Done, ");
+    Serial.print(numFailures);
+    Serial.println(" failure(s)");
+
+    return numFailures ? 1 : 0;
+}
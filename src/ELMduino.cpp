@@ -1,7 +1,36 @@
 #include "ELMduino.h"
 
+// Value of each ASCII hex digit, 0xFF for all other chars - see decodeResponseData()
+static const uint8_t HEX_DIGIT_VALUES[256] PROGMEM = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+// Error keywords the streaming parser looks for, bit i of stream.keywordsFound is set
+// when STREAM_KEYWORDS[i] is received - see streamChar()
+static const char* const STREAM_KEYWORDS[] = { RESPONSE_UNABLE_TO_CONNECT, RESPONSE_NO_DATA, RESPONSE_STOPPED, RESPONSE_ERROR };
+constexpr uint8_t NUM_STREAM_KEYWORDS       = sizeof(STREAM_KEYWORDS) / sizeof(STREAM_KEYWORDS[0]);
+constexpr uint8_t KEYWORD_UNABLE_TO_CONNECT = 0x01;
+constexpr uint8_t KEYWORD_NO_DATA           = 0x02;
+constexpr uint8_t KEYWORD_STOPPED           = 0x04;
+constexpr uint8_t KEYWORD_ERROR             = 0x08;
+
 /*
- bool ELM327::begin(Stream &stream, const bool& debug, const uint16_t& timeout, const char& protocol, const uint16_t& payloadLen, const byte& dataTimeout)
+ bool ELM327::begin(Stream &stream, const bool& debug, const uint16_t& timeout, const char& protocol, const uint16_t& payloadLen, const byte& dataTimeout, bool (*loadSession)(uint8_t* data, uint16_t len))
 
  Description:
  ------------
@@ -16,6 +45,9 @@
   * uint16_t payloadLen - Maximum number of bytes expected to be returned by the ELM327 after a query
   * byte dataTimeout    - Number of ms to wait after receiving data before the ELM327 will
                           return the data - see https://web.archive.org/web/20230729213500/https://www.elmelectronics.com/help/obd/tips/#UnderstandingOBD
+  * (*loadSession)()    - Optional function that reads a session stored with saveSession(). If
+                          given, the session is restored instead of searching for the protocol -
+                          see restoreSession()
  Return:
  -------
   * bool - Whether or not the ELM327 was properly initialized
@@ -25,27 +57,81 @@ bool ELM327::begin(      Stream&   stream,
                    const uint16_t& timeout,
                    const char&     protocol,
                    const uint16_t& payloadLen,
-                   const byte&     dataTimeout)
+                   const byte&     dataTimeout,
+                   bool (*loadSession)(uint8_t* data, uint16_t len))
 {
     elm_port    = &stream;
-    PAYLOAD_LEN = payloadLen;
     debugMode   = debug;
     timeout_ms  = timeout;
-    payload = (char *)malloc(PAYLOAD_LEN + 1); // allow for terminating '\0'
+
+    // ELM327Static brings its own buffer, otherwise (re)allocate it if
+    // this is the first call or the size changed
+    if (!staticBuffers)
+    {
+        if (payload && (payloadLen != PAYLOAD_LEN))
+        {
+            free(payload);
+            payload = nullptr;
+        }
+
+        PAYLOAD_LEN = payloadLen;
+
+        // payload (+ terminating '\0') followed by the decoded responseData
+        if (!payload)
+            payload = (char *)malloc(PAYLOAD_LEN + 1 + PAYLOAD_LEN / 2);
+
+        if (!payload)
+            return false;
+
+        responseData = (uint8_t *)(payload + PAYLOAD_LEN + 1);
+    }
 
     // test if serial port is connected
     if (!elm_port)
         return false;
 
-    // try to connect
-    if (!initializeELM(protocol, dataTimeout))
+    // try to connect - resume the stored session if there is one
+    if (loadSession)
+    {
+        if (!restoreSession(loadSession, protocol, dataTimeout))
+            return false;
+    }
+    else if (!initializeELM(protocol, dataTimeout))
         return false;
 
+    // find out once which PIDs the ECU supports so isPidSupported() doesn't need to query
+    if (cacheSupportedPIDs && !supportedPidMapValid[pidMapIndex(SERVICE_01)])
+        refreshSupportedPIDs(SERVICE_01);
+
     return true;
 }
 
+/*
+ ELM327::ELM327(char* payloadBuffer, const uint16_t& payloadLen)
+
+ Description:
+ ------------
+  * Constructor used by ELM327Static to hand over its fixed size buffer
+
+ Inputs:
+ -------
+  * char* payloadBuffer - Buffer of payloadLen + 1 + payloadLen / 2 chars for the received
+                          response and its decoded data
+  * uint16_t payloadLen - Maximum number of bytes expected to be returned by the ELM327 after a query
+
+ Return:
+ -------
+  * void
+*/
+ELM327::ELM327(char* payloadBuffer, const uint16_t& payloadLen)
+    : payload(payloadBuffer), PAYLOAD_LEN(payloadLen), staticBuffers(true)
+{
+    responseData = (uint8_t *)(payload + PAYLOAD_LEN + 1);
+}
+
 ELM327::~ELM327() {
-    if (payload) free(payload);
+    if (!staticBuffers)
+        free(payload);
 }
 
 /*
@@ -83,1086 +169,977 @@ ELM327::~ELM327() {
   * C        - User2 CAN (11* bit ID, 50* kbaud)
 
   * --> *user adjustable
+
+  * If the ELM327 already responds, a warm start ("AT WS") is used instead of a full reset.
+    Each command is sent as soon as the previous command's prompt is received. The time
+    each init phase took is stored in Init_Times
 */
 bool ELM327::initializeELM(const char& protocol,
                            const byte& dataTimeout)
 {
-    char command[10] = {'\0'};
-    connected = false;
-
-    sendCommand_Blocking(SET_ALL_TO_DEFAULTS);
-    delay(100);
-
-    sendCommand_Blocking(RESET_ALL);
-    delay(100);
-
-    sendCommand_Blocking(ECHO_OFF);
-    delay(100);
-
-    sendCommand_Blocking(PRINTING_SPACES_OFF);
-    delay(100);
-
-    sendCommand_Blocking(ALLOW_LONG_MESSAGES);
-    delay(100);
-
-    // // Set data timeout
-    snprintf(command, sizeof(command), SET_TIMEOUT_TO_H_X_4MS, dataTimeout / 4);
-    sendCommand_Blocking(command);
-    delay(100);
-
-    // Automatic searching for protocol requires setting the protocol to AUTO and then
-    // sending an OBD command to initiate the protocol search. The OBD command "0100"
-    // requests a list of supported PIDs 0x00 - 0x20 and is guaranteed to work
-    if (protocol == '0')
-    {
-        // Tell the ELM327 to do an auto protocol search. If a valid protocol is found, it will be saved to memory.
-        // Some ELM clones may not have memory enabled and thus will perform the search every time.
-        snprintf(command, sizeof(command), SET_PROTOCOL_TO_AUTO_H_SAVE, protocol);
-        if (sendCommand_Blocking(command) == ELM_SUCCESS)
-        {
-            if (strstr(payload, RESPONSE_OK) != NULL)
-            {
-                // Protocol search can take a comparatively long time. Temporarily set
-                // the timeout value to 30 seconds, then restore the previous value.
-                uint16_t prevTimeout = timeout_ms;
-                timeout_ms = 30000;
-
-                int8_t state = sendCommand_Blocking("0100");
-
-                if (state == ELM_SUCCESS)
-                {
-                    timeout_ms = prevTimeout;
-                    connected = true;
-                    return connected;
-                }
-                else if (state == ELM_BUFFER_OVERFLOW)
-                {
-                    while (elm_port->available())
-                        elm_port->read();
-                }
-
-                timeout_ms = prevTimeout;
-            }
-        }
-    }
-    else
-    {
-        // Set protocol
-        snprintf(command, sizeof(command), TRY_PROT_H_AUTO_SEARCH, protocol);
-
-        if (sendCommand_Blocking(command) == ELM_SUCCESS)
-        {
-            if (strstr(payload, RESPONSE_OK) != NULL)
-            {
-                connected = true;
-                return connected;
-            }
-        }
-    }
+    uint32_t phaseStart = millis();
 
-    if (debugMode)
-    {
-        Serial.print(F("Setting protocol via "));
-        Serial.print(TRY_PROT_H_AUTO_SEARCH);
-        Serial.print(F(" did not work - trying via "));
-        Serial.println(SET_PROTOCOL_TO_H_SAVE);
-    }
+    connected = false;
+    resetELM(dataTimeout);
+    connectProtocol(protocol);
 
-    // Set protocol and save
-    snprintf(command, sizeof(command), SET_PROTOCOL_TO_H_SAVE, protocol);
+    Init_Times.protocol_ms = millis() - phaseStart - Init_Times.probe_ms - Init_Times.reset_ms - Init_Times.config_ms;
+    Init_Times.total_ms    = millis() - phaseStart;
 
-    if (sendCommand_Blocking(command) == ELM_SUCCESS)
-    {
-        if (strstr(payload, RESPONSE_OK) != NULL)
-        {
-            connected = true;
-            return connected;
-        }
-    }
-    
     if (debugMode)
-    {
-        Serial.print(F("Setting protocol via "));
-        Serial.print(SET_PROTOCOL_TO_H_SAVE);
-        Serial.println(F(" did not work"));
-    }
+        printInitTimes();
 
     return connected;
 }
 
 /*
- void ELM327::formatQueryArray(uint8_t service, uint16_t pid, uint8_t num_responses)
+ void ELM327::resetELM(const byte& dataTimeout)
 
  Description:
  ------------
-  * Creates a query stack to be sent to ELM327
+  * Resets the ELM327 and applies the settings ELMduino needs (echo off, spaces off, long
+    messages, data timeout). If the ELM327 already responds (i.e. it wasn't just powered
+    up), a warm start is used instead of a full reset. Every command moves on as soon as
+    the ELM327's prompt is received. Stores the time of each phase in Init_Times
 
  Inputs:
  -------
-  * uint16_t service - Service number of the queried PID
-  * uint32_t pid     - PID number of the queried PID
-  * uint8_t num_responses - see function header for "queryPID()"
+  * byte dataTimeout - Number of ms to wait after receiving data before the ELM327 will
+                       return the data
 
  Return:
  -------
   * void
 */
-void ELM327::formatQueryArray(const uint8_t&  service,
-                              const uint16_t& pid,
-                              const uint8_t&  num_responses)
+void ELM327::resetELM(const byte& dataTimeout)
 {
-    if (debugMode)
+    char command[10] = {'\0'};
+    uint32_t phaseStart = millis();
+
+    for (uint8_t i = 0; i < NUM_PID_MAP_SERVICES; i++)
+        supportedPidMapValid[i] = false;
+
+    activeHeader[0] = '\0';
+    adapterId[0]    = '\0';
+    dataTimeout_ms  = dataTimeout;
+    ecuDemux        = false;
+    addressedECU    = 0;
+    headerInFlight  = false;
+
+    // A reset restores the default timing
+    Timing.calibrated     = false;
+    Timing.dataTimeout    = dataTimeout / 4;
+    Timing.adaptiveTiming = 1;
+    Timing.backoffPending = false;
+    Timing.backoffStep    = 0;
+
+    uint16_t prevTimeout = timeout_ms;
+    timeout_ms = INIT_PROBE_TIMEOUT;
+    Init_Times.warmStart = (sendCommand_Blocking(DISP_ID) == ELM_SUCCESS) && (strstr(payload, "ELM") != NULL);
+    timeout_ms = prevTimeout;
+    Init_Times.probe_ms = millis() - phaseStart;
+    phaseStart = millis();
+
+    // Both resets restore all defaults, so "AT D" isn't needed
+    if (Init_Times.warmStart)
     {
-        Serial.print(F("Service: "));
-        Serial.println(service);
-        Serial.print(F("PID: "));
-        Serial.println(pid);
+        strncpy(adapterId, strstr(payload, "ELM"), ADAPTER_ID_LEN - 1);
+        adapterId[ADAPTER_ID_LEN - 1] = '\0';
+        sendCommand_Blocking(WARM_START);
     }
-
-    isMode0x22Query = (service == 0x22 && pid <= 0xFF); // mode 0x22 responses always zero-pad the pid to 4 chars, even for a 2-char pid
-
-    query[0] = ((service >> 4) & 0xF) + '0';
-    query[1] = (service & 0xF) + '0';
-
-    // determine PID length (standard queries have 16-bit PIDs,
-    // but some custom queries have PIDs with 32-bit values)
-    if (pid & 0xFF00)
+    else if ((sendCommand_Blocking(RESET_ALL) == ELM_SUCCESS) && (strstr(payload, "ELM") != NULL))
     {
-        if (debugMode)
-            Serial.println(F("Long query detected"));
-
-        longQuery = true;
-
-        query[2] = ((pid >> 12) & 0xF) + '0';
-        query[3] = ((pid >> 8) & 0xF) + '0';
-        query[4] = ((pid >> 4) & 0xF) + '0';
-        query[5] = (pid & 0xF) + '0';
-
-        if (specifyNumResponses)
-        {
-            if (num_responses > 0xF)
-            {
-                query[6] = ((num_responses >> 4) & 0xF) + '0';
-                query[7] = (num_responses & 0xF) + '0';
-                query[8] = '\0';
-
-                upper(query, 8);
-            }
-            else
-            {
-                query[6] = (num_responses & 0xF) + '0';
-                query[7] = '\0';
-                query[8] = '\0';
-
-                upper(query, 7);
-            }
-        }
-        else
-        {
-            query[6] = '\0';
-            query[7] = '\0';
-            query[8] = '\0';
-
-            upper(query, 6);
-        }
+        strncpy(adapterId, strstr(payload, "ELM"), ADAPTER_ID_LEN - 1);
+        adapterId[ADAPTER_ID_LEN - 1] = '\0';
     }
-    else
-    {
-        if (debugMode)
-            Serial.println(F("Normal length query detected"));
-
-        longQuery = false;
-
-        query[2] = ((pid >> 4) & 0xF) + '0';
-        query[3] = (pid & 0xF) + '0';
-
-        if (specifyNumResponses)
-        {
-            if (num_responses > 0xF)
-            {
-                query[4] = ((num_responses >> 4) & 0xF) + '0';
-                query[5] = (num_responses & 0xF) + '0';
-                query[6] = '\0';
-                query[7] = '\0';
-                query[8] = '\0';
-
-                upper(query, 6);
-            }
-            else
-            {
-                query[4] = (num_responses & 0xF) + '0';
-                query[5] = '\0';
-                query[6] = '\0';
-                query[7] = '\0';
-                query[8] = '\0';
 
-                upper(query, 5);
-            }
-        }
-        else
-        {
-            query[4] = '\0';
-            query[5] = '\0';
-            query[6] = '\0';
-            query[7] = '\0';
-            query[8] = '\0';
+    Init_Times.reset_ms = millis() - phaseStart;
+    phaseStart = millis();
 
-            upper(query, 4);
-        }
-    }
+    sendCommand_Blocking(ECHO_OFF);
+    sendCommand_Blocking(PRINTING_SPACES_OFF);
+    sendCommand_Blocking(ALLOW_LONG_MESSAGES);
 
-    if (debugMode)
+    // Set data timeout - "AT ST 00" selects the default timeout, which is already in effect after a reset
+    if (dataTimeout / 4)
     {
-        Serial.print(F("Query string: "));
-        Serial.println(query);
+        snprintf(command, sizeof(command), SET_TIMEOUT_TO_H_X_4MS, dataTimeout / 4);
+        sendCommand_Blocking(command);
     }
+
+    Init_Times.config_ms = millis() - phaseStart;
 }
 
 /*
- void ELM327::upper(char string[], uint8_t buflen)
+ void ELM327::printInitTimes()
 
  Description:
  ------------
-  * Converts all elements of char array string[] to
-  uppercase ascii
+  * Prints the time each phase of the last initialization took
 
  Inputs:
  -------
-  * uint8_t string[] - Char array
-  * uint8_t buflen   - Length of char array
+  * void
 
  Return:
  -------
   * void
 */
-void ELM327::upper(char   string[],
-                   uint8_t buflen)
+void ELM327::printInitTimes()
 {
-    for (uint8_t i = 0; i < buflen; i++)
-    {
-        if (string[i] > 'Z')
-            string[i] -= 32;
-        else if ((string[i] > '9') && (string[i] < 'A'))
-            string[i] += 7;
-    }
+    Serial.print(Init_Times.warmStart ? F("Warm start") : F("Full reset"));
+    Serial.print(F(" - init took "));
+    Serial.print(Init_Times.total_ms);
+    Serial.print(F("ms (probe: "));
+    Serial.print(Init_Times.probe_ms);
+    Serial.print(F("ms, reset: "));
+    Serial.print(Init_Times.reset_ms);
+    Serial.print(F("ms, config: "));
+    Serial.print(Init_Times.config_ms);
+    Serial.print(F("ms, protocol: "));
+    Serial.print(Init_Times.protocol_ms);
+    Serial.println(F("ms)"));
 }
 
 /*
- bool ELM327::timeout()
+ bool ELM327::saveSession(bool (*writeSession)(const uint8_t* data, uint16_t len))
 
  Description:
  ------------
-  * Determines if a time-out has occurred
+  * Stores the state of the current session (detected protocol, adapter ID, supported PIDs,
+    header, timeouts and calibrated timing) through a user-supplied function, i.e. to EEPROM, NVS or a file.
+    Restore it at the next boot with restoreSession() (or by passing the matching read
+    function to begin()) to skip the protocol search.
 
  Inputs:
  -------
-  * void
+  * (*writeSession)() - Function that stores "len" bytes of "data" and returns true on success
 
  Return:
  -------
-  * bool - whether or not a time-out has occurred
+  * bool - Whether or not the session was stored
 */
-bool ELM327::timeout()
+bool ELM327::saveSession(bool (*writeSession)(const uint8_t* data, uint16_t len))
 {
-    currentTime = millis();
-    if ((currentTime - previousTime) >= timeout_ms)
-        return true;
-    return false;
-}
+    elmSession session;
 
-/*
- uint8_t ELM327::ctoi(uint8_t value)
-
- Description:
- ------------
-  * converts a decimal or hex char to an int
-
- Inputs:
- -------
-  * uint8_t value - char to be converted
-
- Return:
- -------
-  * uint8_t - int value of parameter "value"
-*/
-uint8_t ELM327::ctoi(uint8_t value)
-{
-    if (value >= 'A')
-        return value - 'A' + 10;
-    else
-        return value - '0';
-}
-
-/*
- int8_t ELM327::nextIndex(char const *str,
-                          char const *target,
-                          uint8_t numOccur)
-
- Description:
- ------------
-  * Finds and returns the first char index of
-  numOccur'th instance of target in str
-
- Inputs:
- -------
-  * char const *str    - string to search target within
-  * char const *target - String to search for in str
-  * uint8_t numOccur   - Which instance of target in str
+    if (!writeSession || (activeProtocol == AUTOMATIC))
+        return false;
 
- Return:
- -------
-  * int8_t - First char index of numOccur'th
-  instance of target in str. -1 if there is no
-  numOccur'th instance of target in str
-*/
-int8_t ELM327::nextIndex(char const *str,
-                         char const *target,
-                         uint8_t     numOccur)
-{
-    char const *p = str;
-    char const *r = str;
-    uint8_t count;
+    memset(&session, 0, sizeof(session));
+    session.version     = SESSION_VERSION;
+    session.protocol    = activeProtocol;
+    session.timeout_ms  = timeout_ms;
+    session.dataTimeout = dataTimeout_ms;
 
-    for (count = 0;; ++count)
+    if (Timing.calibrated)
     {
-        p = strstr(p, target);
-
-        if (count == (numOccur - 1))
-            break;
-
-        if (!p)
-            break;
+        session.calibratedTimeout = Timing.dataTimeout;
+        session.adaptiveTiming    = Timing.adaptiveTiming;
+    }
+    strncpy(session.adapterId, adapterId, ADAPTER_ID_LEN - 1);
+    strncpy(session.header, addressedECU ? broadcastHeader : activeHeader, HEADER_LEN - 1);
 
-        p++;
+    for (uint8_t i = 0; i < NUM_PID_MAP_SERVICES; i++)
+    {
+        if (supportedPidMapValid[i])
+            session.supportedPidMapValid |= (1 << i);
     }
 
-    if (!p)
-        return -1;
+    memcpy(session.supportedPidMap, supportedPidMap, sizeof(supportedPidMap));
+    session.checksum = sessionChecksum(session);
 
-    return p - r;
+    return writeSession((const uint8_t*)&session, sizeof(session));
 }
 
 /*
- void ELM327::removeChar(char *from,
-                          char const *remove)
+ bool ELM327::restoreSession(bool (*loadSession)(uint8_t* data, uint16_t len), const char& protocol, const byte& dataTimeout)
 
  Description:
  ------------
-  * Removes all instances of each char in string "remove" from the string "from"
-
- Inputs:
- -------
-  * char *from         - String to remove target(s) from
-  * char const *remove - Chars to find/remove 
+  * Initializes the ELM327 using a session stored with saveSession(). The stored protocol
+    is set directly and verified with a single "0100" query, so no protocol search is
+    needed. The stored header, timeouts, calibrated timing and supported PIDs are restored
+    as well.
 
- Return:
- -------
-  * void
-*/
-void ELM327::removeChar(char *from, const char *remove)
-{
-    size_t i = 0, j = 0;
-    while (from[i]) {
-        if (!strchr(remove, from[i]))
-            from[j++] = from[i];
-        i++;
-    }
-    from[j] = '\0'; 
-}
-/*
- double ELM327::conditionResponse(const uint8_t &numExpectedBytes, const float &scaleFactor, const float &bias)
+  * The session is only used with the adapter it was stored from: the ID ("AT I") read
+    by the reset must match the stored one.
 
- Description:
- ------------
-  * Converts the ELM327's response into its correct, numerical value. Returns 0 if numExpectedBytes > numPayChars
+  * If there is no valid stored session, it belongs to another adapter or the verification
+    fails, the ELM327 is initialized normally with initializeELM(protocol, dataTimeout).
 
  Inputs:
  -------
-  * uint64_t response        - ELM327's response
-  * uint8_t numExpectedBytes - Number of valid bytes from the response to process
-  * double scaleFactor       - Amount to scale the response by
-  * float bias               - Amount to bias the response by
+  * (*loadSession)() - Function that reads "len" bytes into "data" and returns true on success
+  * char protocol    - Protocol ID to use if the session can't be restored
+  * byte dataTimeout - Data timeout to use if the session can't be restored
 
  Return:
  -------
-  * double - Converted numerical value
+  * bool - Whether or not the ELM327 was properly initialized
 */
-double ELM327::conditionResponse(const uint8_t& numExpectedBytes,
-                                 const double&  scaleFactor,
-                                 const double&   bias)
+bool ELM327::restoreSession(bool (*loadSession)(uint8_t* data, uint16_t len),
+                            const char& protocol,
+                            const byte& dataTimeout)
 {
-    uint8_t numExpectedPayChars = numExpectedBytes * 2;
-    uint8_t payCharDiff         = numPayChars - numExpectedPayChars;
+    elmSession session;
+    char command[10] = {'\0'};
+    uint32_t phaseStart = millis();
 
-    if (numExpectedBytes > 8)
+    if (!loadSession || !loadSession((uint8_t*)&session, sizeof(session)) ||
+        (session.version != SESSION_VERSION) || (session.checksum != sessionChecksum(session)) ||
+        (session.protocol == AUTOMATIC))
     {
         if (debugMode)
-            Serial.println(F("WARNING: Number of expected response bytes is greater than 8 - returning 0"));
+            Serial.println(F("No valid stored session"));
 
-        return 0;
+        return initializeELM(protocol, dataTimeout);
     }
 
-    if (numPayChars < numExpectedPayChars)
+    connected  = false;
+    timeout_ms = session.timeout_ms;
+    resetELM(session.dataTimeout);
+
+    // Another adapter (i.e. a clone with other timing) may not match the stored settings
+    session.adapterId[ADAPTER_ID_LEN - 1] = '\0';
+
+    if (strcmp(adapterId, session.adapterId))
     {
         if (debugMode)
-            Serial.println(F("WARNING: Number of payload chars is less than the number of expected response chars returned by ELM327 - returning 0"));
+        {
+            Serial.print(F("Stored session is from another adapter ("));
+            Serial.print(session.adapterId);
+            Serial.println(F(") - searching for protocol"));
+        }
 
-        return 0;
+        return initializeELM(protocol, dataTimeout);
     }
-    else if (numPayChars & 0x1)
+
+    snprintf(command, sizeof(command), SET_PROTOCOL_TO_H_SAVE, session.protocol);
+    sendCommand_Blocking(command);
+
+    session.header[HEADER_LEN - 1] = '\0';
+    if (session.header[0] != '\0')
+        setHeader(session.header);
+
+    if (session.calibratedTimeout && setTiming(session.calibratedTimeout, session.adaptiveTiming))
+        Timing.calibrated = true;
+
+    if (sendCommand_Blocking("0100") != ELM_SUCCESS)
     {
         if (debugMode)
-            Serial.println(F("WARNING: Number of payload chars returned by ELM327 is an odd value - returning 0"));
+            Serial.println(F("Stored session could not be verified - searching for protocol"));
 
-        return 0;
-    }
-    else if (numExpectedPayChars == numPayChars)
-    {
-        if (scaleFactor == 1 && bias == 0) // No scale/bias needed
-            return response;
-        else
-            return (response * scaleFactor) + bias;
+        return initializeELM(protocol, dataTimeout);
     }
 
-    // If there were more payload bytes returned than we expected, test the first and last bytes in the
-    // returned payload and see which gives us a higher value. Sometimes ELM327's return leading zeros
-    // and others return trailing zeros. The following approach gives us the best chance at determining
-    // where the real data is. Note that if the payload returns BOTH leading and trailing zeros, this
-    // will not give accurate results!
+    connected      = true;
+    activeProtocol = session.protocol;
 
-    if (debugMode)
-        Serial.println(F("Looking for lagging zeros"));
+    for (uint8_t i = 0; i < NUM_PID_MAP_SERVICES; i++)
+        supportedPidMapValid[i] = session.supportedPidMapValid & (1 << i);
 
-    uint16_t numExpectedBits  = numExpectedBytes * 8;
-    uint64_t laggingZerosMask = 0;
+    memcpy(supportedPidMap, session.supportedPidMap, sizeof(supportedPidMap));
 
-    for (uint16_t i = 0; i < numExpectedBits; i++)
-        laggingZerosMask |= (1 << i);
+    Init_Times.total_ms    = millis() - phaseStart;
+    Init_Times.protocol_ms = Init_Times.total_ms - Init_Times.probe_ms - Init_Times.reset_ms - Init_Times.config_ms;
 
-    if (!(laggingZerosMask & response)) // Detect all lagging zeros in `response`
+    if (debugMode)
     {
-        if (debugMode)
-            Serial.println(F("Lagging zeros found"));
-
-        if (scaleFactor == 1 && bias == 0) // No scale/bias needed
-            return (response >> (4 * payCharDiff));
-        else
-            return ((response >> (4 * payCharDiff)) * scaleFactor) + bias;
+        Serial.print(F("Restored session with protocol "));
+        Serial.println(activeProtocol);
+        printInitTimes();
     }
-    else
-    {
-        if (debugMode)
-            Serial.println(F("Lagging zeros not found - assuming leading zeros"));
 
-        if (scaleFactor == 1 && bias == 0) // No scale/bias needed
-            return response;
-        else
-            return (response * scaleFactor) + bias;
-    }
+    return connected;
 }
 
 /*
- double ELM327::conditionResponse(double (*func)())
+ uint16_t ELM327::sessionChecksum(const elmSession& session)
 
  Description:
  ------------
-  * Provides a means to pass in a user-defined function to process the response. Used for PIDs that 
-    don't use the common scaleFactor + Bias formula to calculate the value from the response data. Also
-    useful for processing OEM custom PIDs which are too numerous and varied to encode in the lib. 
+  * Computes the Fletcher-16 checksum of a stored session (excluding the checksum itself)
 
  Inputs:
  -------
-  * (*func)() - pointer to function to do calculate response value
-  
+  * elmSession session - Session to compute the checksum of
+
  Return:
  -------
-  * double - Converted numerical value
+  * uint16_t - Checksum
 */
+uint16_t ELM327::sessionChecksum(const elmSession& session)
+{
+    const uint8_t* data = (const uint8_t*)&session;
+    const uint8_t* end  = (const uint8_t*)&session.checksum;
+    uint16_t sum1 = 0;
+    uint16_t sum2 = 0;
 
-double ELM327::conditionResponse(double (*func)()) {
-    return func();
+    for (size_t i = 0; i < (size_t)(end - data); i++)
+    {
+        sum1 = (sum1 + data[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+
+    return (sum2 << 8) | sum1;
 }
 
 /*
- void ELM327::flushInputBuff()
+ bool ELM327::setHeader(const char* header)
 
  Description:
  ------------
-  * Flushes input serial buffer
+  * Sets the header (CAN ID) of all following requests with "AT SH" and remembers it so
+    that it can be stored with saveSession(). This is a blocking function.
 
  Inputs:
  -------
-  * void
+  * const char* header - Header as hex string, i.e. "7E0" or "18DA10F1"
 
  Return:
  -------
-  * void
+  * bool - Whether or not the ELM327 accepted the header
 */
-void ELM327::flushInputBuff()
+bool ELM327::setHeader(const char* header)
 {
-    if (debugMode)
-        Serial.println(F("Clearing input serial buffer"));
+    if (!sendHeader(header))
+        return false;
 
-    while (elm_port->available())
-        elm_port->read();
+    // Other ECUs answer now
+    clearResponseHints();
+    addressedECU   = 0;
+    headerInFlight = false;
+
+    return true;
 }
 
 /*
-  void ELM327::queryPID(const uint8_t& service, const uint16_t& pid, const uint8_t& num_responses)
+ bool ELM327::sendHeader(const char* header)
 
-  Description:
-  ------------
-  * Create a PID query command string and send the command
+ Description:
+ ------------
+  * Sends "AT SH" and keeps the header in activeHeader - see setHeader() and addressECU()
 
-  Inputs:
-  -------
-  * uint8_t service       - The diagnostic service ID. 01 is "Show current data"
-  * uint16_t pid          - The Parameter ID (PID) from the service
-  * uint8_t num_responses - Number of lines of data to receive - see ELM datasheet "Talking to the vehicle".
-                            This can speed up retrieval of information if you know how many responses will be sent.
-                            Basically the OBD scanner will not wait for more responses if it does not need to go through
-                            final timeout. Also prevents OBD scanners from sending mulitple of the same response.
+ Inputs:
+ -------
+  * const char* header - Header as hex string, i.e. "7E0" or "18DA10F1"
 
-  Return:
-  -------
-  * void
+ Return:
+ -------
+  * bool - Whether or not the ELM327 accepted the header
 */
-void ELM327::queryPID(const uint8_t&  service,
-                      const uint16_t& pid,
-                      const uint8_t&  num_responses)
+bool ELM327::sendHeader(const char* header)
 {
-    formatQueryArray(service, pid, num_responses);
-    sendCommand(query);
+    char command[20] = {'\0'};
+
+    snprintf(command, sizeof(command), SET_HEADER, header);
+
+    if ((sendCommand_Blocking(command) != ELM_SUCCESS) || (strstr(payload, RESPONSE_OK) == NULL))
+        return false;
+
+    strncpy(activeHeader, header, HEADER_LEN - 1);
+    activeHeader[HEADER_LEN - 1] = '\0';
+
+    return true;
 }
 
 /*
- void ELM327::queryPID(char queryStr[])
+ bool ELM327::setECUDemux(const bool& enable)
 
  Description:
  ------------
-  * Queries ELM327 for a specific type of vehicle telemetry data
+  * Turns headers on ("AT H1") and attributes every frame of the following responses to
+    the ECU that sent it. Several ECUs (i.e. engine and hybrid ECUs) answer each broadcast
+    query - the responses are parsed as usual (the first ECU's data goes to responseData)
+    and the single frame responses of all ECUs are kept in ECU_Responses, see ecuValue().
+    The response CAN IDs can be passed to schedulePID() to query each ECU on its own.
+    This is a blocking function
+
+  * ISO 15765 (CAN) protocols only
 
  Inputs:
  -------
-  * char queryStr[] - Query string (service and PID)
+  * bool enable - Whether to turn demultiplexing (and headers) on or off
 
  Return:
  -------
-  * void
+  * bool - Whether or not the ELM327 accepted the setting
 */
-void ELM327::queryPID(char queryStr[])
+bool ELM327::setECUDemux(const bool& enable)
 {
-    if (strlen(queryStr) <= 4)
-        longQuery = false;
-    else
-        longQuery = true;
+    if (enable && !isCANProtocol())
+        return false;
 
-    sendCommand(queryStr);
+    if ((sendCommand_Blocking(enable ? HEADERS_ON : HEADERS_OFF) != ELM_SUCCESS) || (strstr(payload, RESPONSE_OK) == NULL))
+        return false;
+
+    ecuDemux              = enable;
+    ECU_Responses.numECUs = 0;
+
+    return true;
 }
 
 /*
- double ELM327::processPID(const uint8_t& service, const uint16_t& pid, const uint8_t& num_responses, const uint8_t& numExpectedBytes, const float& scaleFactor, const float& bias)
+ double ELM327::ecuValue(const uint32_t& id)
 
  Description:
  ------------
-  * Queries ELM327 for a specific type of vehicle telemetry data
+  * Decodes the response of one ECU to the last service 01 query, i.e. after read(ENGINE_RPM)
+    with setECUDemux() on. The legacy response fields and responseBytes are left as the
+    query set them
 
  Inputs:
  -------
-  * uint8_t service          - The diagnostic service ID. 01 is "Show current data"
-  * uint16_t pid             - The Parameter ID (PID) from the service
-  * uint8_t num_responses    - Number of lines of data to receive - see ELM datasheet "Talking to the vehicle".
-                               This can speed up retrieval of information if you know how many responses will be sent.
-                               Basically the OBD scanner will not wait for more responses if it does not need to go through
-                               final timeout. Also prevents OBD scanners from sending mulitple of the same response.
-  * uint8_t numExpectedBytes - Number of valid bytes from the response to process
-  * float scaleFactor        - Amount to scale the response by
-  * float bias               - Amount to bias the response by
+  * uint32_t id - Response CAN ID of the ECU (see ECU_Responses), i.e. 0x7E9
 
  Return:
  -------
-  * double - The PID value if successfully received, else 0.0
+  * double - The ECU's value of the PID, 0 if it didn't respond
 */
-double ELM327::processPID(const uint8_t&  service,
-                          const uint16_t& pid,
-                          const uint8_t&  num_responses,
-                          const uint8_t&  numExpectedBytes,
-                          const double&   scaleFactor,
-                          const float&    bias)
+double ELM327::ecuValue(const uint32_t& id)
 {
-    if (nb_query_state == SEND_COMMAND)
-    {
-        queryPID(service, pid, num_responses);
-        nb_query_state = WAITING_RESP;
-    }
-    else if (nb_query_state == WAITING_RESP)
+    pidDescriptor descriptor;
+
+    if ((metricsService != SERVICE_01) || !getPidDescriptor(metricsPid, descriptor))
+        return 0;
+
+    for (uint8_t i = 0; i < ECU_Responses.numECUs; i++)
     {
-        get_response();
-        if (nb_rx_state == ELM_SUCCESS)
-        {
-            nb_query_state = SEND_COMMAND; // Reset the query state machine for next command
-            findResponse();
-            
-            /* This data manipulation seems duplicative of the responseByte_0, responseByte_1, etc vars and it is.
-               The duplcation is deliberate to provide a clear way for the calculator functions to access the relevant
-               data bytes from the response in the format they are commonly expressed in and without breaking backward
-               compatability with existing code that may be using the responseByte_n vars. 
-               
-               In addition, we need to place the response values into static vars that can be accessed by the (static) 
-               calculator functions. A future (breaking!) change could be made to eliminate this duplication. 
-            */
-            uint8_t responseBits = numExpectedBytes * 8;
-            uint8_t extractedBytes[8] = {0};  // Store extracted bytes
-
-            // Extract bytes only if shift is non-negative
-            for (int i = 0; i < numExpectedBytes; i++)
-            {
-                int shiftAmount = responseBits - (8 * (i + 1));             // Compute shift amount
-                if (shiftAmount >= 0) {                                     //  Ensure valid shift
-                    extractedBytes[i] = (response >> shiftAmount) & 0xFF;   // Extract byte
-                }
-            }
+        if (ECU_Responses.ecus[i].id != id)
+            continue;
 
-            // Assign extracted values to response_A, response_B, ..., response_H safely
-            response_A = extractedBytes[0];
-            response_B = extractedBytes[1];
-            response_C = extractedBytes[2];
-            response_D = extractedBytes[3];
-            response_E = extractedBytes[4];
-            response_F = extractedBytes[5];
-            response_G = extractedBytes[6];
-            response_H = extractedBytes[7];
-            
-            double (*calculator)() = selectCalculator(pid);
-
-            if (nullptr == calculator) {
-                //Use the default scaleFactor + Bias calculation
-                return conditionResponse(numExpectedBytes, scaleFactor, bias);
-            }
-            else {
-                return conditionResponse(calculator);
-            }
-        }
-        else if (nb_rx_state != ELM_GETTING_MSG)
-            nb_query_state = SEND_COMMAND; // Error or timeout, so reset the query state machine for next command
+        uint8_t* data = responseData;
+        uint16_t len  = responseDataLen;
+
+        responseData    = ECU_Responses.ecus[i].data;
+        responseDataLen = ECU_Responses.ecus[i].len;
+
+        double value = decodePID(metricsPid, descriptor.numBytes, descriptor.scaleFactor, descriptor.bias);
+
+        responseData    = data;
+        responseDataLen = len;
+        setResponseBytes(descriptor.numBytes);
+
+        return value;
     }
-    return 0.0;
+
+    return 0;
 }
+
 /*
- double ELM327::selectCalculator(uint16_t pid))()
+ bool ELM327::calibrateTiming(const uint8_t& numRounds)
 
  Description:
  ------------
-  * Selects the appropriate calculation function for a given PID.
+  * Finds the lowest safe "AT ST" timeout and the most aggressive "AT AT" adaptive timing
+    mode for the connected vehicle:
+      - Up to TIMING_PROBE_PIDS supported service 01 PIDs are queried numRounds times with
+        fixed default timing (AT AT0, 200ms). The queries don't specify the number of
+        responses, so the time to the prompt minus the timeout is when the last ECU
+        answered. The number of responses of each PID is noted as well
+      - "AT ST" is set to TIMING_MARGIN_PERCENT of the slowest response and AT AT2, AT AT1
+        and AT AT0 are tried in that order. The first mode that gets every response of
+        numRounds rounds is kept, otherwise "AT ST" is doubled and the modes are tried again
+
+  * The result is kept in Timing and stored by saveSession(). While in use, the timing is
+    backed off when supported PIDs start returning NO DATA - see watchTiming()
+
+  * Blocking - takes a few seconds. Call it with the engine running
 
  Inputs:
  -------
-  * uint16_t pid             - The Parameter ID (PID) from the service
-  
+  * uint8_t numRounds - Number of times each PID is queried per measurement/verification
 
  Return:
  -------
-  * double (*func()) - Pointer to a function to be used to calculate the value for this PID.
-    Returns nullptr if the PID is calculated using the default scaleFactor + Bias formula as
-    implemented in conditionResponse(). (Maintained for backward compatibility)
+  * bool - Whether or not a timing was found. The ELM327 default timing is restored if not
 */
-double (*ELM327::selectCalculator(uint16_t pid))() 
-{       
-    switch (pid)
-    {
-        case ENGINE_LOAD:
-        case ENGINE_COOLANT_TEMP:
-        case SHORT_TERM_FUEL_TRIM_BANK_1:
-        case LONG_TERM_FUEL_TRIM_BANK_1:
-        case SHORT_TERM_FUEL_TRIM_BANK_2:
-        case LONG_TERM_FUEL_TRIM_BANK_2:
-        case FUEL_PRESSURE:
-        case INTAKE_MANIFOLD_ABS_PRESSURE:
-        case VEHICLE_SPEED:
-        case TIMING_ADVANCE:
-        case INTAKE_AIR_TEMP:
-        case THROTTLE_POSITION:
-        case COMMANDED_EGR:
-        case EGR_ERROR:
-        case COMMANDED_EVAPORATIVE_PURGE:
-        case FUEL_TANK_LEVEL_INPUT:
-        case WARM_UPS_SINCE_CODES_CLEARED:
-        case ABS_BAROMETRIC_PRESSURE:
-        case RELATIVE_THROTTLE_POSITION:
-        case AMBIENT_AIR_TEMP:
-        case ABS_THROTTLE_POSITION_B:
-        case ABS_THROTTLE_POSITION_C:
-        case ABS_THROTTLE_POSITION_D:
-        case ABS_THROTTLE_POSITION_E:
-        case ABS_THROTTLE_POSITION_F:
-        case COMMANDED_THROTTLE_ACTUATOR:
-        case ETHANOL_FUEL_PERCENT:
-        case RELATIVE_ACCELERATOR_PEDAL_POS:
-        case HYBRID_BATTERY_REMAINING_LIFE:
-        case ENGINE_OIL_TEMP:
-        case DEMANDED_ENGINE_PERCENT_TORQUE:
-        case ACTUAL_ENGINE_TORQUE:
-            return nullptr; 
-
-        case ENGINE_RPM:
-            return calculator_0C;
-
-        case MAF_FLOW_RATE:
-            return calculator_10;
-
-        case OXYGEN_SENSOR_1_A:
-        case OXYGEN_SENSOR_2_A:
-        case OXYGEN_SENSOR_3_A:
-        case OXYGEN_SENSOR_4_A:
-        case OXYGEN_SENSOR_5_A:
-        case OXYGEN_SENSOR_6_A:
-        case OXYGEN_SENSOR_7_A:
-        case OXYGEN_SENSOR_8_A:
-        case OXYGEN_SENSOR_1_B:
-        case OXYGEN_SENSOR_2_B:
-        case OXYGEN_SENSOR_3_B:
-        case OXYGEN_SENSOR_4_B:
-        case OXYGEN_SENSOR_6_B:
-        case OXYGEN_SENSOR_7_B:
-        case OXYGEN_SENSOR_8_B:
-        case OXYGEN_SENSOR_1_C:
-        case OXYGEN_SENSOR_2_C:
-        case OXYGEN_SENSOR_3_C:
-        case OXYGEN_SENSOR_4_C:
-        case OXYGEN_SENSOR_5_C:
-        case OXYGEN_SENSOR_6_C:
-        case OXYGEN_SENSOR_7_C:
-        case OXYGEN_SENSOR_8_C:
-            return calculator_14;
-
-        case RUN_TIME_SINCE_ENGINE_START:
-        case DISTANCE_TRAVELED_WITH_MIL_ON:
-        case DIST_TRAV_SINCE_CODES_CLEARED:
-        case TIME_RUN_WITH_MIL_ON:
-        case TIME_SINCE_CODES_CLEARED:
-        case ENGINE_REFERENCE_TORQUE:
-            return calculator_1F;
-
-        case FUEL_RAIL_PRESSURE:
-            return calculator_22;
-
-        case FUEL_RAIL_GUAGE_PRESSURE:
-        case FUEL_RAIL_ABS_PRESSURE:
-            return calculator_23;
-
-        case EVAP_SYSTEM_VAPOR_PRESSURE:
-            return calculator_32;
-     
-        case CATALYST_TEMP_BANK_1_SENSOR_1:
-        case CATALYST_TEMP_BANK_2_SENSOR_1:
-        case CATALYST_TEMP_BANK_1_SENSOR_2:
-        case CATALYST_TEMP_BANK_2_SENSOR_2:
-            return calculator_3C;
-
-        case CONTROL_MODULE_VOLTAGE:
-            return calculator_42;
-
-        case ABS_LOAD_VALUE:
-            return calculator_43;
-
-        case FUEL_AIR_COMMANDED_EQUIV_RATIO:
-            return calculator_44;
-
-        case MAX_VALUES_EQUIV_V_I_PRESSURE:
-            return calculator_4F;
-
-        case MAX_MAF_RATE:
-            return calculator_50;
-
-        case ABS_EVAP_SYS_VAPOR_PRESSURE:
-            return calculator_53;
-
-        case SHORT_TERM_SEC_OXY_SENS_TRIM_1_3:
-        case LONG_TERM_SEC_OXY_SENS_TRIM_1_3:
-        case SHORT_TERM_SEC_OXY_SENS_TRIM_2_4:
-        case LONG_TERM_SEC_OXY_SENS_TRIM_2_4:
-            return calculator_55;
-
-        case FUEL_INJECTION_TIMING:
-            return calculator_5D;
-
-        case ENGINE_FUEL_RATE:
-            return calculator_5E;
-
-        default:
-            return nullptr;    
-        
+bool ELM327::calibrateTiming(const uint8_t& numRounds)
+{
+    uint8_t  pids[TIMING_PROBE_PIDS];
+    uint8_t  numResponses[TIMING_PROBE_PIDS];
+    uint8_t  numPids = 0;
+    uint32_t maxLatency_us = 0;
+
+    if (!supportedPidMapValid[pidMapIndex(SERVICE_01)])
+        refreshSupportedPIDs(SERVICE_01);
+
+    for (uint16_t pid = 1; (pid <= 0x60) && (numPids < TIMING_PROBE_PIDS); pid++)
+    {
+        if ((pid % PID_INTERVAL_OFFSET) && isPidSupported(SERVICE_01, pid))
+            pids[numPids++] = pid;
     }
-}
 
-/*
- uint32_t ELM327::supportedPIDs_1_20()
+    if (numPids == 0)
+        pids[numPids++] = SUPPORTED_PIDS_1_20;
 
- Description:
- ------------
-  * Determine which of PIDs 0x1 through 0x20 are supported (bit encoded)
+    Timing.calibrated = false;
+    Timing.backoffs   = 0;
 
- Inputs:
- -------
-  * void
+    if (!setTiming(DEFAULT_DATA_TIMEOUT, 0))
+        return false;
 
- Return:
- -------
-  * uint32_t - Bit encoded booleans of supported PIDs 0x1-0x20
-*/
-uint32_t ELM327::supportedPIDs_1_20()
-{
-    return (uint32_t)processPID(SERVICE_01, SUPPORTED_PIDS_1_20, 1, 4);
-}
+    for (uint8_t i = 0; i < numPids; i++)
+    {
+        numResponses[i] = 0;
 
-/*
- uint32_t ELM327::monitorStatus()
+        for (uint8_t round = 0; round < numRounds; round++)
+        {
+            formatQueryArray(SERVICE_01, pids[i], 0);
 
- Description:
- ------------
-  * Monitor status since DTCs cleared (Includes malfunction indicator
-  lamp (MIL) status and number of DTCs). See https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_01
-  for more info
+            if (sendCommand_Blocking(query) != ELM_SUCCESS)
+                continue;
 
- Inputs:
- -------
-  * void
+            // The ELM327 waits for the timeout after the last response before the prompt
+            uint32_t prompt_us  = micros() - queryStart_us;
+            uint32_t latency_us = firstByte_us - queryStart_us;
 
- Return:
- -------
-  * uint32_t - Bit encoded status (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_01)
-*/
-uint32_t ELM327::monitorStatus()
-{
-    return (uint32_t)processPID(SERVICE_01, MONITOR_STATUS_SINCE_DTC_CLEARED, 1, 4);
-}
+            if (prompt_us > (DEFAULT_DATA_TIMEOUT * 4000UL))
+                latency_us = prompt_us - DEFAULT_DATA_TIMEOUT * 4000UL;
 
-/*
- uint16_t ELM327::freezeDTC()
+            if (latency_us > maxLatency_us)
+                maxLatency_us = latency_us;
 
- Description:
- ------------
-  * Freeze DTC - see https://www.samarins.com/diagnose/freeze-frame.html for more info
+            if (stream.numResponses > numResponses[i])
+                numResponses[i] = stream.numResponses;
+        }
 
- Inputs:
- -------
-  * void
+        if (debugMode)
+        {
+            Serial.print(F("PID 0x"));
+            Serial.print(pids[i], HEX);
+            Serial.print(F(": "));
+            Serial.print(numResponses[i]);
+            Serial.println(F(" response(s)"));
+        }
+    }
 
- Return:
- -------
-  * uint16_t - Various vehicle information (https://www.samarins.com/diagnose/freeze-frame.html)
-*/
-uint16_t ELM327::freezeDTC()
-{
-    return (uint16_t)processPID(SERVICE_01, FREEZE_DTC, 1, 2);
-}
+    Timing.maxLatency_ms = maxLatency_us / 1000;
 
-/*
- uint16_t ELM327::fuelSystemStatus()
+    if (debugMode)
+    {
+        Serial.print(F("Slowest response: "));
+        Serial.print(Timing.maxLatency_ms);
+        Serial.println(F("ms"));
+    }
 
- Description:
- ------------
-  * Freeze DTC - see https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_03 for more info
+    uint32_t dataTimeout = ((maxLatency_us * TIMING_MARGIN_PERCENT / 100) + 3999) / 4000;
 
- Inputs:
- -------
-  * void
+    if (dataTimeout < 1)
+        dataTimeout = 1;
+    else if (dataTimeout > 0xFF)
+        dataTimeout = 0xFF;
 
- Return:
- -------
-  * uint16_t - Bit encoded status (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_03)
-*/
-uint16_t ELM327::fuelSystemStatus()
-{
-    return (uint16_t)processPID(SERVICE_01, FUEL_SYSTEM_STATUS, 1, 2);
-}
+    while (true)
+    {
+        for (int8_t mode = 2; mode >= 0; mode--)
+        {
+            if (setTiming(dataTimeout, mode) && verifyTiming(pids, numResponses, numPids, numRounds))
+            {
+                Timing.calibrated = true;
 
-/*
- float ELM327::engineLoad()
+                if (debugMode)
+                {
+                    Serial.print(F("Calibrated timing: AT ST "));
+                    Serial.print(dataTimeout, HEX);
+                    Serial.print(F(", AT AT"));
+                    Serial.println(mode);
+                }
 
- Description:
- ------------
-  * Find the current engine load in %
+                return true;
+            }
+        }
 
- Inputs:
- -------
-  * void
+        if (dataTimeout == 0xFF)
+            break;
 
- Return:
- -------
-  * float - Engine load %
-*/
-float ELM327::engineLoad()
-{
-    return processPID(SERVICE_01, ENGINE_LOAD, 1, 1, 100.0 / 255.0);
+        dataTimeout = (dataTimeout >= 0x80) ? 0xFF : (dataTimeout * 2);
+    }
+
+    if (debugMode)
+        Serial.println(F("Timing calibration failed - restoring the default timing"));
+
+    setTiming(0, 1);
+    return false;
 }
 
 /*
- float ELM327::engineCoolantTemp()
+ bool ELM327::verifyTiming(const uint8_t pids[], const uint8_t numResponses[], const uint8_t& numPids, const uint8_t& numRounds)
 
  Description:
  ------------
-  * Find the current engine coolant temp in C
+  * Checks if the current timing gets every response of the PIDs probed by calibrateTiming()
 
  Inputs:
  -------
-  * void
+  * uint8_t pids[]         - Probed PIDs
+  * uint8_t numResponses[] - Number of responses of each PID, 0 to skip the PID
+  * uint8_t numPids        - Number of probed PIDs
+  * uint8_t numRounds      - Number of times each PID is queried
 
  Return:
  -------
-  * float - Engine load %
+  * bool - Whether or not all responses were received
 */
-float ELM327::engineCoolantTemp()
+bool ELM327::verifyTiming(const uint8_t  pids[],
+                          const uint8_t  numResponses[],
+                          const uint8_t& numPids,
+                          const uint8_t& numRounds)
 {
-    return processPID(SERVICE_01, ENGINE_COOLANT_TEMP, 1, 1, 1, -40.0);
+    for (uint8_t round = 0; round < numRounds; round++)
+    {
+        for (uint8_t i = 0; i < numPids; i++)
+        {
+            if (numResponses[i] == 0)
+                continue;
+
+            formatQueryArray(SERVICE_01, pids[i], 0);
+
+            if ((sendCommand_Blocking(query) != ELM_SUCCESS) || (stream.numResponses != numResponses[i]))
+                return false;
+        }
+    }
+
+    return true;
 }
 
 /*
- float ELM327::shortTermFuelTrimBank_1()
+ bool ELM327::setTiming(const uint8_t& dataTimeout, const uint8_t& adaptiveTiming)
 
  Description:
  ------------
-  * Find fuel trim %
+  * Sets how long the ELM327 waits for responses
 
  Inputs:
  -------
-  * void
+  * uint8_t dataTimeout    - "AT ST" value in units of 4ms, 0 for the ELM327 default (200ms).
+                             With adaptive timing, this is the longest timeout it may use
+  * uint8_t adaptiveTiming - "AT AT" mode: 0 is off, 1 (default) and 2 (more aggressive)
+                             adapt the timeout to the measured response times
 
  Return:
  -------
-  * float - Fuel trim %
+  * bool - Whether or not the ELM327 accepted the timing
 */
-float ELM327::shortTermFuelTrimBank_1()
+bool ELM327::setTiming(const uint8_t& dataTimeout, const uint8_t& adaptiveTiming)
 {
-    return processPID(SERVICE_01, SHORT_TERM_FUEL_TRIM_BANK_1, 1, 1, 100.0 / 128.0, -100.0);
-}
+    char command[10] = {'\0'};
 
-/*
- float ELM327::longTermFuelTrimBank_1()
+    snprintf(command, sizeof(command), SET_TIMEOUT_TO_H_X_4MS, dataTimeout);
 
- Description:
- ------------
-  * Find fuel trim %
+    if ((sendCommand_Blocking(command) != ELM_SUCCESS) || (strstr(payload, RESPONSE_OK) == NULL))
+        return false;
 
- Inputs:
- -------
-  * void
+    if (adaptiveTiming == 0)
+        sendCommand_Blocking(ADAPTIVE_TIMING_OFF);
+    else if (adaptiveTiming == 1)
+        sendCommand_Blocking(ADAPTIVE_TIMING_AUTO_1);
+    else
+        sendCommand_Blocking(ADAPTIVE_TIMING_AUTO_2);
 
- Return:
- -------
-  * float - Fuel trim %
-*/
-float ELM327::longTermFuelTrimBank_1()
-{
-    return processPID(SERVICE_01, LONG_TERM_FUEL_TRIM_BANK_1, 1, 1, 100.0 / 128.0, -100.0);
+    if ((nb_rx_state != ELM_SUCCESS) || (strstr(payload, RESPONSE_OK) == NULL))
+        return false;
+
+    Timing.dataTimeout    = dataTimeout;
+    Timing.adaptiveTiming = adaptiveTiming;
+    Timing.windowQueries  = 0;
+    Timing.windowNoData   = 0;
+
+    return true;
 }
 
 /*
- float ELM327::shortTermFuelTrimBank_2()
+ bool ELM327::negotiateBaud(const uint32_t& currentBaud, const uint32_t& baud, bool (*setHostBaud)(const uint32_t& baud))
 
  Description:
  ------------
-  * Find fuel trim %
+  * Switches the serial link to a faster baud rate with the "AT BRD" handshake of the
+    ELM327 datasheet:
+      - The ELM327 answers "OK" at the current rate, switches to the new rate and sends
+        its ID ("AT I")
+      - The host switches (setHostBaud()), checks the ID and confirms it with a CR within
+        the handshake timeout ("AT BRT"). The ELM327 then answers "OK" at the new rate
+      - Without a valid CR, the ELM327 goes back to the current rate by itself
+
+  * On failure the host is switched back to currentBaud, so the ELM327 can still be used.
+    The new rate is kept until the ELM327 is powered off or fully reset ("AT Z")
 
  Inputs:
  -------
-  * void
+  * uint32_t currentBaud - Baud rate the host and the ELM327 are using now
+  * uint32_t baud        - Baud rate to switch to - 4000000 / baud must be an "AT BRD"
+                           divisor (8 to 255) within BAUD_TOLERANCE_PERCENT
+  * (*setHostBaud)()     - Function that switches the host side of the serial port,
+                           i.e. Serial1.updateBaudRate(baud). Returns false if the host
+                           can't use the rate - negotiateBaud() then falls back
 
  Return:
  -------
-  * float - Fuel trim %
+  * bool - Whether or not the new baud rate is in use
 */
-float ELM327::shortTermFuelTrimBank_2()
+bool ELM327::negotiateBaud(const uint32_t& currentBaud,
+                           const uint32_t& baud,
+                           bool (*setHostBaud)(const uint32_t& baud))
 {
-    return processPID(SERVICE_01, SHORT_TERM_FUEL_TRIM_BANK_2, 1, 1, 100.0 / 128.0, -100.0);
-}
+    char     command[12] = {'\0'};
+    char     line[ADAPTER_ID_LEN];
+    uint32_t divisor = (baud > 0) ? ((4000000UL + baud / 2) / baud) : 0;
 
-/*
- float ELM327::longTermFuelTrimBank_2()
+    if (!setHostBaud || (divisor < 8) || (divisor > 0xFF))
+        return false;
 
- Description:
- ------------
-  * Find fuel trim %
+    uint32_t actualBaud = 4000000UL / divisor;
+    uint32_t error      = (actualBaud > baud) ? (actualBaud - baud) : (baud - actualBaud);
 
- Inputs:
- -------
-  * void
+    if ((error * 100) > (baud * BAUD_TOLERANCE_PERCENT))
+    {
+        if (debugMode)
+        {
+            Serial.print(F("No AT BRD divisor for "));
+            Serial.println(baud);
+        }
 
- Return:
- -------
-  * float - Fuel trim %
-*/
-float ELM327::longTermFuelTrimBank_2()
-{
-    return processPID(SERVICE_01, LONG_TERM_FUEL_TRIM_BANK_2, 1, 1, 100.0 / 128.0, -100.0);
-}
+        return false;
+    }
 
-/*
- float ELM327::fuelPressure()
+    // Leave the host enough time to switch - not all clones support "AT BRT"
+    snprintf(command, sizeof(command), SET_HANDSHAKE_TIMEOUT, BAUD_HANDSHAKE_TIMEOUT);
+    sendCommand_Blocking(command);
 
- Description:
- ------------
-  * Find fuel pressure in kPa
+    snprintf(command, sizeof(command), TRY_BAUD_DIVISOR, divisor);
 
- Inputs:
- -------
-  * void
+    if (debugMode)
+    {
+        Serial.print(F("Sending the following command/query: "));
+        Serial.println(command);
+    }
 
- Return:
- -------
-  * float - Fuel pressure in kPa
-*/
-float ELM327::fuelPressure()
-{
-    return processPID(SERVICE_01, FUEL_PRESSURE, 1, 1, 3.0);
+    flushInputBuff();
+    elm_port->print(command);
+    elm_port->print('\r');
+    lastCommand[0] = '\0';
+
+    // "OK" at the current rate, "?" if the ELM327 doesn't support the divisor
+    bool ok = false;
+
+    while (readLine(line, sizeof(line), '\r', timeout_ms))
+    {
+        if (!strcmp(line, RESPONSE_OK))
+        {
+            ok = true;
+            break;
+        }
+        else if (!strcmp(line, "?"))
+            break;
+    }
+
+    if (!ok)
+    {
+        if (debugMode)
+            Serial.println(F("AT BRD not supported"));
+
+        readLine(line, sizeof(line), '>', timeout_ms);
+        return false;
+    }
+
+    // The ELM327 sends its ID at the new rate, then waits for the CR
+    uint16_t handshake_ms = BAUD_HANDSHAKE_TIMEOUT * 5;
+    bool     switched     = setHostBaud(baud);
+
+    line[0] = '\0';
+
+    while (switched && readLine(line, sizeof(line), '\r', handshake_ms) && (line[0] == '\0'))
+        ;
+
+    if (switched && (line[0] != '\0') && (strstr(line, "ELM") || !strcmp(line, adapterId)))
+    {
+        elm_port->print('\r');
+
+        if (readLine(line, sizeof(line), '>', timeout_ms) && strstr(line, RESPONSE_OK) &&
+            (sendCommand_Blocking(DISP_ID) == ELM_SUCCESS))
+        {
+            if (debugMode)
+            {
+                Serial.print(F("Switched to "));
+                Serial.print(baud);
+                Serial.println(F(" baud"));
+            }
+
+            return true;
+        }
+    }
+
+    if (debugMode)
+    {
+        Serial.print(F("Couldn't switch to "));
+        Serial.print(baud);
+        Serial.println(F(" baud - falling back"));
+    }
+
+    // The ELM327 goes back to the current rate after the handshake timeout and sends a prompt
+    setHostBaud(currentBaud);
+    readLine(line, sizeof(line), '>', handshake_ms + timeout_ms);
+    flushInputBuff();
+    sendCommand_Blocking(DISP_ID);
+
+    return false;
 }
 
 /*
- uint8_t ELM327::manifoldPressure()
+ bool ELM327::readLine(char line[], const uint8_t& lineLen, const char& end, const uint16_t& wait_ms)
 
  Description:
  ------------
-  * Find intake manifold absolute pressure in kPa
+  * Reads the serial port directly (not through payload) until the end char, keeping only
+    alphanumeric, decimal and '?' chars. Used where the ELM327 doesn't send a prompt
 
  Inputs:
  -------
-  * void
+  * char line[]     - Buffer for the chars before the end char
+  * uint8_t lineLen - Size of line, longer lines are truncated
+  * char end        - Char to read up to, i.e. '\r' or '>'
+  * uint16_t wait_ms - How long to wait for the end char
 
  Return:
  -------
-  * uint8_t - Intake manifold absolute pressure in kPa
+  * bool - Whether or not the end char was read in time
 */
-uint8_t ELM327::manifoldPressure()
+bool ELM327::readLine(char line[], const uint8_t& lineLen, const char& end, const uint16_t& wait_ms)
 {
-    return (uint8_t)processPID(SERVICE_01, INTAKE_MANIFOLD_ABS_PRESSURE, 1, 1);
+    uint8_t  len   = 0;
+    uint32_t start = millis();
+
+    line[0] = '\0';
+
+    while ((millis() - start) < wait_ms)
+    {
+        if (!elm_port->available())
+            continue;
+
+        char recChar = elm_port->read();
+
+        if (recChar == end)
+            return true;
+
+        if ((isalnum(recChar) || (recChar == '.') || (recChar == '?')) && (len < (lineLen - 1)))
+        {
+            line[len++] = recChar;
+            line[len]   = '\0';
+        }
+    }
+
+    return false;
 }
 
 /*
- float ELM327::rpm()
+ bool ELM327::connectProtocol(const char& protocol)
 
  Description:
  ------------
-  * Queries and parses received message for/returns vehicle RMP data
+  * Sets the protocol of the ELM327 and connects to the ECU - see initializeELM()
 
  Inputs:
  -------
-  * void
+  * char protocol - Protocol ID to specify the ELM327 to communicate with the ECU over
 
  Return:
  -------
-  * float - Vehicle RPM
+  * bool - Whether or not the ELM327 connected
 */
-float ELM327::rpm()
+bool ELM327::connectProtocol(const char& protocol)
 {
-    return processPID(SERVICE_01, ENGINE_RPM, 1, 2, 1.0 / 4.0);
+    char command[10] = {'\0'};
+
+    // Automatic searching for protocol requires setting the protocol to AUTO and then
+    // sending an OBD command to initiate the protocol search. The OBD command "0100"
+    // requests a list of supported PIDs 0x00 - 0x20 and is guaranteed to work
+    if (protocol == '0')
+    {
+        // Tell the ELM327 to do an auto protocol search. If a valid protocol is found, it will be saved to memory.
+        // Some ELM clones may not have memory enabled and thus will perform the search every time.
+        snprintf(command, sizeof(command), SET_PROTOCOL_TO_AUTO_H_SAVE, protocol);
+        if (sendCommand_Blocking(command) == ELM_SUCCESS)
+        {
+            if (strstr(payload, RESPONSE_OK) != NULL)
+            {
+                // Protocol search can take a comparatively long time. Temporarily set
+                // the timeout value to 30 seconds, then restore the previous value.
+                uint16_t prevTimeout = timeout_ms;
+                timeout_ms = 30000;
+
+                int8_t state = sendCommand_Blocking("0100");
+
+                if (state == ELM_SUCCESS)
+                {
+                    timeout_ms = prevTimeout;
+                    connected = true;
+                    readProtocol();
+                    return connected;
+                }
+                else if (state == ELM_BUFFER_OVERFLOW)
+                {
+                    while (elm_port->available())
+                        elm_port->read();
+                }
+
+                timeout_ms = prevTimeout;
+            }
+        }
+    }
+    else
+    {
+        // Set protocol
+        snprintf(command, sizeof(command), TRY_PROT_H_AUTO_SEARCH, protocol);
+
+        if (sendCommand_Blocking(command) == ELM_SUCCESS)
+        {
+            if (strstr(payload, RESPONSE_OK) != NULL)
+            {
+                connected = true;
+                activeProtocol = protocol;
+                return connected;
+            }
+        }
+    }
+
+    if (debugMode)
+    {
+        Serial.print(F("Setting protocol via "));
+        Serial.print(TRY_PROT_H_AUTO_SEARCH);
+        Serial.print(F(" did not work - trying via "));
+        Serial.println(SET_PROTOCOL_TO_H_SAVE);
+    }
+
+    // Set protocol and save
+    snprintf(command, sizeof(command), SET_PROTOCOL_TO_H_SAVE, protocol);
+
+    if (sendCommand_Blocking(command) == ELM_SUCCESS)
+    {
+        if (strstr(payload, RESPONSE_OK) != NULL)
+        {
+            connected = true;
+            activeProtocol = protocol;
+            return connected;
+        }
+    }
+    
+    if (debugMode)
+    {
+        Serial.print(F("Setting protocol via "));
+        Serial.print(SET_PROTOCOL_TO_H_SAVE);
+        Serial.println(F(" did not work"));
+    }
+
+    return connected;
 }
 
 /*
- int32_t ELM327::kph()
+ void ELM327::readProtocol()
 
  Description:
  ------------
-  *  Queries and parses received message for/returns vehicle speed data (kph)
+  * Asks the ELM327 which protocol it is currently using and stores it in "activeProtocol"
 
  Inputs:
  -------
@@ -1170,59 +1147,189 @@ float ELM327::rpm()
 
  Return:
  -------
-  * int32_t - Vehicle speed in kph
+  * void
 */
-int32_t ELM327::kph()
+void ELM327::readProtocol()
 {
-    return (int32_t)processPID(SERVICE_01, VEHICLE_SPEED, 1, 1);
+    if (sendCommand_Blocking(DISP_CURRENT_PROTOCOL_NUM) == ELM_SUCCESS)
+    {
+        // The response is the protocol ID, prefixed with 'A' if it was found by automatic search
+        size_t len = strlen(payload);
+
+        if (len > 0)
+            activeProtocol = payload[len - 1];
+    }
+
+    if (debugMode)
+    {
+        Serial.print(F("Active protocol: "));
+        Serial.println(activeProtocol);
+    }
 }
 
 /*
- float ELM327::mph()
+ void ELM327::formatQueryArray(uint8_t service, uint16_t pid, uint8_t num_responses)
 
  Description:
  ------------
-  *  Queries and parses received message for/returns vehicle speed data (mph)
+  * Creates a query stack to be sent to ELM327
 
  Inputs:
  -------
-  * void
+  * uint16_t service - Service number of the queried PID
+  * uint32_t pid     - PID number of the queried PID
+  * uint8_t num_responses - see function header for "queryPID()", 0 to not specify it
 
  Return:
  -------
-  * float - Vehicle speed in mph
+  * void
 */
-float ELM327::mph()
+void ELM327::formatQueryArray(const uint8_t&  service,
+                              const uint16_t& pid,
+                              const uint8_t&  num_responses)
 {
-    return kph() * KPH_MPH_CONVERT;
+    if (debugMode)
+    {
+        Serial.print(F("Service: "));
+        Serial.println(service);
+        Serial.print(F("PID: "));
+        Serial.println(pid);
+    }
+
+    isMode0x22Query = (service == 0x22 && pid <= 0xFF); // mode 0x22 responses always zero-pad the pid to 4 chars, even for a 2-char pid
+
+    query[0] = ((service >> 4) & 0xF) + '0';
+    query[1] = (service & 0xF) + '0';
+
+    // determine PID length (standard queries have 16-bit PIDs,
+    // but some custom queries have PIDs with 32-bit values)
+    if (pid & 0xFF00)
+    {
+        if (debugMode)
+            Serial.println(F("Long query detected"));
+
+        longQuery = true;
+
+        query[2] = ((pid >> 12) & 0xF) + '0';
+        query[3] = ((pid >> 8) & 0xF) + '0';
+        query[4] = ((pid >> 4) & 0xF) + '0';
+        query[5] = (pid & 0xF) + '0';
+
+        if (specifyNumResponses && num_responses)
+        {
+            if (num_responses > 0xF)
+            {
+                query[6] = ((num_responses >> 4) & 0xF) + '0';
+                query[7] = (num_responses & 0xF) + '0';
+                query[8] = '\0';
+
+                upper(query, 8);
+            }
+            else
+            {
+                query[6] = (num_responses & 0xF) + '0';
+                query[7] = '\0';
+                query[8] = '\0';
+
+                upper(query, 7);
+            }
+        }
+        else
+        {
+            query[6] = '\0';
+            query[7] = '\0';
+            query[8] = '\0';
+
+            upper(query, 6);
+        }
+    }
+    else
+    {
+        if (debugMode)
+            Serial.println(F("Normal length query detected"));
+
+        longQuery = false;
+
+        query[2] = ((pid >> 4) & 0xF) + '0';
+        query[3] = (pid & 0xF) + '0';
+
+        if (specifyNumResponses && num_responses)
+        {
+            if (num_responses > 0xF)
+            {
+                query[4] = ((num_responses >> 4) & 0xF) + '0';
+                query[5] = (num_responses & 0xF) + '0';
+                query[6] = '\0';
+                query[7] = '\0';
+                query[8] = '\0';
+
+                upper(query, 6);
+            }
+            else
+            {
+                query[4] = (num_responses & 0xF) + '0';
+                query[5] = '\0';
+                query[6] = '\0';
+                query[7] = '\0';
+                query[8] = '\0';
+
+                upper(query, 5);
+            }
+        }
+        else
+        {
+            query[4] = '\0';
+            query[5] = '\0';
+            query[6] = '\0';
+            query[7] = '\0';
+            query[8] = '\0';
+
+            upper(query, 4);
+        }
+    }
+
+    if (debugMode)
+    {
+        Serial.print(F("Query string: "));
+        Serial.println(query);
+    }
 }
 
 /*
- float ELM327::timingAdvance()
+ void ELM327::upper(char string[], uint8_t buflen)
 
  Description:
  ------------
-  *  Find timing advance in degrees before Top Dead Center (TDC)
+  * Converts all elements of char array string[] to
+  uppercase ascii
 
  Inputs:
  -------
-  * void
+  * uint8_t string[] - Char array
+  * uint8_t buflen   - Length of char array
 
  Return:
  -------
-  * float - Timing advance in degrees before Top Dead Center (TDC)
+  * void
 */
-float ELM327::timingAdvance()
+void ELM327::upper(char   string[],
+                   uint8_t buflen)
 {
-    return processPID(SERVICE_01, TIMING_ADVANCE, 1, 1, 1.0 / 2.0, -64.0);
+    for (uint8_t i = 0; i < buflen; i++)
+    {
+        if (string[i] > 'Z')
+            string[i] -= 32;
+        else if ((string[i] > '9') && (string[i] < 'A'))
+            string[i] += 7;
+    }
 }
 
 /*
- float ELM327::intakeAirTemp()
+ bool ELM327::timeout()
 
  Description:
  ------------
-  *  Find intake air temperature in C
+  * Determines if a time-out has occurred
 
  Inputs:
  -------
@@ -1230,119 +1337,231 @@ float ELM327::timingAdvance()
 
  Return:
  -------
-  * float - Intake air temperature in C
+  * bool - whether or not a time-out has occurred
 */
-float ELM327::intakeAirTemp()
+bool ELM327::timeout()
 {
-    return processPID(SERVICE_01, INTAKE_AIR_TEMP, 1, 1, 1, -40.0);
+    currentTime = millis();
+    if ((currentTime - previousTime) >= timeout_ms)
+        return true;
+    return false;
 }
 
 /*
- float ELM327::mafRate()
+ uint8_t ELM327::ctoi(uint8_t value)
 
  Description:
  ------------
-  *  Find mass air flow sensor (MAF) air flow rate rate in g/s
+  * converts a decimal or hex char to an int
 
  Inputs:
  -------
-  * void
+  * uint8_t value - char to be converted
 
  Return:
  -------
-  * float - Mass air flow sensor (MAF) air flow rate rate in g/s
+  * uint8_t - int value of parameter "value"
 */
-float ELM327::mafRate()
+uint8_t ELM327::ctoi(uint8_t value)
 {
-    return processPID(SERVICE_01, MAF_FLOW_RATE, 1, 2, 1.0 / 100.0);
-}
-
-/*
- float ELM327::throttle()
+    if (value >= 'A')
+        return value - 'A' + 10;
+    else
+        return value - '0';
+}
+
+/*
+ int8_t ELM327::nextIndex(char const *str,
+                          char const *target,
+                          uint8_t numOccur)
 
  Description:
  ------------
-  *  Find throttle position in %
+  * Finds and returns the first char index of
+  numOccur'th instance of target in str
 
  Inputs:
  -------
-  * void
+  * char const *str    - string to search target within
+  * char const *target - String to search for in str
+  * uint8_t numOccur   - Which instance of target in str
 
  Return:
  -------
-  * float - Throttle position in %
+  * int8_t - First char index of numOccur'th
+  instance of target in str. -1 if there is no
+  numOccur'th instance of target in str
 */
-float ELM327::throttle()
+int8_t ELM327::nextIndex(char const *str,
+                         char const *target,
+                         uint8_t     numOccur)
 {
-    return processPID(SERVICE_01, THROTTLE_POSITION, 1, 1, 100.0 / 255.0);
+    char const *p = str;
+    char const *r = str;
+    uint8_t count;
+
+    for (count = 0;; ++count)
+    {
+        p = strstr(p, target);
+
+        if (count == (numOccur - 1))
+            break;
+
+        if (!p)
+            break;
+
+        p++;
+    }
+
+    if (!p)
+        return -1;
+
+    return p - r;
 }
 
 /*
- uint8_t ELM327::commandedSecAirStatus()
+ void ELM327::removeChar(char *from,
+                          char const *remove)
 
  Description:
  ------------
-  *  Find commanded secondary air status
+  * Removes all instances of each char in string "remove" from the string "from"
 
  Inputs:
  -------
-  * void
+  * char *from         - String to remove target(s) from
+  * char const *remove - Chars to find/remove 
 
  Return:
  -------
-  * uint8_t - Bit encoded status (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_12)
+  * void
 */
-uint8_t ELM327::commandedSecAirStatus()
+void ELM327::removeChar(char *from, const char *remove)
 {
-    return (uint8_t)processPID(SERVICE_01, COMMANDED_SECONDARY_AIR_STATUS, 1, 1);
+    size_t i = 0, j = 0;
+    while (from[i]) {
+        if (!strchr(remove, from[i]))
+            from[j++] = from[i];
+        i++;
+    }
+    from[j] = '\0'; 
 }
-
 /*
- uint8_t ELM327::oxygenSensorsPresent_2banks()
+ double ELM327::conditionResponse(const uint8_t &numExpectedBytes, const float &scaleFactor, const float &bias)
 
  Description:
  ------------
-  *  Find which oxygen sensors are present ([A0..A3] == Bank 1, Sensors 1-4. [A4..A7] == Bank 2...)
+  * Converts the ELM327's response into its correct, numerical value. Returns 0 if fewer than
+    numExpectedBytes data bytes were received
 
  Inputs:
  -------
-  * void
+  * uint8_t numExpectedBytes - Number of valid bytes from the response to process
+  * double scaleFactor       - Amount to scale the response by
+  * float bias               - Amount to bias the response by
 
  Return:
  -------
-  * uint8_t - Bit encoded
+  * double - Converted numerical value
 */
-uint8_t ELM327::oxygenSensorsPresent_2banks()
+double ELM327::conditionResponse(const uint8_t& numExpectedBytes,
+                                 const double&  scaleFactor,
+                                 const double&   bias)
 {
-    return (uint8_t)processPID(SERVICE_01, OXYGEN_SENSORS_PRESENT_2_BANKS, 1, 1);
+    if (numExpectedBytes > 8)
+    {
+        if (debugMode)
+            Serial.println(F("WARNING: Number of expected response bytes is greater than 8 - returning 0"));
+
+        return 0;
+    }
+
+    if (responseDataLen < numExpectedBytes)
+    {
+        if (debugMode)
+            Serial.println(F("WARNING: Number of payload chars is less than the number of expected response chars returned by ELM327 - returning 0"));
+
+        return 0;
+    }
+
+    // The data starts right after the response header, so the value is in the first
+    // numExpectedBytes bytes - any further bytes are padding
+    double value;
+
+    if (numExpectedBytes <= 4)
+    {
+        uint32_t raw = 0;
+
+        for (uint8_t i = 0; i < numExpectedBytes; i++)
+            raw = (raw << 8) | responseData[i];
+
+        value = raw;
+    }
+    else
+    {
+        uint64_t raw = 0;
+
+        for (uint8_t i = 0; i < numExpectedBytes; i++)
+            raw = (raw << 8) | responseData[i];
+
+        value = raw;
+    }
+
+    if (scaleFactor == 1 && bias == 0) // No scale/bias needed
+        return value;
+    else
+        return (value * scaleFactor) + bias;
 }
 
 /*
- uint8_t ELM327::obdStandards()
+ double ELM327::conditionResponse(double (*func)())
 
  Description:
  ------------
-  *  Find the OBD standards this vehicle conforms to (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_1C)
+  * Provides a means to pass in a user-defined function to process the response. Used for PIDs that 
+    don't use the common scaleFactor + Bias formula to calculate the value from the response data. Also
+    useful for processing OEM custom PIDs which are too numerous and varied to encode in the lib. 
 
  Inputs:
  -------
-  * void
+  * (*func)() - pointer to function to do calculate response value
+  
+ Return:
+ -------
+  * double - Converted numerical value
+*/
+
+double ELM327::conditionResponse(double (*func)()) {
+    return func();
+}
+
+/*
+ double ELM327::conditionResponse(double (*func)(const pidResponse&))
+
+ Description:
+ ------------
+  * Same as conditionResponse(double (*func)()), but the user-defined function is passed the
+    response bytes of this ELM327 instance (A, B, C, ...), so it doesn't need to access any
+    global state. Safe to use with several ELM327 instances.
 
+ Inputs:
+ -------
+  * (*func)(const pidResponse&) - pointer to function to do calculate response value
+  
  Return:
  -------
-  * uint8_t - Bit encoded (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_1C)
+  * double - Converted numerical value
 */
-uint8_t ELM327::obdStandards()
-{
-    return (uint8_t)processPID(SERVICE_01, OBD_STANDARDS, 1, 1);
+double ELM327::conditionResponse(double (*func)(const pidResponse&)) {
+    return func(responseBytes);
 }
 
 /*
- uint8_t ELM327::oxygenSensorsPresent_4banks()
+ void ELM327::flushInputBuff()
 
  Description:
  ------------
-  *  Find which oxygen sensors are present (Similar to PID 13, but [A0..A7] == [B1S1, B1S2, B2S1, B2S2, B3S1, B3S2, B4S1, B4S2])
+  * Flushes input serial buffer
 
  Inputs:
  -------
@@ -1350,39 +1569,99 @@ uint8_t ELM327::obdStandards()
 
  Return:
  -------
-  * uint8_t - Bit encoded
+  * void
 */
-uint8_t ELM327::oxygenSensorsPresent_4banks()
+void ELM327::flushInputBuff()
 {
-    return (uint8_t)processPID(SERVICE_01, OXYGEN_SENSORS_PRESENT_4_BANKS, 1, 1);
+    if (debugMode)
+        Serial.println(F("Clearing input serial buffer"));
+
+    while (elm_port->available())
+        elm_port->read();
 }
 
 /*
- bool ELM327::auxInputStatus()
+  void ELM327::queryPID(const uint8_t& service, const uint16_t& pid, const uint8_t& num_responses)
+
+  Description:
+  ------------
+  * Create a PID query command string and send the command
+
+  Inputs:
+  -------
+  * uint8_t service       - The diagnostic service ID. 01 is "Show current data"
+  * uint16_t pid          - The Parameter ID (PID) from the service
+  * uint8_t num_responses - Number of lines of data to receive - see ELM datasheet "Talking to the vehicle".
+                            This can speed up retrieval of information if you know how many responses will be sent.
+                            Basically the OBD scanner will not wait for more responses if it does not need to go through
+                            final timeout. Also prevents OBD scanners from sending mulitple of the same response.
+                            NUM_RESPONSES_AUTO uses the number of responses learned for this PID on the active
+                            protocol. Until it is learned, the query is sent without a count and the responses
+                            are counted. A count that stops matching is learned again
+
+  Return:
+  -------
+  * void
+*/
+void ELM327::queryPID(const uint8_t&  service,
+                      const uint16_t& pid,
+                      const uint8_t&  num_responses)
+{
+    int8_t  hint         = -1;
+    uint8_t numResponses = num_responses;
+
+    if (num_responses == NUM_RESPONSES_AUTO)
+    {
+        // A physically addressed query is answered by that ECU alone - see addressECU()
+        hint         = (learnNumResponses && specifyNumResponses && (addressedECU == 0)) ? findResponseHint(service, pid) : -1;
+        numResponses = (hint >= 0) ? responseHints[hint].numResponses : 1;
+
+        if ((hint >= 0) && debugMode)
+        {
+            Serial.print(F("Number of responses hint: "));
+            Serial.println(numResponses);
+        }
+    }
+
+    formatQueryArray(service, pid, numResponses);
+    sendCommand(query);
+
+    hintIndex = hint;
+    hintSent  = numResponses;
+}
+
+/*
+ uint8_t ELM327::numResponsesHint(const uint8_t& service, const uint16_t& pid)
 
  Description:
  ------------
-  *  Find Power Take Off (PTO) status
+  * Number of responses learned for a PID on the active protocol - see queryPID()
 
  Inputs:
  -------
-  * void
+  * uint8_t service - The diagnostic service ID
+  * uint16_t pid    - The Parameter ID (PID) from the service
 
  Return:
  -------
-  * bool - Power Take Off (PTO) status
+  * uint8_t - Number of responses, 0 if not learned (yet)
 */
-bool ELM327::auxInputStatus()
+uint8_t ELM327::numResponsesHint(const uint8_t& service, const uint16_t& pid)
 {
-    return (bool)processPID(SERVICE_01, AUX_INPUT_STATUS, 1, 1);
+    for (uint8_t i = 0; i < numResponseHints; i++)
+        if ((responseHints[i].service == service) && (responseHints[i].pid == pid) && (responseHints[i].protocol == activeProtocol))
+            return responseHints[i].numResponses;
+
+    return 0;
 }
 
 /*
- uint16_t ELM327::runTime()
+ void ELM327::clearResponseHints()
 
  Description:
  ------------
-  *  Find run time since engine start in s
+  * Forgets all learned numbers of responses, i.e. after the car or the ECUs listening
+    to the queries changed. Also done by setHeader()
 
  Inputs:
  -------
@@ -1390,179 +1669,2963 @@ bool ELM327::auxInputStatus()
 
  Return:
  -------
-  * uint16_t - Run time since engine start in s
+  * void
 */
-uint16_t ELM327::runTime()
+void ELM327::clearResponseHints()
 {
-    return (uint16_t)processPID(SERVICE_01, RUN_TIME_SINCE_ENGINE_START, 1, 2);
+    numResponseHints = 0;
+    hintIndex        = -1;
 }
 
 /*
- uint32_t ELM327::supportedPIDs_21_40()
+ int8_t ELM327::findResponseHint(const uint8_t& service, const uint16_t& pid)
 
  Description:
  ------------
-  * Determine which of PIDs 0x1 through 0x20 are supported (bit encoded)
+  * Finds the responseHints slot of a PID on the active protocol. A new slot is used for
+    a PID seen for the first time. Slots of other protocols are reused
 
  Inputs:
  -------
-  * void
+  * uint8_t service - The diagnostic service ID
+  * uint16_t pid    - The Parameter ID (PID) from the service
 
  Return:
  -------
-  * uint32_t - Bit encoded booleans of supported PIDs 0x21-0x20
+  * int8_t - Slot index, -1 if all slots are taken
 */
-uint32_t ELM327::supportedPIDs_21_40()
+int8_t ELM327::findResponseHint(const uint8_t& service, const uint16_t& pid)
 {
-    return (uint32_t)processPID(SERVICE_01, SUPPORTED_PIDS_21_40, 1, 4);
+    int8_t stale = -1;
+
+    for (uint8_t i = 0; i < numResponseHints; i++)
+    {
+        if ((responseHints[i].service == service) && (responseHints[i].pid == pid))
+        {
+            if (responseHints[i].protocol == activeProtocol)
+                return i;
+
+            stale = i;
+        }
+        else if ((stale < 0) && (responseHints[i].protocol != activeProtocol))
+            stale = i;
+    }
+
+    if ((stale < 0) && (numResponseHints < RESPONSE_HINT_SLOTS))
+        stale = numResponseHints++;
+
+    if (stale >= 0)
+    {
+        responseHints[stale].service      = service;
+        responseHints[stale].pid          = pid;
+        responseHints[stale].protocol     = activeProtocol;
+        responseHints[stale].numResponses = 0;
+        responseHints[stale].uses         = 0;
+    }
+
+    return stale;
 }
 
 /*
- uint16_t ELM327::distTravelWithMIL()
+ void ELM327::updateResponseHint(const int8_t& status)
 
  Description:
  ------------
-  *  Find distance traveled with malfunction indicator lamp (MIL) on in km
+  * Learns the number of responses from the query that just completed, or drops the
+    learned count when the query shows it no longer matches:
+      - Fewer responses than the count (or none) - the ELM327 waited for the final
+        timeout, so the count is learned again
+      - More responses than the count can't be seen (the ELM327 stops listening after
+        the count), so the count is learned again every RESPONSE_HINT_RECHECK queries
 
  Inputs:
  -------
-  * void
+  * const int8_t& status - ELM_XXX status the query completed with
 
  Return:
  -------
-  * uint16_t - Distance traveled with malfunction indicator lamp (MIL) on in km
+  * void
 */
-uint16_t ELM327::distTravelWithMIL()
+void ELM327::updateResponseHint(const int8_t& status)
 {
-    return (uint16_t)processPID(SERVICE_01, DISTANCE_TRAVELED_WITH_MIL_ON, 1, 2);
+    responseHint& hint = responseHints[hintIndex];
+    uint8_t       seen = (status == ELM_SUCCESS) ? stream.numResponses : 0;
+
+    hintIndex = -1;
+
+    if (hintSent == 0)
+    {
+        // Learning - the ELM327 only supports counts up to 0xF
+        if ((seen > 0) && (seen <= 0xF))
+        {
+            hint.numResponses = seen;
+            hint.uses         = 0;
+
+            if (debugMode)
+            {
+                Serial.print(F("Learned number of responses: "));
+                Serial.println(seen);
+            }
+        }
+    }
+    else if ((seen != hintSent) || (++hint.uses >= RESPONSE_HINT_RECHECK))
+    {
+        if (debugMode && (seen != hintSent))
+        {
+            Serial.print(F("Number of responses mismatch, expected "));
+            Serial.print(hintSent);
+            Serial.print(F(" got "));
+            Serial.println(seen);
+        }
+
+        hint.numResponses = 0;
+    }
 }
 
 /*
- float ELM327::fuelRailPressure()
+ void ELM327::queryPID(char queryStr[])
 
  Description:
  ------------
-  *  Find fuel Rail Pressure (relative to manifold vacuum) in kPa
+  * Queries ELM327 for a specific type of vehicle telemetry data
 
  Inputs:
  -------
-  * void
+  * char queryStr[] - Query string (service and PID)
 
  Return:
  -------
-  * float - Fuel Rail Pressure (relative to manifold vacuum) in kPa
+  * void
 */
-float ELM327::fuelRailPressure()
+void ELM327::queryPID(char queryStr[])
 {
-    return processPID(SERVICE_01, FUEL_RAIL_PRESSURE, 1, 2, 0.079);
+    if (strlen(queryStr) <= 4)
+        longQuery = false;
+    else
+        longQuery = true;
+
+    sendCommand(queryStr);
+}
+
+/*
+ double ELM327::processPID(const uint8_t& service, const uint16_t& pid, const uint8_t& num_responses, const uint8_t& numExpectedBytes, const float& scaleFactor, const float& bias)
+
+ Description:
+ ------------
+  * Queries ELM327 for a specific type of vehicle telemetry data
+
+ Inputs:
+ -------
+  * uint8_t service          - The diagnostic service ID. 01 is "Show current data"
+  * uint16_t pid             - The Parameter ID (PID) from the service
+  * uint8_t num_responses    - Number of lines of data to receive - see ELM datasheet "Talking to the vehicle".
+                               This can speed up retrieval of information if you know how many responses will be sent.
+                               Basically the OBD scanner will not wait for more responses if it does not need to go through
+                               final timeout. Also prevents OBD scanners from sending mulitple of the same response.
+                               NUM_RESPONSES_AUTO uses the learned number - see queryPID()
+  * uint8_t numExpectedBytes - Number of valid bytes from the response to process
+  * float scaleFactor        - Amount to scale the response by
+  * float bias               - Amount to bias the response by
+
+ Return:
+ -------
+  * double - The PID value if successfully received, else 0.0
+*/
+double ELM327::processPID(const uint8_t&  service,
+                          const uint16_t& pid,
+                          const uint8_t&  num_responses,
+                          const uint8_t&  numExpectedBytes,
+                          const double&   scaleFactor,
+                          const float&    bias)
+{
+    if (nb_query_state == SEND_COMMAND)
+    {
+        if (applyBackoff() == ELM_GETTING_MSG)
+            return 0.0;
+
+        queryPID(service, pid, num_responses);
+        nb_query_state = WAITING_RESP;
+    }
+    else if (nb_query_state == WAITING_RESP)
+    {
+        get_response();
+        if (nb_rx_state == ELM_SUCCESS)
+        {
+            nb_query_state = SEND_COMMAND; // Reset the query state machine for next command
+            findResponse();
+
+            return decodePID(pid, numExpectedBytes, scaleFactor, bias);
+        }
+        else if (nb_rx_state != ELM_GETTING_MSG)
+            nb_query_state = SEND_COMMAND; // Error or timeout, so reset the query state machine for next command
+    }
+    return 0.0;
+}
+
+/*
+ double ELM327::decodePID(const uint16_t& pid, const uint8_t& numExpectedBytes, const double& scaleFactor, const float& bias)
+
+ Description:
+ ------------
+  * Converts the current contents of "response" into the PID's value using either the
+    PID's calculator function (see selectCalculator()) or the default scaleFactor + bias
+    formula implemented in conditionResponse()
+
+ Inputs:
+ -------
+  * uint16_t pid             - The Parameter ID (PID) the response belongs to
+  * uint8_t numExpectedBytes - Number of valid bytes from the response to process
+  * double scaleFactor       - Amount to scale the response by
+  * float bias               - Amount to bias the response by
+
+ Return:
+ -------
+  * double - Converted numerical value
+*/
+double ELM327::decodePID(const uint16_t& pid,
+                         const uint8_t&  numExpectedBytes,
+                         const double&   scaleFactor,
+                         const float&    bias)
+{
+    setResponseBytes(numExpectedBytes);
+
+    double (*calculator)(const pidResponse&) = selectCalculator(pid);
+
+    if (nullptr == calculator) {
+        //Use the default scaleFactor + Bias calculation
+        return conditionResponse(numExpectedBytes, scaleFactor, bias);
+    }
+    else {
+        return conditionResponse(calculator);
+    }
+}
+
+/*
+ void ELM327::processPIDs(const uint8_t& service, pidRequest requests[], const uint8_t& numRequests)
+
+ Description:
+ ------------
+  * Queries ELM327 for several PIDs of the same service using as few requests as possible.
+    On ISO 15765 (CAN) protocols, up to MAX_PIDS_PER_QUERY PIDs are requested in a single
+    query (i.e. "010C0D05110F04") and the combined reply is split per PID using each PID's
+    number of expected bytes. On all other protocols, the PIDs are transparently requested
+    one at a time.
+
+  * This is a non-blocking function: nb_rx_state stays ELM_GETTING_MSG until all requests
+    have been processed and is ELM_SUCCESS once the whole batch is done. If an error occurs,
+    processing stops and nb_rx_state holds the error. Check each request's "valid" flag
+    before using its "value".
+
+ Inputs:
+ -------
+  * uint8_t service         - The diagnostic service ID. 01 is "Show current data"
+  * pidRequest requests[]   - PIDs to query along with their numExpectedBytes, scaleFactor
+                              and bias. The decoded values are written back to each entry.
+                              Service 01 entries with numExpectedBytes == 0 are filled in
+                              from the PID descriptor table
+  * uint8_t numRequests     - Number of entries in requests[]
+
+ Return:
+ -------
+  * void
+*/
+void ELM327::processPIDs(const uint8_t& service,
+                         pidRequest     requests[],
+                         const uint8_t& numRequests)
+{
+    if (nb_query_state == SEND_COMMAND)
+    {
+        if (applyBackoff() == ELM_GETTING_MSG)
+            return;
+
+        if (batchIndex >= numRequests)
+            batchIndex = 0;
+
+        if (batchIndex == 0)
+        {
+            for (uint8_t i = 0; i < numRequests; i++)
+            {
+                pidDescriptor descriptor;
+
+                // Requests without a byte count are completed from the PID descriptor table
+                if ((requests[i].numExpectedBytes == 0) && (service == SERVICE_01) && getPidDescriptor(requests[i].pid, descriptor))
+                {
+                    requests[i].numExpectedBytes = descriptor.numBytes;
+                    requests[i].scaleFactor      = descriptor.scaleFactor;
+                    requests[i].bias             = descriptor.bias;
+                }
+
+                requests[i].valid = false;
+            }
+        }
+
+        batchCount = numRequests - batchIndex;
+
+        if (!isCANProtocol())
+            batchCount = 1;
+        else if (batchCount > MAX_PIDS_PER_QUERY)
+            batchCount = MAX_PIDS_PER_QUERY;
+
+        formatBatchQueryArray(service, requests + batchIndex, batchCount);
+        sendCommand(query);
+        nb_query_state = WAITING_RESP;
+    }
+    else if (nb_query_state == WAITING_RESP)
+    {
+        get_response();
+        if (nb_rx_state == ELM_SUCCESS)
+        {
+            nb_query_state = SEND_COMMAND; // Reset the query state machine for next command
+            parseBatchResponse(service, requests + batchIndex, batchCount);
+            batchIndex += batchCount;
+
+            if (batchIndex < numRequests)
+                nb_rx_state = ELM_GETTING_MSG; // More requests left in this batch
+            else
+                batchIndex = 0;
+        }
+        else if (nb_rx_state != ELM_GETTING_MSG)
+        {
+            nb_query_state = SEND_COMMAND; // Error or timeout, so reset the query state machine for next command
+            batchIndex = 0;
+        }
+    }
+}
+
+/*
+ void ELM327::formatBatchQueryArray(const uint8_t& service, const pidRequest requests[], const uint8_t& numRequests)
+
+ Description:
+ ------------
+  * Creates a multi-PID query stack to be sent to ELM327
+
+ Inputs:
+ -------
+  * uint8_t service       - Service number of the queried PIDs
+  * pidRequest requests[] - PIDs to add to the query
+  * uint8_t numRequests   - Number of PIDs to add to the query (max MAX_PIDS_PER_QUERY)
+
+ Return:
+ -------
+  * void
+*/
+void ELM327::formatBatchQueryArray(const uint8_t&   service,
+                                   const pidRequest requests[],
+                                   const uint8_t&   numRequests)
+{
+    uint8_t index = 0;
+
+    longQuery       = false;
+    isMode0x22Query = false;
+
+    query[index++] = ((service >> 4) & 0xF) + '0';
+    query[index++] = (service & 0xF) + '0';
+
+    for (uint8_t i = 0; i < numRequests; i++)
+    {
+        query[index++] = ((requests[i].pid >> 4) & 0xF) + '0';
+        query[index++] = (requests[i].pid & 0xF) + '0';
+    }
+
+    // A CAN ECU answers a multi-PID request with a single (multi-frame) message
+    if (specifyNumResponses)
+        query[index++] = '1';
+
+    query[index] = '\0';
+    upper(query, index);
+
+    if (debugMode)
+    {
+        Serial.print(F("Batch query string: "));
+        Serial.println(query);
+    }
+}
+
+/*
+ void ELM327::parseBatchResponse(const uint8_t& service, pidRequest requests[], const uint8_t& numRequests)
+
+ Description:
+ ------------
+  * Splits the buffered reply to a (multi-PID) query into per-PID slices and decodes
+    each slice with decodePID()
+
+ Inputs:
+ -------
+  * uint8_t service       - Service number of the queried PIDs
+  * pidRequest requests[] - PIDs that were queried. The decoded values are written back
+  * uint8_t numRequests   - Number of PIDs that were queried
+
+ Return:
+ -------
+  * void
+*/
+void ELM327::parseBatchResponse(const uint8_t& service,
+                                pidRequest     requests[],
+                                const uint8_t& numRequests)
+{
+    uint16_t payLen = strlen(payload);
+    uint16_t index  = 0;
+
+    // Find the response service ID - only even indexes are valid byte boundaries
+    while (((index + 1) < payLen) && (((ctoi(payload[index]) << 4) | ctoi(payload[index + 1])) != (service + 0x40)))
+        index += 2;
+
+    if ((index + 1) >= payLen)
+    {
+        if (debugMode)
+            Serial.println(F("Response not detected"));
+
+        return;
+    }
+
+    index += 2;
+
+    while ((index + 1) < payLen)
+    {
+        uint8_t pid = (ctoi(payload[index]) << 4) | ctoi(payload[index + 1]);
+        pidRequest* request = nullptr;
+
+        index += 2;
+
+        for (uint8_t i = 0; i < numRequests; i++)
+        {
+            if (requests[i].pid == pid)
+            {
+                request = &requests[i];
+                break;
+            }
+        }
+
+        // Without a matching request, the length of the PID's data is unknown
+        if (request == nullptr)
+        {
+            if (debugMode)
+            {
+                Serial.print(F("Unexpected PID in batch response: "));
+                Serial.println(pid);
+            }
+            break;
+        }
+
+        numPayChars = request->numExpectedBytes * 2;
+
+        if ((index + numPayChars) > payLen)
+        {
+            if (debugMode)
+                Serial.println(F("WARNING: Batch response truncated"));
+
+            break;
+        }
+
+        decodeResponseData(payload + index, numPayChars);
+        index += numPayChars;
+
+        request->value = decodePID(pid, request->numExpectedBytes, request->scaleFactor, request->bias);
+        request->valid = true;
+
+        if (debugMode)
+        {
+            Serial.print(F("PID "));
+            Serial.print(pid);
+            Serial.print(F(": "));
+            Serial.println(request->value);
+        }
+    }
+}
+
+/*
+ bool ELM327::isCANProtocol()
+
+ Description:
+ ------------
+  * Determines if the protocol detected during initialization is an ISO 15765 (CAN)
+    protocol
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * bool - Whether or not the active protocol is ISO 15765 (CAN)
+*/
+bool ELM327::isCANProtocol()
+{
+    return (activeProtocol >= ISO_15765_11_BIT_500_KBAUD) && (activeProtocol <= ISO_15765_29_BIT_250_KBAUD);
+}
+
+/*
+ void ELM327::setResponseBytes(const uint8_t& numBytes)
+
+ Description:
+ ------------
+  * Copies the first numBytes bytes of responseData into responseBytes (A = first byte)
+    for use by the calculator functions. responseBytes.data/len span all of responseData.
+    The response bytes are kept per instance (and not in globals) so that the calculators
+    of several ELM327 instances don't interfere
+
+ Inputs:
+ -------
+  * uint8_t numBytes - Number of data bytes the PID returns (only the first 8 go to A to H)
+
+ Return:
+ -------
+  * void
+*/
+void ELM327::setResponseBytes(const uint8_t& numBytes)
+{
+    uint8_t bytes[8] = {0};
+    uint8_t count    = (numBytes < responseDataLen) ? numBytes : responseDataLen;
+
+    memcpy(bytes, responseData, (count < 8) ? count : 8);
+
+    responseBytes.A = bytes[0];
+    responseBytes.B = bytes[1];
+    responseBytes.C = bytes[2];
+    responseBytes.D = bytes[3];
+    responseBytes.E = bytes[4];
+    responseBytes.F = bytes[5];
+    responseBytes.G = bytes[6];
+    responseBytes.H = bytes[7];
+    responseBytes.data = responseData;
+    responseBytes.len  = responseDataLen;
+}
+
+/*
+ double (*ELM327::selectCalculator(uint16_t pid))(const pidResponse&)
+
+ Description:
+ ------------
+  * Selects the appropriate calculation function for a given PID from the PID descriptor
+    table (see pidTable).
+
+ Inputs:
+ -------
+  * uint16_t pid             - The Parameter ID (PID) from the service
+  
+
+ Return:
+ -------
+  * double (*func(const pidResponse&)) - Pointer to a function to be used to calculate the value for this PID.
+    Returns nullptr if the PID is calculated using the default scaleFactor + Bias formula as
+    implemented in conditionResponse(). (Maintained for backward compatibility)
+*/
+double (*ELM327::selectCalculator(uint16_t pid))(const pidResponse&) 
+{       
+    pidDescriptor descriptor;
+
+    if (!getPidDescriptor(pid, descriptor))
+        return nullptr;
+
+    return descriptor.calculator;
+}
+
+/*
+ bool ELM327::getPidDescriptor(const uint16_t& pid, pidDescriptor& descriptor)
+
+ Description:
+ ------------
+  * Looks up the descriptor (number of bytes, scale factor, bias, calculator function and
+    unit) of a standard service 01 PID. The lookup is a direct index into pidTable.
+
+ Inputs:
+ -------
+  * uint16_t pid             - The Parameter ID (PID) from service 01
+  * pidDescriptor descriptor - Descriptor to copy the PID's table entry into
+
+ Return:
+ -------
+  * bool - Whether or not the PID has an entry in the table
+*/
+bool ELM327::getPidDescriptor(const uint16_t& pid, pidDescriptor& descriptor)
+{
+    if (pid >= NUM_PID_DESCRIPTORS)
+        return false;
+
+    memcpy_P(&descriptor, &pidTable[pid], sizeof(pidDescriptor));
+    return true;
+}
+
+/*
+ double ELM327::read(const uint8_t& pid)
+
+ Description:
+ ------------
+  * Queries and decodes any standard service 01 PID using its entry in the PID descriptor
+    table. This is the generic form of the named PID functions (i.e. read(ENGINE_RPM) is
+    the same as rpm()).
+
+ Inputs:
+ -------
+  * uint8_t pid - The Parameter ID (PID) from service 01
+
+ Return:
+ -------
+  * double - The PID value if successfully received, else 0.0. If the PID isn't in the
+             table, nb_rx_state is set to ELM_GENERAL_ERROR
+*/
+double ELM327::read(const uint8_t& pid)
+{
+    pidDescriptor descriptor;
+
+    if (!getPidDescriptor(pid, descriptor))
+    {
+        if (debugMode)
+        {
+            Serial.print(F("No descriptor for PID: "));
+            Serial.println(pid);
+        }
+
+        nb_rx_state = ELM_GENERAL_ERROR;
+        return 0.0;
+    }
+
+    return processPID(SERVICE_01, pid, NUM_RESPONSES_AUTO, descriptor.numBytes, descriptor.scaleFactor, descriptor.bias);
+}
+/*
+ int32_t ELM327::readFixed(const uint8_t& pid)
+
+ Description:
+ ------------
+  * Integer counterpart of read(): queries a standard service 01 PID and returns its value
+    in fixed-point form, without any floating point math. The fixed-point value is the PID's
+    data bytes plus the descriptor's fixedBias, so the engineering value is
+    fixed-point value * scaleFactor (see getPidDescriptor()). Examples:
+      - ENGINE_RPM:          rpm * 4
+      - ENGINE_COOLANT_TEMP: temperature in degrees C
+      - THROTTLE_POSITION:   percent * 255 / 100
+      - VEHICLE_SPEED:       speed in km/h
+
+ Inputs:
+ -------
+  * uint8_t pid - The Parameter ID (PID) from service 01
+
+ Return:
+ -------
+  * int32_t - The fixed-point PID value if successfully received, else 0. If the PID isn't
+              in the table, nb_rx_state is set to ELM_GENERAL_ERROR
+*/
+int32_t ELM327::readFixed(const uint8_t& pid)
+{
+    if (nb_query_state == SEND_COMMAND)
+    {
+        if (pid >= NUM_PID_DESCRIPTORS)
+        {
+            nb_rx_state = ELM_GENERAL_ERROR;
+            return 0;
+        }
+
+        if (applyBackoff() == ELM_GETTING_MSG)
+            return 0;
+
+        queryPID(SERVICE_01, pid, NUM_RESPONSES_AUTO);
+        nb_query_state = WAITING_RESP;
+    }
+    else if (nb_query_state == WAITING_RESP)
+    {
+        get_response();
+        if (nb_rx_state == ELM_SUCCESS)
+        {
+            nb_query_state = SEND_COMMAND; // Reset the query state machine for next command
+            findResponse();
+
+            return fixedValue(pid);
+        }
+        else if (nb_rx_state != ELM_GETTING_MSG)
+            nb_query_state = SEND_COMMAND; // Error or timeout, so reset the query state machine for next command
+    }
+    return 0;
+}
+
+/*
+ int32_t ELM327::fixedValue(const uint8_t& pid)
+
+ Description:
+ ------------
+  * Decodes the last response (responseData) as the fixed-point value of a standard
+    service 01 PID - see readFixed()
+
+ Inputs:
+ -------
+  * uint8_t pid - The Parameter ID (PID) from service 01 the response belongs to
+
+ Return:
+ -------
+  * int32_t - The fixed-point PID value, 0 if the PID isn't in the table or the
+              response is too short
+*/
+int32_t ELM327::fixedValue(const uint8_t& pid)
+{
+    if (pid >= NUM_PID_DESCRIPTORS)
+        return 0;
+
+    uint8_t numBytes   = pgm_read_byte(&pidTable[pid].numBytes);
+    uint8_t fixedFlags = pgm_read_byte(&pidTable[pid].fixedFlags);
+    int16_t fixedBias  = (int16_t)pgm_read_word(&pidTable[pid].fixedBias);
+
+    if (fixedFlags & FIXED_FIRST_BYTE)
+        numBytes = 1;
+
+    if ((numBytes > 4) || (responseDataLen < numBytes))
+        return 0;
+
+    uint32_t raw = 0;
+
+    for (uint8_t i = 0; i < numBytes; i++)
+        raw = (raw << 8) | responseData[i];
+
+    if ((fixedFlags & FIXED_SIGNED) && (numBytes == 2))
+        return (int16_t)raw + fixedBias;
+
+    return (int32_t)raw + fixedBias;
+}
+
+
+/*
+ uint32_t ELM327::supportedPIDs_1_20()
+
+ Description:
+ ------------
+  * Determine which of PIDs 0x1 through 0x20 are supported (bit encoded)
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint32_t - Bit encoded booleans of supported PIDs 0x1-0x20
+*/
+uint32_t ELM327::supportedPIDs_1_20()
+{
+    return (uint32_t)read(SUPPORTED_PIDS_1_20);
+}
+
+/*
+ uint32_t ELM327::monitorStatus()
+
+ Description:
+ ------------
+  * Monitor status since DTCs cleared (Includes malfunction indicator
+  lamp (MIL) status and number of DTCs). See https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_01
+  for more info
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint32_t - Bit encoded status (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_01)
+*/
+uint32_t ELM327::monitorStatus()
+{
+    return (uint32_t)read(MONITOR_STATUS_SINCE_DTC_CLEARED);
+}
+
+/*
+ uint16_t ELM327::freezeDTC()
+
+ Description:
+ ------------
+  * Freeze DTC - see https://www.samarins.com/diagnose/freeze-frame.html for more info
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint16_t - Various vehicle information (https://www.samarins.com/diagnose/freeze-frame.html)
+*/
+uint16_t ELM327::freezeDTC()
+{
+    return (uint16_t)read(FREEZE_DTC);
+}
+
+/*
+ uint16_t ELM327::fuelSystemStatus()
+
+ Description:
+ ------------
+  * Freeze DTC - see https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_03 for more info
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint16_t - Bit encoded status (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_03)
+*/
+uint16_t ELM327::fuelSystemStatus()
+{
+    return (uint16_t)read(FUEL_SYSTEM_STATUS);
+}
+
+/*
+ float ELM327::engineLoad()
+
+ Description:
+ ------------
+  * Find the current engine load in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Engine load %
+*/
+float ELM327::engineLoad()
+{
+    return read(ENGINE_LOAD);
+}
+
+/*
+ float ELM327::engineCoolantTemp()
+
+ Description:
+ ------------
+  * Find the current engine coolant temp in C
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Engine load %
+*/
+float ELM327::engineCoolantTemp()
+{
+    return read(ENGINE_COOLANT_TEMP);
+}
+
+/*
+ float ELM327::shortTermFuelTrimBank_1()
+
+ Description:
+ ------------
+  * Find fuel trim %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Fuel trim %
+*/
+float ELM327::shortTermFuelTrimBank_1()
+{
+    return read(SHORT_TERM_FUEL_TRIM_BANK_1);
+}
+
+/*
+ float ELM327::longTermFuelTrimBank_1()
+
+ Description:
+ ------------
+  * Find fuel trim %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Fuel trim %
+*/
+float ELM327::longTermFuelTrimBank_1()
+{
+    return read(LONG_TERM_FUEL_TRIM_BANK_1);
+}
+
+/*
+ float ELM327::shortTermFuelTrimBank_2()
+
+ Description:
+ ------------
+  * Find fuel trim %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Fuel trim %
+*/
+float ELM327::shortTermFuelTrimBank_2()
+{
+    return read(SHORT_TERM_FUEL_TRIM_BANK_2);
+}
+
+/*
+ float ELM327::longTermFuelTrimBank_2()
+
+ Description:
+ ------------
+  * Find fuel trim %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Fuel trim %
+*/
+float ELM327::longTermFuelTrimBank_2()
+{
+    return read(LONG_TERM_FUEL_TRIM_BANK_2);
+}
+
+/*
+ float ELM327::fuelPressure()
+
+ Description:
+ ------------
+  * Find fuel pressure in kPa
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Fuel pressure in kPa
+*/
+float ELM327::fuelPressure()
+{
+    return read(FUEL_PRESSURE);
+}
+
+/*
+ uint8_t ELM327::manifoldPressure()
+
+ Description:
+ ------------
+  * Find intake manifold absolute pressure in kPa
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint8_t - Intake manifold absolute pressure in kPa
+*/
+uint8_t ELM327::manifoldPressure()
+{
+    return (uint8_t)read(INTAKE_MANIFOLD_ABS_PRESSURE);
+}
+
+/*
+ float ELM327::rpm()
+
+ Description:
+ ------------
+  * Queries and parses received message for/returns vehicle RMP data
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Vehicle RPM
+*/
+float ELM327::rpm()
+{
+    return read(ENGINE_RPM);
+}
+
+/*
+ int32_t ELM327::kph()
+
+ Description:
+ ------------
+  *  Queries and parses received message for/returns vehicle speed data (kph)
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * int32_t - Vehicle speed in kph
+*/
+int32_t ELM327::kph()
+{
+    return (int32_t)read(VEHICLE_SPEED);
+}
+
+/*
+ float ELM327::mph()
+
+ Description:
+ ------------
+  *  Queries and parses received message for/returns vehicle speed data (mph)
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Vehicle speed in mph
+*/
+float ELM327::mph()
+{
+    return kph() * KPH_MPH_CONVERT;
+}
+
+/*
+ float ELM327::timingAdvance()
+
+ Description:
+ ------------
+  *  Find timing advance in degrees before Top Dead Center (TDC)
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Timing advance in degrees before Top Dead Center (TDC)
+*/
+float ELM327::timingAdvance()
+{
+    return read(TIMING_ADVANCE);
+}
+
+/*
+ float ELM327::intakeAirTemp()
+
+ Description:
+ ------------
+  *  Find intake air temperature in C
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Intake air temperature in C
+*/
+float ELM327::intakeAirTemp()
+{
+    return read(INTAKE_AIR_TEMP);
+}
+
+/*
+ float ELM327::mafRate()
+
+ Description:
+ ------------
+  *  Find mass air flow sensor (MAF) air flow rate rate in g/s
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Mass air flow sensor (MAF) air flow rate rate in g/s
+*/
+float ELM327::mafRate()
+{
+    return read(MAF_FLOW_RATE);
+}
+
+/*
+ float ELM327::throttle()
+
+ Description:
+ ------------
+  *  Find throttle position in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Throttle position in %
+*/
+float ELM327::throttle()
+{
+    return read(THROTTLE_POSITION);
+}
+
+/*
+ uint8_t ELM327::commandedSecAirStatus()
+
+ Description:
+ ------------
+  *  Find commanded secondary air status
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint8_t - Bit encoded status (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_12)
+*/
+uint8_t ELM327::commandedSecAirStatus()
+{
+    return (uint8_t)read(COMMANDED_SECONDARY_AIR_STATUS);
+}
+
+/*
+ uint8_t ELM327::oxygenSensorsPresent_2banks()
+
+ Description:
+ ------------
+  *  Find which oxygen sensors are present ([A0..A3] == Bank 1, Sensors 1-4. [A4..A7] == Bank 2...)
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint8_t - Bit encoded
+*/
+uint8_t ELM327::oxygenSensorsPresent_2banks()
+{
+    return (uint8_t)read(OXYGEN_SENSORS_PRESENT_2_BANKS);
+}
+
+/*
+ uint8_t ELM327::obdStandards()
+
+ Description:
+ ------------
+  *  Find the OBD standards this vehicle conforms to (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_1C)
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint8_t - Bit encoded (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_1C)
+*/
+uint8_t ELM327::obdStandards()
+{
+    return (uint8_t)read(OBD_STANDARDS);
+}
+
+/*
+ uint8_t ELM327::oxygenSensorsPresent_4banks()
+
+ Description:
+ ------------
+  *  Find which oxygen sensors are present (Similar to PID 13, but [A0..A7] == [B1S1, B1S2, B2S1, B2S2, B3S1, B3S2, B4S1, B4S2])
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint8_t - Bit encoded
+*/
+uint8_t ELM327::oxygenSensorsPresent_4banks()
+{
+    return (uint8_t)read(OXYGEN_SENSORS_PRESENT_4_BANKS);
+}
+
+/*
+ bool ELM327::auxInputStatus()
+
+ Description:
+ ------------
+  *  Find Power Take Off (PTO) status
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * bool - Power Take Off (PTO) status
+*/
+bool ELM327::auxInputStatus()
+{
+    return (bool)read(AUX_INPUT_STATUS);
+}
+
+/*
+ uint16_t ELM327::runTime()
+
+ Description:
+ ------------
+  *  Find run time since engine start in s
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint16_t - Run time since engine start in s
+*/
+uint16_t ELM327::runTime()
+{
+    return (uint16_t)read(RUN_TIME_SINCE_ENGINE_START);
+}
+
+/*
+ uint32_t ELM327::supportedPIDs_21_40()
+
+ Description:
+ ------------
+  * Determine which of PIDs 0x1 through 0x20 are supported (bit encoded)
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint32_t - Bit encoded booleans of supported PIDs 0x21-0x20
+*/
+uint32_t ELM327::supportedPIDs_21_40()
+{
+    return (uint32_t)read(SUPPORTED_PIDS_21_40);
+}
+
+/*
+ uint16_t ELM327::distTravelWithMIL()
+
+ Description:
+ ------------
+  *  Find distance traveled with malfunction indicator lamp (MIL) on in km
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint16_t - Distance traveled with malfunction indicator lamp (MIL) on in km
+*/
+uint16_t ELM327::distTravelWithMIL()
+{
+    return (uint16_t)read(DISTANCE_TRAVELED_WITH_MIL_ON);
+}
+
+/*
+ float ELM327::fuelRailPressure()
+
+ Description:
+ ------------
+  *  Find fuel Rail Pressure (relative to manifold vacuum) in kPa
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Fuel Rail Pressure (relative to manifold vacuum) in kPa
+*/
+float ELM327::fuelRailPressure()
+{
+    return read(FUEL_RAIL_PRESSURE);
+}
+
+/*
+ float ELM327::fuelRailGuagePressure()
+
+ Description:
+ ------------
+  *  Find fuel Rail Gauge Pressure (diesel, or gasoline direct injection) in kPa
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Fuel Rail Gauge Pressure (diesel, or gasoline direct injection) in kPa
+*/
+float ELM327::fuelRailGuagePressure()
+{
+    return read(FUEL_RAIL_GUAGE_PRESSURE);
+}
+
+/*
+ float ELM327::commandedEGR()
+
+ Description:
+ ------------
+  *  Find commanded Exhaust Gas Recirculation (EGR) in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Commanded Exhaust Gas Recirculation (EGR) in %
+*/
+float ELM327::commandedEGR()
+{
+    return read(COMMANDED_EGR);
+}
+
+/*
+ float ELM327::egrError()
+
+ Description:
+ ------------
+  *  Find Exhaust Gas Recirculation (EGR) error in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Exhaust Gas Recirculation (EGR) error in %
+*/
+float ELM327::egrError()
+{
+    return read(EGR_ERROR);
+}
+
+/*
+ float ELM327::commandedEvapPurge()
+
+ Description:
+ ------------
+  *  Find commanded evaporative purge in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Commanded evaporative purge in %
+*/
+float ELM327::commandedEvapPurge()
+{
+    return read(COMMANDED_EVAPORATIVE_PURGE);
+}
+
+/*
+ float ELM327::fuelLevel()
+
+ Description:
+ ------------
+  *  Find fuel tank level input in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Fuel tank level input in %
+*/
+float ELM327::fuelLevel()
+{
+    return read(FUEL_TANK_LEVEL_INPUT);
+}
+
+/*
+ uint8_t ELM327::warmUpsSinceCodesCleared()
+
+ Description:
+ ------------
+  *  Find num warm-ups since codes cleared
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint8_t - Num warm-ups since codes cleared
+*/
+uint8_t ELM327::warmUpsSinceCodesCleared()
+{
+    return (uint8_t)read(WARM_UPS_SINCE_CODES_CLEARED);
+}
+
+/*
+ uint16_t ELM327::distSinceCodesCleared()
+
+ Description:
+ ------------
+  *  Find distance traveled since codes cleared in km
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint16_t - Distance traveled since codes cleared in km
+*/
+uint16_t ELM327::distSinceCodesCleared()
+{
+    return (uint16_t)read(DIST_TRAV_SINCE_CODES_CLEARED);
+}
+
+/*
+ float ELM327::evapSysVapPressure()
+
+ Description:
+ ------------
+  *  Find evap. system vapor pressure in Pa
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Evap. system vapor pressure in Pa
+*/
+float ELM327::evapSysVapPressure()
+{
+    return read(EVAP_SYSTEM_VAPOR_PRESSURE);
+}
+
+/*
+ uint8_t ELM327::absBaroPressure()
+
+ Description:
+ ------------
+  *  Find absolute barometric pressure in kPa
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint8_t - Absolute barometric pressure in kPa
+*/
+uint8_t ELM327::absBaroPressure()
+{
+    return (uint8_t)read(ABS_BAROMETRIC_PRESSURE);
+}
+
+/*
+ float ELM327::catTempB1S1()
+
+ Description:
+ ------------
+  *  Find catalyst temperature in C
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Catalyst temperature in C
+*/
+float ELM327::catTempB1S1()
+{
+    return read(CATALYST_TEMP_BANK_1_SENSOR_1);
+}
+
+/*
+ float ELM327::catTempB2S1()
+
+ Description:
+ ------------
+  *  Find catalyst temperature in C
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Catalyst temperature in C
+*/
+float ELM327::catTempB2S1()
+{
+    return read(CATALYST_TEMP_BANK_2_SENSOR_1);
+}
+
+/*
+ float ELM327::catTempB1S2()
+
+ Description:
+ ------------
+  *  Find catalyst temperature in C
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Catalyst temperature in C
+*/
+float ELM327::catTempB1S2()
+{
+    return read(CATALYST_TEMP_BANK_1_SENSOR_2);
+}
+
+/*
+ float ELM327::catTempB2S2()
+
+ Description:
+ ------------
+  *  Find catalyst temperature in C
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Catalyst temperature in C
+*/
+float ELM327::catTempB2S2()
+{
+    return read(CATALYST_TEMP_BANK_2_SENSOR_2);
+}
+
+/*
+ uint32_t ELM327::supportedPIDs_41_60()
+
+ Description:
+ ------------
+  * Determine which of PIDs 0x41 through 0x60 are supported (bit encoded)
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint32_t - Bit encoded booleans of supported PIDs 0x41-0x60
+*/
+uint32_t ELM327::supportedPIDs_41_60()
+{
+    return (uint32_t)read(SUPPORTED_PIDS_41_60);
+}
+
+/*
+ uint32_t ELM327::monitorDriveCycleStatus()
+
+ Description:
+ ------------
+  *  Find status this drive cycle (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_41)
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint32_t - Bit encoded status (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_41)
+*/
+uint32_t ELM327::monitorDriveCycleStatus()
+{
+    return (uint32_t)read(MONITOR_STATUS_THIS_DRIVE_CYCLE);
+}
+
+/*
+ float ELM327::ctrlModVoltage()
+
+ Description:
+ ------------
+  *  Find control module voltage in V
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Control module voltage in V
+*/
+float ELM327::ctrlModVoltage()
+{
+    return read(CONTROL_MODULE_VOLTAGE);
+}
+
+/*
+ float ELM327::absLoad()
+
+ Description:
+ ------------
+  *  Find absolute load value in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Absolute load value in %
+*/
+float ELM327::absLoad()
+{
+    return read(ABS_LOAD_VALUE);
+}
+
+/*
+ float ELM327::commandedAirFuelRatio()
+
+ Description:
+ ------------
+  *  Find commanded air-fuel equivalence ratio
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Commanded air-fuel equivalence ratio
+*/
+float ELM327::commandedAirFuelRatio()
+{
+    return read(FUEL_AIR_COMMANDED_EQUIV_RATIO);
+}
+
+/*
+ float ELM327::relativeThrottle()
+
+ Description:
+ ------------
+  *  Find relative throttle position in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Relative throttle position in %
+*/
+float ELM327::relativeThrottle()
+{
+    return read(RELATIVE_THROTTLE_POSITION);
+}
+
+/*
+ float ELM327::ambientAirTemp()
+
+ Description:
+ ------------
+  *  Find ambient air temperature in C
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Ambient air temperature in C
+*/
+float ELM327::ambientAirTemp()
+{
+    return read(AMBIENT_AIR_TEMP);
+}
+
+/*
+ float ELM327::absThrottlePosB()
+
+ Description:
+ ------------
+  *  Find absolute throttle position B in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Absolute throttle position B in %
+*/
+float ELM327::absThrottlePosB()
+{
+    return read(ABS_THROTTLE_POSITION_B);
+}
+
+/*
+ float ELM327::absThrottlePosC()
+
+ Description:
+ ------------
+  *  Find absolute throttle position C in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Absolute throttle position C in %
+*/
+float ELM327::absThrottlePosC()
+{
+    return read(ABS_THROTTLE_POSITION_C);
+}
+
+/*
+ float ELM327::absThrottlePosD()
+
+ Description:
+ ------------
+  *  Find absolute throttle position D in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Absolute throttle position D in %
+*/
+float ELM327::absThrottlePosD()
+{
+    return read(ABS_THROTTLE_POSITION_D);
+}
+
+/*
+ float ELM327::absThrottlePosE()
+
+ Description:
+ ------------
+  *  Find absolute throttle position E in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Absolute throttle position E in %
+*/
+float ELM327::absThrottlePosE()
+{
+    return read(ABS_THROTTLE_POSITION_E);
+}
+
+/*
+ float ELM327::absThrottlePosF()
+
+ Description:
+ ------------
+  *  Find absolute throttle position F in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Absolute throttle position F in %
+*/
+float ELM327::absThrottlePosF()
+{
+    return read(ABS_THROTTLE_POSITION_F);
+}
+
+/*
+ float ELM327::commandedThrottleActuator()
+
+ Description:
+ ------------
+  *  Find commanded throttle actuator in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Commanded throttle actuator in %
+*/
+float ELM327::commandedThrottleActuator()
+{
+    return read(COMMANDED_THROTTLE_ACTUATOR);
+}
+
+/*
+ uint16_t ELM327::timeRunWithMIL()
+
+ Description:
+ ------------
+  *  Find time run with MIL on in min
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint16_t - Time run with MIL on in min
+*/
+uint16_t ELM327::timeRunWithMIL()
+{
+    return (uint16_t)read(TIME_RUN_WITH_MIL_ON);
+}
+
+/*
+ uint16_t ELM327::timeSinceCodesCleared()
+
+ Description:
+ ------------
+  *  Find time since trouble codes cleared in min
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint16_t - Time since trouble codes cleared in min
+*/
+uint16_t ELM327::timeSinceCodesCleared()
+{
+    return (uint16_t)read(TIME_SINCE_CODES_CLEARED);
+}
+
+/*
+ float ELM327::maxMafRate()
+
+ Description:
+ ------------
+  *  Find maximum value for air flow rate from mass air flow sensor in g/s
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Maximum value for air flow rate from mass air flow sensor in g/s
+*/
+float ELM327::maxMafRate()
+{
+    return read(MAX_MAF_RATE);
+}
+
+/*
+ uint8_t ELM327::fuelType()
+
+ Description:
+ ------------
+  *  Find fuel type (https://en.wikipedia.org/wiki/OBD-II_PIDs#Fuel_Type_Coding)
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint8_t - Bit encoded (https://en.wikipedia.org/wiki/OBD-II_PIDs#Fuel_Type_Coding)
+*/
+uint8_t ELM327::fuelType()
+{
+    return (uint8_t)read(FUEL_TYPE);
+}
+
+/*
+ float ELM327::ethanolPercent()
+
+ Description:
+ ------------
+  *  Find ethanol fuel in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Ethanol fuel in %
+*/
+float ELM327::ethanolPercent()
+{
+    return read(ETHANOL_FUEL_PERCENT);
+}
+
+/*
+ float ELM327::absEvapSysVapPressure()
+
+ Description:
+ ------------
+  *  Find absolute evap. system vapor pressure in kPa
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Absolute evap. system vapor pressure in kPa
+*/
+float ELM327::absEvapSysVapPressure()
+{
+    return read(ABS_EVAP_SYS_VAPOR_PRESSURE);
+}
+
+/*
+ float ELM327::evapSysVapPressure2()
+
+ Description:
+ ------------
+  *  Find evap. system vapor pressure in Pa
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Evap. system vapor pressure in Pa
+*/
+float ELM327::evapSysVapPressure2()
+{
+    return read(EVAP_SYS_VAPOR_PRESSURE);
+}
+
+/*
+ float ELM327::absFuelRailPressure()
+
+ Description:
+ ------------
+  *  Find absolute fuel rail pressure in kPa
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - absolute fuel rail pressure in kPa
+*/
+float ELM327::absFuelRailPressure()
+{
+    return read(FUEL_RAIL_ABS_PRESSURE);
+}
+
+/*
+ float ELM327::relativePedalPos()
+
+ Description:
+ ------------
+  *  Find relative accelerator pedal position in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Relative accelerator pedal position in %
+*/
+float ELM327::relativePedalPos()
+{
+    return read(RELATIVE_ACCELERATOR_PEDAL_POS);
+}
+
+/*
+ float ELM327::hybridBatLife()
+
+ Description:
+ ------------
+  *  Find hybrid battery pack remaining life in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Hybrid battery pack remaining life in %
+*/
+float ELM327::hybridBatLife()
+{
+    return read(HYBRID_BATTERY_REMAINING_LIFE);
+}
+
+/*
+ float ELM327::oilTemp()
+
+ Description:
+ ------------
+  *  Find engine oil temperature in C
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Engine oil temperature in C
+*/
+float ELM327::oilTemp()
+{
+    return read(ENGINE_OIL_TEMP);
+}
+
+/*
+ float ELM327::fuelInjectTiming()
+
+ Description:
+ ------------
+  *  Find fuel injection timing in degrees
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Fuel injection timing in degrees
+*/
+float ELM327::fuelInjectTiming()
+{
+    return read(FUEL_INJECTION_TIMING);
+}
+
+/*
+ float ELM327::fuelRate()
+
+ Description:
+ ------------
+  *  Find engine fuel rate in L/h
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Engine fuel rate in L/h
+*/
+float ELM327::fuelRate()
+{
+    return read(ENGINE_FUEL_RATE);
+}
+
+/*
+ uint8_t ELM327::emissionRqmts()
+
+ Description:
+ ------------
+  *  Find emission requirements to which vehicle is designed
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint8_t - Bit encoded (?)
+*/
+uint8_t ELM327::emissionRqmts()
+{
+    return (uint8_t)read(EMISSION_REQUIREMENTS);
+}
+
+/*
+ uint32_t ELM327::supportedPIDs_61_80()
+
+ Description:
+ ------------
+  * Determine which of PIDs 0x61 through 0x80 are supported (bit encoded)
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint32_t - Bit encoded booleans of supported PIDs 0x61-0x80
+*/
+uint32_t ELM327::supportedPIDs_61_80()
+{
+    return (uint32_t)read(SUPPORTED_PIDS_61_80);
+}
+
+/*
+ float ELM327::demandedTorque()
+
+ Description:
+ ------------
+  *  Find driver's demanded engine torque in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Driver's demanded engine torque in %
+*/
+float ELM327::demandedTorque()
+{
+    return read(DEMANDED_ENGINE_PERCENT_TORQUE);
+}
+
+/*
+ float ELM327::torque()
+
+ Description:
+ ------------
+  *  Find actual engine torque in %
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * float - Actual engine torque in %
+*/
+float ELM327::torque()
+{
+    return read(ACTUAL_ENGINE_TORQUE);
+}
+
+/*
+ uint16_t ELM327::referenceTorque()
+
+ Description:
+ ------------
+  *  Find engine reference torque in Nm
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint16_t - Engine reference torque in Nm
+*/
+uint16_t ELM327::referenceTorque()
+{
+    return read(ENGINE_REFERENCE_TORQUE);
+}
+
+/*
+ uint16_t ELM327::auxSupported()
+
+ Description:
+ ------------
+  *  Find auxiliary input/output supported
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * uint16_t - Bit encoded (?)
+*/
+uint16_t ELM327::auxSupported()
+{
+    return (uint16_t)read(AUX_INPUT_OUTPUT_SUPPORTED);
+}
+
+/*
+ void ELM327::sendCommand(const char *cmd)
+
+ Description:
+ ------------
+  * Sends a command/query for Non-Blocking PID queries
+
+ Inputs:
+ -------
+  * const char *cmd - Command/query to send to ELM327
+
+ Return:
+ -------
+  * void
+*/
+void ELM327::sendCommand(const char *cmd)
+{
+    // The ELM327 only takes commands again once the monitor is stopped
+    if (monitoring)
+        stopMonitor();
+
+    // Back-to-back identical OBD queries only need a CR - the ELM327 repeats the last command
+    bool repeat = repeatQueries && lastCommandDone && (lastCommand[0] != '\0') && !strcmp(cmd, lastCommand);
+
+    // clear payload buffer
+    payload[0] = '\0';
+
+    // reset input serial buffer and number of received bytes
+    recBytes  = 0;
+    hintIndex = -1;
+    flushInputBuff();
+    connected = false;
+
+    // Reset the receive state ready to start receiving a response message
+    nb_rx_state = ELM_GETTING_MSG;
+
+    if (debugMode)
+    {
+        Serial.print(F("Sending the following command/query: "));
+        Serial.print(cmd);
+
+        if (repeat)
+            Serial.print(F(" (repeat)"));
+
+        Serial.println();
+    }
+
+    // Queries ("<service><pid>...") are tracked per service/PID in Metrics
+    if (isxdigit(cmd[0]) && isxdigit(cmd[1]))
+    {
+        metricsService = (ctoi(toupper(cmd[0])) << 4) | ctoi(toupper(cmd[1]));
+        metricsPid     = (isxdigit(cmd[2]) && isxdigit(cmd[3])) ? ((ctoi(toupper(cmd[2])) << 4) | ctoi(toupper(cmd[3]))) : 0;
+    }
+    else
+        metricsService = -1;
+
+    // Prepare the streaming parser: the echo to drop (as filtered by streamChar()) and,
+    // for PID queries, the response header to decode the data after
+    memset(&stream, 0, sizeof(stream));
+
+    for (uint8_t i = 0; cmd[i] != '\0'; i++)
+    {
+        if (!isalnum(cmd[i]) && (cmd[i] != '.'))
+            continue;
+
+        if (stream.echoLen >= (ECHO_CMD_LEN - 1))
+        {
+            stream.echoLen = 0; // Too long to check, leave the echo in payload
+            break;
+        }
+
+        echoCmd[stream.echoLen++] = cmd[i];
+    }
+
+    if (cmd == query)
+        stream.headerLen = formatResponseHeader(expectedHeader);
+
+    // With headers on, each line of an OBD response starts with the CAN ID of its ECU
+    if (ecuDemux && (metricsService >= 0))
+    {
+        stream.idChars = ((activeProtocol == ISO_15765_29_BIT_500_KBAUD) || (activeProtocol == ISO_15765_29_BIT_250_KBAUD)) ? 8 : 3;
+        ECU_Responses.numECUs = 0;
+    }
+
+    // A repeated command isn't echoed
+    if (repeat)
+        stream.echoLen = 0;
+
+    // Latencies include sending the command - printing blocks while the serial TX buffer is full
+    queryStart_us = micros();
+
+    if (repeat)
+        elm_port->write('\r');
+    else
+    {
+        size_t len = strlen(cmd);
+
+        // The command and its CR in a single write, unless it's too long
+        if (len < (LAST_COMMAND_LEN - 1))
+        {
+            memcpy(lastCommand, cmd, len);
+            lastCommand[len] = '\r';
+            elm_port->write((const uint8_t*)lastCommand, len + 1);
+            lastCommand[len] = '\0';
+        }
+        else
+        {
+            elm_port->print(cmd);
+            elm_port->print('\r');
+            lastCommand[0] = '\0';
+        }
+
+        // Only OBD commands are repeated - an AT command leaves nothing to repeat
+        if ((toupper(cmd[0]) == 'A') && (toupper(cmd[1]) == 'T'))
+            lastCommand[0] = '\0';
+    }
+
+    lastCommandDone = false;
+
+    // prime the timeout timer
+    previousTime = millis();
+    currentTime = previousTime;
+
+    queryInFlight = true;
+    firstByteRxd  = false;
+}
+
+/*
+ obd_rx_states ELM327::sendCommand_Blocking(const char* cmd)
+
+ Description:
+ ------------
+    * Sends a command/query and waits for a respoonse (blocking function)
+    Sometimes it's desirable to use a blocking command, e.g when sending an AT command.
+    This function removes the need for the caller to set up a loop waiting for the command to finish.
+    Caller is free to parse the payload string if they need to use the response.
+
+ Inputs:
+ -------
+  * const char *cmd - Command/query to send to ELM327
+
+ Return:
+ -------
+  * int8_t - the ELM_XXX status of getting the OBD response
+*/
+int8_t ELM327::sendCommand_Blocking(const char *cmd)
+{
+    // Blocking anyway, so backed off timing is applied right away - see applyBackoff()
+    if (Timing.backoffPending && (Timing.backoffStep == 0) && strncmp(cmd, "AT", 2))
+    {
+        Timing.backoffPending = false;
+        setTiming(Timing.dataTimeout, Timing.adaptiveTiming);
+    }
+
+    sendCommand(cmd);
+    uint32_t startTime = millis();
+    while (get_response() == ELM_GETTING_MSG) {
+        if (millis() - startTime > timeout_ms) break;
+    }
+    return nb_rx_state;
+}
+
+/*
+ obd_rx_states ELM327::get_response(void)
+
+ Description:
+ ------------
+  * Non Blocking (NB) receive OBD scanner response. Must be called repeatedly until
+    the status progresses past ELM_GETTING_MSG.
+
+  * If "bulkReceive" is true (default) and debug mode is off, all chars currently
+    buffered by the serial port are processed in one call. Otherwise, only a single
+    char is processed per call.
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * int8_t - the ELM_XXX status of getting the OBD response
+*/
+int8_t ELM327::get_response(void)
+{
+    int8_t state = receiveResponse();
+
+    if (queryInFlight && (state != ELM_GETTING_MSG))
+    {
+        watchTiming(state);
+        recordMetrics(state);
+    }
+
+    if ((hintIndex >= 0) && (state != ELM_GETTING_MSG))
+        updateResponseHint(state);
+
+    return state;
+}
+
+/*
+ int8_t ELM327::receiveResponse()
+
+ Description:
+ ------------
+  * Does the actual receiving and checking of the response - see get_response()
+
+ Inputs:
+ -------
+  * void
+
+ Return:
+ -------
+  * int8_t - the ELM_XXX status of getting the OBD response
+*/
+int8_t ELM327::receiveResponse()
+{
+    // buffer the response of the ELM327 until either the
+    // end marker is read or a timeout has occurred
+    // last valid idx is PAYLOAD_LEN but want to keep one free for terminating '\0'
+    // so limit counter to < PAYLOAD_LEN
+    if (!firstByteRxd && elm_port->available())
+    {
+        firstByte_us = micros();
+        firstByteRxd = true;
+    }
+
+    if (!elm_port->available())
+    {
+        nb_rx_state = ELM_GETTING_MSG;
+        if (timeout())
+            nb_rx_state = ELM_TIMEOUT;
+    }
+    else if (bulkReceive && !debugMode)
+    {
+        // Drain everything the port has buffered in a single call. The loop
+        // only looks for the prompt and parses chars - no timeout or debug checks
+        nb_rx_state = ELM_GETTING_MSG;
+
+        while (elm_port->available())
+        {
+            char recChar = elm_port->read();
+
+            if (recChar == '>')
+            {
+                nb_rx_state     = ELM_MSG_RXD;
+                lastCommandDone = true;
+                break;
+            }
+
+            if (!streamChar(recChar))
+            {
+                nb_rx_state = ELM_BUFFER_OVERFLOW;
+                break;
+            }
+        }
+    }
+    else
+    {
+        char recChar = elm_port->read();
+
+        if (debugMode)
+        {
+            Serial.print(F("\tReceived char: "));
+            // display each received character, make non-printables printable
+            if (recChar == '\f')
+                Serial.println(F("\\f"));
+            else if (recChar == '\n')
+                Serial.println(F("\\n"));
+            else if (recChar == '\r')
+                Serial.println(F("\\r"));
+            else if (recChar == '\t')
+                Serial.println(F("\\t"));
+            else if (recChar == '\v')
+                Serial.println(F("\\v"));
+            // convert spaces to underscore, easier to see in debug output
+            else if (recChar == ' ')
+                Serial.println(F("_"));
+            // display regular printable
+            else
+                Serial.println(recChar);
+        }
+
+        // this is the end of the OBD response
+        if (recChar == '>')
+        {
+            if (debugMode)
+                Serial.println(F("Delimiter found."));
+
+            nb_rx_state     = ELM_MSG_RXD;
+            lastCommandDone = true;
+        }
+        else if (streamChar(recChar))
+            nb_rx_state = ELM_GETTING_MSG;
+        else
+            nb_rx_state = ELM_BUFFER_OVERFLOW;
+    }
+
+    // Message is still being received (or is timing out), so exit early without doing all the other checks
+    if (nb_rx_state == ELM_GETTING_MSG)
+        return nb_rx_state;
+
+    // End of response delimiter was found
+    if (debugMode && nb_rx_state == ELM_MSG_RXD)
+    {
+        Serial.print(F("All chars received: "));
+        Serial.println(payload);
+    }
+
+    if (nb_rx_state == ELM_TIMEOUT)
+    {
+        if (debugMode)
+        {
+            Serial.print(F("Timeout detected with overflow of "));
+            Serial.print((currentTime - previousTime) - timeout_ms);
+            Serial.println(F("ms"));
+        }
+        return nb_rx_state;
+    }
+
+    if (nb_rx_state == ELM_BUFFER_OVERFLOW)
+    {
+        if (debugMode)
+        {
+            Serial.print(F("OBD receive buffer overflow (> "));
+            Serial.print(PAYLOAD_LEN);
+            Serial.println(F(" bytes)"));
+        }
+        return nb_rx_state;
+    }
+
+    // Now we have successfully received OBD response, check if the parser found any OBD errors
+    if (stream.keywordsFound & KEYWORD_UNABLE_TO_CONNECT)
+    {
+        if (debugMode)
+            Serial.println(F("ELM responded with error \"UNABLE TO CONNECT\""));
+
+        nb_rx_state = ELM_UNABLE_TO_CONNECT;
+        return nb_rx_state;
+    }
+
+    connected = true;
+
+    if (stream.keywordsFound & KEYWORD_NO_DATA)
+    {
+        if (debugMode)
+            Serial.println(F("ELM responded with error \"NO DATA\""));
+
+        nb_rx_state = ELM_NO_DATA;
+        return nb_rx_state;
+    }
+
+    if (stream.keywordsFound & KEYWORD_STOPPED)
+    {
+        if (debugMode)
+            Serial.println(F("ELM responded with error \"STOPPED\""));
+
+        nb_rx_state = ELM_STOPPED;
+        return nb_rx_state;
+    }
+
+    if (stream.keywordsFound & KEYWORD_ERROR)
+    {
+        if (debugMode)
+            Serial.println(F("ELM responded with \"ERROR\""));
+
+        nb_rx_state = ELM_GENERAL_ERROR;
+        return nb_rx_state;
+    }
+
+    // Multiline responses were reassembled while they arrived
+    if (stream.frameError)
+        nb_rx_state = ELM_GARBAGE;
+    else
+        nb_rx_state = ELM_SUCCESS;
+
+    return nb_rx_state;
+}
+
+/*
+ bool ELM327::streamChar(const char& recChar)
+
+ Description:
+ ------------
+  * Streaming parser - processes one received char so the response is fully checked and
+    decoded the moment the prompt arrives, without any further passes over payload:
+      - Drops the chars that aren't needed for parsing (spaces, '\n', ...) and the line
+        ends, so payload holds the lines back to back
+      - Drops the echo of the command (if echo is on)
+      - Recognizes the UNABLE TO CONNECT, NO DATA, STOPPED and ERROR keywords
+      - Reassembles multiline (ISO-TP) responses in place: the length line and the "N:"
+        frame indices are dropped and the frame sequence is validated
+      - Finds the expected response header of a PID query and decodes the data bytes
+        into responseData as they arrive - see finishStreamDecode()
+      - With headers on, strips the CAN ID and PCI of each frame and records the response
+        of each ECU - see demuxChar()
+
+ Inputs:
+ -------
+  * const char& recChar - Received char (not the '>' prompt)
+
+ Return:
+ -------
+  * bool - false if payload is full
+*/
+bool ELM327::streamChar(const char& recChar)
+{
+    // A complete multiline response - everything after it is ignored
+    bool complete = stream.multiLine && stream.totalChars && (recBytes >= stream.totalChars);
+
+    // End of line
+    if (recChar == '\r')
+    {
+        memset(stream.keywordMatch, 0, sizeof(stream.keywordMatch));
+
+        if (complete)
+            return true;
+
+        if (stream.idChars)
+        {
+            recordECUResponse();
+
+            stream.linePos   = 0;
+            stream.prefixLen = 0;
+            stream.linePlain = false;
+        }
+
+        uint16_t lineLen = recBytes - stream.lineStart;
+
+        if ((stream.numLines == 0) && (stream.echoLen > 0) && (lineLen == stream.echoLen) &&
+            !memcmp(payload + stream.lineStart, echoCmd, lineLen))
+            streamRewind(stream.lineStart); // Echo of the command
+        else if (stream.multiLine && !stream.lineIsFrame)
+            streamRewind(stream.lineStart); // Only frames carry data in a multiline response
+
+        stream.prevLineStart = stream.lineStart;
+        stream.prevLineLen   = recBytes - stream.lineStart;
+        stream.lineStart     = recBytes;
+        stream.lineIsFrame   = false;
+        stream.lineHasHeader = false;
+        stream.numLines++;
+        return true;
+    }
+
+    // Frame index of a multiline response - the chars since the start of the line
+    if (recChar == ':')
+    {
+        if (complete)
+            return true;
+
+        uint16_t labelLen = recBytes - stream.lineStart;
+
+        // Frame indices are a single hex digit that wraps after F
+        if ((labelLen != 1) || !isxdigit(payload[stream.lineStart]) || (ctoi(payload[stream.lineStart]) != (stream.nextFrame & 0xF)))
+        {
+            if (debugMode && !stream.frameError)
+            {
+                Serial.print(F("Multiline response frame out of sequence, expected "));
+                Serial.println(stream.nextFrame & 0xF, HEX);
+            }
+
+            stream.frameError = true;
+        }
+
+        if (!stream.multiLine)
+        {
+            // The line before the first frame holds the total data length (1 to 3 hex chars).
+            // Only the frame data is kept - the lines before it are dropped
+            stream.multiLine  = true;
+            stream.totalChars = 0;
+
+            if ((stream.numLines > 0) && (stream.prevLineLen > 0) && (stream.prevLineLen <= 3))
+                for (uint8_t i = 0; (i < stream.prevLineLen) && isxdigit(payload[stream.prevLineStart + i]); i++)
+                    stream.totalChars = (stream.totalChars << 4) | ctoi(payload[stream.prevLineStart + i]);
+
+            stream.totalChars *= 2;
+            stream.lineStart   = 0;
+
+            if (debugMode)
+            {
+                Serial.print(F("totalChars = "));
+                Serial.println(stream.totalChars);
+            }
+        }
+
+        stream.nextFrame++;
+        stream.lineIsFrame = true;
+        streamRewind(stream.lineStart);
+        return true;
+    }
+
+    // Keep only alphanumeric and decimal chars. These are needed for response parsing
+    // decimal places needed to extract floating point numbers, e.g. battery voltage
+    if (!isalnum(recChar) && (recChar != '.'))
+        return true;
+
+    // Error keywords - none of them repeats its first char, so a simple match
+    // counter per keyword is enough
+    for (uint8_t i = 0; i < NUM_STREAM_KEYWORDS; i++)
+    {
+        const char* keyword = STREAM_KEYWORDS[i];
+        uint8_t&    match   = stream.keywordMatch[i];
+
+        if (keyword[match] == recChar)
+            match++;
+        else
+            match = (keyword[0] == recChar) ? 1 : 0;
+
+        if (keyword[match] == '\0')
+        {
+            stream.keywordsFound |= (1 << i);
+            match = 0;
+        }
+    }
+
+    // Data beyond the declared length of a multiline response is dropped
+    if (complete)
+        return true;
+
+    if (stream.idChars && demuxChar(recChar))
+        return true;
+
+    return streamStore(recChar);
 }
 
 /*
- float ELM327::fuelRailGuagePressure()
+ bool ELM327::streamStore(const char& recChar)
 
  Description:
  ------------
-  *  Find fuel Rail Gauge Pressure (diesel, or gasoline direct injection) in kPa
+  * Appends a char of response data to payload, then matches the expected response
+    header and decodes the data after it - see streamChar(). Further responses (of
+    other ECUs or repeated by the ELM327) only count at the position in their line where
+    the first response started (the start of the line, or the end of the CAN ID and PCI
+    with headers on but not demultiplexed), so data that happens to contain the header
+    bytes isn't mistaken for one
 
  Inputs:
  -------
-  * void
+  * const char& recChar - Alphanumeric char or '.'
 
  Return:
  -------
-  * float - Fuel Rail Gauge Pressure (diesel, or gasoline direct injection) in kPa
+  * bool - false if payload is full
 */
-float ELM327::fuelRailGuagePressure()
+bool ELM327::streamStore(const char& recChar)
 {
-    return processPID(SERVICE_01, FUEL_RAIL_GUAGE_PRESSURE, 1, 2, 10.0);
-}
+    if (recBytes >= PAYLOAD_LEN)
+        return false;
 
-/*
- float ELM327::commandedEGR()
+    payload[recBytes++] = recChar;
+    payload[recBytes]   = '\0';
 
- Description:
- ------------
-  *  Find commanded Exhaust Gas Recirculation (EGR) in %
+    // Response header and data of a PID query
+    uint8_t headerLen = stream.headerLen;
 
- Inputs:
- -------
-  * void
+    if (!headerLen)
+        return true;
 
- Return:
- -------
-  * float - Commanded Exhaust Gas Recirculation (EGR) in %
-*/
-float ELM327::commandedEGR()
-{
-    return processPID(SERVICE_01, COMMANDED_EGR, 1, 1, 100.0 / 255.0);
-}
+    uint16_t headerStart = recBytes - headerLen;
+    bool     headerMatch = ((recBytes - stream.lineStart) >= headerLen) && !memcmp(payload + headerStart, expectedHeader, headerLen);
 
-/*
- float ELM327::egrError()
+    // Each ECU answers on its own line - see updateResponseHint(). The consecutive frames of
+    // a multiline response carry data only
+    bool newResponse = headerMatch && !stream.lineHasHeader &&
+                       (!stream.multiLine || (stream.nextFrame <= 1)) &&
+                       (!stream.firstDatum || ((headerStart - stream.lineStart) == stream.headerOffset));
 
- Description:
- ------------
-  *  Find Exhaust Gas Recirculation (EGR) error in %
+    if (newResponse)
+    {
+        stream.lineHasHeader = true;
+        stream.numResponses++;
+    }
 
- Inputs:
- -------
-  * void
+    if (stream.dataEnd)
+        return true;
 
- Return:
- -------
-  * float - Exhaust Gas Recirculation (EGR) error in %
-*/
-float ELM327::egrError()
-{
-    return processPID(SERVICE_01, EGR_ERROR, 1, 1, 100.0 / 128.0, -100);
+    if (!stream.firstDatum)
+    {
+        if (newResponse)
+        {
+            stream.firstDatum   = recBytes;
+            stream.headerOffset = headerStart - stream.lineStart;
+        }
+    }
+    else if (newResponse)
+    {
+        // Some ELM327s respond with two "responses" per query - the data ends at the second one
+        stream.dataEnd = headerStart;
+    }
+    else if (!stream.decodeStopped && !((recBytes - stream.firstDatum) & 0x1))
+    {
+        uint8_t msn = pgm_read_byte(&HEX_DIGIT_VALUES[(uint8_t)payload[recBytes - 2]]);
+        uint8_t lsn = pgm_read_byte(&HEX_DIGIT_VALUES[(uint8_t)payload[recBytes - 1]]);
+
+        if (((msn | lsn) & 0xF0) || (stream.decodedBytes >= (PAYLOAD_LEN / 2)))
+            stream.decodeStopped = true;
+        else
+            responseData[stream.decodedBytes++] = (msn << 4) | lsn;
+    }
+
+    return true;
 }
 
 /*
- float ELM327::commandedEvapPurge()
+ void ELM327::streamRewind(const uint16_t& length)
 
  Description:
  ------------
-  *  Find commanded evaporative purge in %
+  * Drops the chars of payload from index length on and undoes whatever the streaming
+    parser found in them
 
  Inputs:
  -------
-  * void
+  * uint16_t length - New number of chars in payload
 
  Return:
  -------
-  * float - Commanded evaporative purge in %
+  * void
 */
-float ELM327::commandedEvapPurge()
+void ELM327::streamRewind(const uint16_t& length)
 {
-    return processPID(SERVICE_01, COMMANDED_EVAPORATIVE_PURGE, 1, 1, 100.0 / 255.0);
+    if (length >= recBytes)
+        return;
+
+    recBytes          = length;
+    payload[recBytes] = '\0';
+
+    if (stream.firstDatum > recBytes)
+    {
+        stream.firstDatum    = 0;
+        stream.dataEnd       = 0;
+        stream.decodedBytes  = 0;
+        stream.decodeStopped = false;
+    }
+    else if (stream.firstDatum)
+    {
+        uint16_t maxBytes = (recBytes - stream.firstDatum) / 2;
+
+        if (stream.dataEnd && ((stream.dataEnd + stream.headerLen) > recBytes))
+            stream.dataEnd = 0;
+
+        if (stream.decodedBytes >= maxBytes)
+        {
+            stream.decodedBytes  = maxBytes;
+            stream.decodeStopped = false;
+        }
+    }
 }
 
 /*
- float ELM327::fuelLevel()
+ bool ELM327::demuxChar(const char& recChar)
 
  Description:
  ------------
-  *  Find fuel tank level input in %
+  * Strips the CAN ID and PCI that start each line while headers are on (see
+    setECUDemux()), so payload holds the same data as with headers off:
+      - Single frames: the PCI is the data length, the padding after it is dropped
+      - First frames: the PCI is the total data length of a multiline response. The
+        lines before it are dropped, as are the frames of any other ECU after it
+      - Consecutive frames: the PCI is the sequence number, which is validated
+    Lines that aren't frames (i.e. "NO DATA") are kept as they are
 
  Inputs:
  -------
-  * void
+  * const char& recChar - Alphanumeric char or '.' of a response
 
  Return:
  -------
-  * float - Fuel tank level input in %
+  * bool - Whether or not the char was consumed (not response data)
 */
-float ELM327::fuelLevel()
+bool ELM327::demuxChar(const char& recChar)
 {
-    return processPID(SERVICE_01, FUEL_TANK_LEVEL_INPUT, 1, 1, 100.0 / 255.0);
+    if (stream.linePlain)
+        return false;
+
+    uint8_t pos = stream.linePos;
+
+    // Data of the frame - a single frame's chars past its length are padding
+    if (stream.prefixLen && (pos >= stream.prefixLen))
+    {
+        if (stream.lineDataChars == 0xFF)
+            return false;
+
+        stream.linePos++;
+        return (pos - stream.prefixLen) >= stream.lineDataChars;
+    }
+
+    uint8_t value = pgm_read_byte(&HEX_DIGIT_VALUES[(uint8_t)recChar]);
+
+    // Only single, first and consecutive frames (PCI types 0 to 2) carry responses
+    if ((value > 0xF) || ((pos == stream.idChars) && (value > 2)))
+    {
+        stream.linePlain = true;
+
+        for (uint8_t i = 0; i < pos; i++)
+            if (!streamStore(stream.prefix[i]))
+                break;
+
+        return false;
+    }
+
+    stream.prefix[stream.linePos++] = recChar;
+
+    if (pos == stream.idChars)
+    {
+        stream.lineType  = value;
+        stream.prefixLen = stream.idChars + ((value == 1) ? 4 : 2);
+    }
+
+    if (!stream.prefixLen || (stream.linePos < stream.prefixLen))
+        return true;
+
+    // Complete CAN ID and PCI
+    uint16_t pci = 0;
+
+    stream.lineId = 0;
+
+    for (uint8_t i = 0; i < stream.idChars; i++)
+        stream.lineId = (stream.lineId << 4) | pgm_read_byte(&HEX_DIGIT_VALUES[(uint8_t)stream.prefix[i]]);
+
+    for (uint8_t i = stream.idChars + 1; i < stream.prefixLen; i++)
+        pci = (pci << 4) | pgm_read_byte(&HEX_DIGIT_VALUES[(uint8_t)stream.prefix[i]]);
+
+    stream.lineDataChars = 0xFF;
+
+    if (stream.multiLine && ((stream.lineType != 2) || (stream.lineId != stream.frameId)))
+    {
+        // Only one multiline response is kept
+        stream.lineDataChars = 0;
+    }
+    else if (stream.lineType == 0)
+    {
+        stream.lineDataChars = pci * 2;
+    }
+    else if (stream.lineType == 1)
+    {
+        streamRewind(0);
+
+        stream.multiLine   = true;
+        stream.totalChars  = pci * 2;
+        stream.lineStart   = 0;
+        stream.nextFrame   = 1;
+        stream.frameId     = stream.lineId;
+        stream.lineIsFrame = true;
+
+        if (debugMode)
+        {
+            Serial.print(F("totalChars = "));
+            Serial.println(stream.totalChars);
+        }
+    }
+    else if (!stream.multiLine)
+    {
+        // Consecutive frame without its first frame
+        stream.lineDataChars = 0;
+    }
+    else
+    {
+        if (pci != (stream.nextFrame & 0xF))
+        {
+            if (debugMode && !stream.frameError)
+            {
+                Serial.print(F("Multiline response frame out of sequence, expected "));
+                Serial.println(stream.nextFrame & 0xF, HEX);
+            }
+
+            stream.frameError = true;
+        }
+
+        stream.nextFrame++;
+        stream.lineIsFrame = true;
+    }
+
+    return true;
 }
 
 /*
- uint8_t ELM327::warmUpsSinceCodesCleared()
+ void ELM327::recordECUResponse()
 
  Description:
  ------------
-  *  Find num warm-ups since codes cleared
+  * Adds the single frame that just ended to ECU_Responses, with the data after the
+    response header of a query (all data of other commands). Negative responses to
+    queries, repeats of an ECU and lines received during a multiline response are skipped
 
  Inputs:
  -------
@@ -1570,19 +4633,49 @@ float ELM327::fuelLevel()
 
  Return:
  -------
-  * uint8_t - Num warm-ups since codes cleared
+  * void
 */
-uint8_t ELM327::warmUpsSinceCodesCleared()
+void ELM327::recordECUResponse()
 {
-    return (uint8_t)processPID(SERVICE_01, WARM_UPS_SINCE_CODES_CLEARED, 1, 1);
+    const char* line    = payload + stream.lineStart;
+    uint16_t    lineLen = recBytes - stream.lineStart;
+    uint8_t     skip    = stream.headerLen;
+
+    if (stream.linePlain || stream.multiLine || (stream.lineType != 0) || !stream.prefixLen ||
+        (stream.linePos < stream.prefixLen) || (ECU_Responses.numECUs >= ECU_MAX_RESPONSES))
+        return;
+
+    if ((lineLen < skip) || memcmp(line, expectedHeader, skip))
+        return;
+
+    for (uint8_t i = 0; i < ECU_Responses.numECUs; i++)
+        if (ECU_Responses.ecus[i].id == stream.lineId)
+            return;
+
+    ecuResponse& ecu = ECU_Responses.ecus[ECU_Responses.numECUs++];
+
+    ecu.id  = stream.lineId;
+    ecu.len = 0;
+
+    for (uint16_t i = skip; ((i + 1) < lineLen) && (ecu.len < ECU_RESPONSE_LEN); i += 2)
+    {
+        uint8_t msn = pgm_read_byte(&HEX_DIGIT_VALUES[(uint8_t)line[i]]);
+        uint8_t lsn = pgm_read_byte(&HEX_DIGIT_VALUES[(uint8_t)line[i + 1]]);
+
+        if ((msn | lsn) & 0xF0)
+            break;
+
+        ecu.data[ecu.len++] = (msn << 4) | lsn;
+    }
 }
 
 /*
- uint16_t ELM327::distSinceCodesCleared()
+ bool ELM327::finishStreamDecode()
 
  Description:
  ------------
-  *  Find distance traveled since codes cleared in km
+  * Completes the decoding the streaming parser did while the response of a PID query
+    was received: sets responseDataLen, the legacy response fields and responseBytes
 
  Inputs:
  -------
@@ -1590,99 +4683,227 @@ uint8_t ELM327::warmUpsSinceCodesCleared()
 
  Return:
  -------
-  * uint16_t - Distance traveled since codes cleared in km
+  * bool - Whether or not the expected response header was found
 */
-uint16_t ELM327::distSinceCodesCleared()
+bool ELM327::finishStreamDecode()
 {
-    return (uint16_t)processPID(SERVICE_01, DIST_TRAV_SINCE_CODES_CLEARED, 1, 2);
+    if (!stream.firstDatum)
+        return false;
+
+    uint16_t numChars = (stream.dataEnd ? stream.dataEnd : recBytes) - stream.firstDatum;
+
+    if (debugMode)
+    {
+        if (stream.dataEnd)
+            Serial.println(F("Double response detected"));
+        else
+            Serial.println(F("Single response detected"));
+    }
+
+    responseDataLen = (stream.decodedBytes < (numChars / 2)) ? stream.decodedBytes : (numChars / 2);
+    setLegacyResponse();
+
+    return true;
 }
 
 /*
- float ELM327::evapSysVapPressure()
+ uint8_t ELM327::formatResponseHeader(char header[])
 
  Description:
  ------------
-  *  Find evap. system vapor pressure in Pa
+  * Creates the header a response to the current query starts with (i.e. "410C" for "010C1")
 
  Inputs:
  -------
-  * void
+  * char header[] - Buffer of at least 7 chars for the header
 
  Return:
  -------
-  * float - Evap. system vapor pressure in Pa
+  * uint8_t - Length of the header
 */
-float ELM327::evapSysVapPressure()
+uint8_t ELM327::formatResponseHeader(char header[])
 {
-    return processPID(SERVICE_01, EVAP_SYSTEM_VAPOR_PRESSURE, 1, 2, 1.0 / 4.0);
+    memset(header, '\0', 7);
+
+    if (longQuery)
+    {
+        header[0] = query[0] + 4;
+        header[1] = query[1];
+        header[2] = query[2];
+        header[3] = query[3];
+        header[4] = query[4];
+        header[5] = query[5];
+    }
+    else
+    {
+        header[0] = query[0] + 4;
+        header[1] = query[1];
+
+        if (isMode0x22Query) // mode 0x22 responses always zero-pad the pid to 4 chars, even for a 2-char pid
+        {
+            header[2] = '0';
+            header[3] = '0';
+            header[4] = query[2];
+            header[5] = query[3];
+        }
+        else
+        {
+            header[2] = query[2];
+            header[3] = query[3];
+        }
+    }
+
+    return strlen(header);
 }
 
 /*
- uint8_t ELM327::absBaroPressure()
+ void ELM327::recordMetrics(const int8_t& status)
 
  Description:
  ------------
-  *  Find absolute barometric pressure in kPa
+  * Adds the outcome and latencies of the query that just completed to Metrics
 
  Inputs:
  -------
-  * void
+  * const int8_t& status - ELM_XXX status the query completed with
 
  Return:
  -------
-  * uint8_t - Absolute barometric pressure in kPa
+  * void
 */
-uint8_t ELM327::absBaroPressure()
+void ELM327::recordMetrics(const int8_t& status)
 {
-    return (uint8_t)processPID(SERVICE_01, ABS_BAROMETRIC_PRESSURE, 1, 1);
+    queryInFlight = false;
+
+    if ((status >= ELM_GENERAL_ERROR) && (status <= ELM_MSG_RXD))
+        Metrics.statusCounts[status - ELM_GENERAL_ERROR]++;
+
+    if (metricsService < 0)
+        return;
+
+#if ELM_METRICS
+    queryMetrics* entry = getPidMetrics(metricsService, metricsPid);
+
+    if (!entry)
+    {
+        if (Metrics.numPids >= METRICS_PID_SLOTS)
+        {
+            Metrics.untracked++;
+            return;
+        }
+
+        entry = &Metrics.pids[Metrics.numPids++];
+        memset(entry, 0, sizeof(queryMetrics));
+        entry->service = metricsService;
+        entry->pid     = metricsPid;
+    }
+
+    if (firstByteRxd)
+        updateStat(entry->firstByte_us, firstByte_us - queryStart_us);
+
+    if (status == ELM_SUCCESS)
+        updateStat(entry->prompt_us, micros() - queryStart_us);
+
+    updateStat(entry->rxBytes, recBytes);
+#else
+    Metrics.untracked++;
+#endif
 }
 
 /*
- float ELM327::catTempB1S1()
+ void ELM327::updateStat(runningStat& stat, const uint32_t& value)
 
  Description:
  ------------
-  *  Find catalyst temperature in C
+  * Adds a sample to a running statistic
 
  Inputs:
  -------
-  * void
+  * runningStat& stat     - Statistic to update
+  * const uint32_t& value - New sample
 
  Return:
  -------
-  * float - Catalyst temperature in C
+  * void
 */
-float ELM327::catTempB1S1()
+void ELM327::updateStat(runningStat& stat, const uint32_t& value)
 {
-    return processPID(SERVICE_01, CATALYST_TEMP_BANK_1_SENSOR_1, 1, 2, 1.0 / 10.0, -40.0);
+    if (!stat.count || (value < stat.min))
+        stat.min = value;
+
+    if (!stat.count || (value > stat.max))
+        stat.max = value;
+
+    stat.count++;
+    stat.mean += ((float)value - stat.mean) / stat.count;
 }
 
 /*
- float ELM327::catTempB2S1()
+ void ELM327::watchTiming(const int8_t& status)
 
  Description:
  ------------
-  *  Find catalyst temperature in C
+  * Backs the calibrated timing off when too many queries of supported service 01 PIDs
+    return NO DATA (TIMING_BACKOFF_NO_DATA within TIMING_WATCH_WINDOW queries). Each
+    back off first lowers the "AT AT" mode, then raises "AT ST" by half. The new timing
+    is sent before the next service 01 query (see applyBackoff()) or blocking command
 
  Inputs:
  -------
-  * void
+  * const int8_t& status - ELM_XXX status the query completed with
 
  Return:
  -------
-  * float - Catalyst temperature in C
+  * void
 */
-float ELM327::catTempB2S1()
+void ELM327::watchTiming(const int8_t& status)
 {
-    return processPID(SERVICE_01, CATALYST_TEMP_BANK_2_SENSOR_1, 1, 2, 1.0 / 10.0, -40.0);
+    // Unsupported PIDs always return NO DATA, whatever the timing
+    if (!Timing.calibrated || (metricsService != SERVICE_01) || !isPidSupported(SERVICE_01, metricsPid))
+        return;
+
+    Timing.windowQueries++;
+
+    if (status == ELM_NO_DATA)
+        Timing.windowNoData++;
+
+    if (Timing.windowNoData >= TIMING_BACKOFF_NO_DATA)
+    {
+        if ((Timing.adaptiveTiming > 0) || (Timing.dataTimeout < 0xFF))
+        {
+            if (Timing.adaptiveTiming > 0)
+                Timing.adaptiveTiming--;
+            else
+                Timing.dataTimeout = (Timing.dataTimeout >= 0xAA) ? 0xFF : (Timing.dataTimeout + Timing.dataTimeout / 2 + 1);
+
+            Timing.backoffPending = true;
+            Timing.backoffs++;
+
+            if (debugMode)
+            {
+                Serial.print(F("NO DATA rate too high - backing off to AT ST "));
+                Serial.print(Timing.dataTimeout, HEX);
+                Serial.print(F(", AT AT"));
+                Serial.println(Timing.adaptiveTiming);
+            }
+        }
+    }
+    else if (Timing.windowQueries < TIMING_WATCH_WINDOW)
+        return;
+
+    Timing.windowQueries = 0;
+    Timing.windowNoData  = 0;
 }
 
 /*
- float ELM327::catTempB1S2()
+ int8_t ELM327::applyBackoff()
 
  Description:
  ------------
-  *  Find catalyst temperature in C
+  * Sends the timing backed off by watchTiming() ("AT ST", then "AT AT") without blocking,
+    as part of the non-blocking query state machine: processPID(), processPIDs() and
+    readFixed() call it until it stops returning ELM_GETTING_MSG, then send their query.
+    If the ELM327 refuses the timing, the query goes out with the old one
 
  Inputs:
  -------
@@ -1690,59 +4911,110 @@ float ELM327::catTempB2S1()
 
  Return:
  -------
-  * float - Catalyst temperature in C
+  * int8_t - ELM_GETTING_MSG while the timing commands are in flight, else ELM_SUCCESS
 */
-float ELM327::catTempB1S2()
+int8_t ELM327::applyBackoff()
 {
-    return processPID(SERVICE_01, CATALYST_TEMP_BANK_1_SENSOR_2, 1, 2, 1.0 / 10.0, -40.0);
+    char command[10] = {'\0'};
+
+    if (Timing.backoffStep == 0)
+    {
+        if (!Timing.backoffPending)
+            return ELM_SUCCESS;
+
+        Timing.backoffPending = false;
+        Timing.backoffStep    = 1;
+
+        snprintf(command, sizeof(command), SET_TIMEOUT_TO_H_X_4MS, Timing.dataTimeout);
+        sendCommand(command);
+
+        return ELM_GETTING_MSG;
+    }
+
+    if (get_response() == ELM_GETTING_MSG)
+        return ELM_GETTING_MSG;
+
+    if ((Timing.backoffStep == 1) && (nb_rx_state == ELM_SUCCESS) && (strstr(payload, RESPONSE_OK) != NULL))
+    {
+        Timing.backoffStep = 2;
+
+        if (Timing.adaptiveTiming == 0)
+            sendCommand(ADAPTIVE_TIMING_OFF);
+        else if (Timing.adaptiveTiming == 1)
+            sendCommand(ADAPTIVE_TIMING_AUTO_1);
+        else
+            sendCommand(ADAPTIVE_TIMING_AUTO_2);
+
+        return ELM_GETTING_MSG;
+    }
+
+    Timing.backoffStep   = 0;
+    Timing.windowQueries = 0;
+    Timing.windowNoData  = 0;
+
+    return ELM_SUCCESS;
 }
 
 /*
- float ELM327::catTempB2S2()
+ uint32_t ELM327::statusCount(const int8_t& status)
 
  Description:
  ------------
-  *  Find catalyst temperature in C
+  * Returns how many queries completed with the given status since the last resetMetrics()
 
  Inputs:
  -------
-  * void
+  * const int8_t& status - ELM_XXX status code
 
  Return:
  -------
-  * float - Catalyst temperature in C
+  * uint32_t - Number of queries, 0 for unknown status codes
 */
-float ELM327::catTempB2S2()
+uint32_t ELM327::statusCount(const int8_t& status)
 {
-    return processPID(SERVICE_01, CATALYST_TEMP_BANK_2_SENSOR_2, 1, 2, 1.0 / 10.0, -40.0);
+    if ((status < ELM_GENERAL_ERROR) || (status > ELM_MSG_RXD))
+        return 0;
+
+    return Metrics.statusCounts[status - ELM_GENERAL_ERROR];
 }
 
 /*
- uint32_t ELM327::supportedPIDs_41_60()
+ queryMetrics* ELM327::getPidMetrics(const uint8_t& service, const uint16_t& pid)
 
  Description:
  ------------
-  * Determine which of PIDs 0x41 through 0x60 are supported (bit encoded)
+  * Finds the latency/size statistics of a given service/PID
 
  Inputs:
  -------
-  * void
+  * const uint8_t& service - The diagnostic service ID (i.e. 0x01)
+  * const uint16_t& pid    - The Parameter ID (PID) of the query
 
  Return:
  -------
-  * uint32_t - Bit encoded booleans of supported PIDs 0x41-0x60
+  * queryMetrics* - Pointer to the statistics or nullptr if the PID hasn't been queried yet
+                    (always nullptr if ELM_METRICS is 0)
 */
-uint32_t ELM327::supportedPIDs_41_60()
+queryMetrics* ELM327::getPidMetrics(const uint8_t& service, const uint16_t& pid)
 {
-    return (uint32_t)processPID(SERVICE_01, SUPPORTED_PIDS_41_60, 1, 4);
+#if ELM_METRICS
+    for (uint8_t i = 0; i < Metrics.numPids; i++)
+        if ((Metrics.pids[i].service == service) && (Metrics.pids[i].pid == pid))
+            return &Metrics.pids[i];
+#else
+    (void)service;
+    (void)pid;
+#endif
+
+    return nullptr;
 }
 
 /*
- uint32_t ELM327::monitorDriveCycleStatus()
+ void ELM327::resetMetrics()
 
  Description:
  ------------
-  *  Find status this drive cycle (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_41)
+  * Clears all query metrics
 
  Inputs:
  -------
@@ -1750,19 +5022,29 @@ uint32_t ELM327::supportedPIDs_41_60()
 
  Return:
  -------
-  * uint32_t - Bit encoded status (https://en.wikipedia.org/wiki/OBD-II_PIDs#Service_01_PID_41)
+  * void
 */
-uint32_t ELM327::monitorDriveCycleStatus()
+void ELM327::resetMetrics()
 {
-    return (uint32_t)processPID(SERVICE_01, MONITOR_STATUS_THIS_DRIVE_CYCLE, 1, 4);
+    memset(Metrics.statusCounts, 0, sizeof(Metrics.statusCounts));
+    Metrics.untracked = 0;
+#if ELM_METRICS
+    Metrics.numPids   = 0;
+#endif
 }
 
 /*
- float ELM327::ctrlModVoltage()
-
+ bool ELM327::parseMultiLineResponse()
+ 
  Description:
  ------------
-  *  Find control module voltage in V
+  * Reassembles a buffered multiline (ISO-TP) response into a single line with only the data chars
+  * Works in place in a single pass: the length line and "N:" frame indices are dropped and the
+    data chars are moved down in payload, so no other buffer is needed
+  * Frames must arrive in sequence (0:, 1:, ... F:, 0:, ...) and up to the ISO-TP maximum of
+    4095 bytes can be declared by the length line
+  * Received responses are already reassembled by the streaming parser (see streamChar()),
+    this is only needed for raw responses copied into payload by the caller
 
  Inputs:
  -------
@@ -1770,39 +5052,179 @@ uint32_t ELM327::monitorDriveCycleStatus()
 
  Return:
  -------
-  * float - Control module voltage in V
+  * bool - false if a frame was out of sequence
 */
-float ELM327::ctrlModVoltage()
-{
-    return processPID(SERVICE_01, CONTROL_MODULE_VOLTAGE, 1, 2, 1.0 / 1000.0);
+bool ELM327::parseMultiLineResponse() {
+    uint16_t totalChars = 0; // Declared response length in hex chars
+    uint16_t numChars = 0;   // Data chars reassembled so far
+    uint8_t  nextFrame = 0;  // Sequence number the next frame must have
+    char*    line = payload;
+    char*    data = payload; // Write position - never ahead of line
+
+    while ((numChars < totalChars || 0 == totalChars) && *line != '\0')
+    {
+        char* end = strchr(line, '\r');
+        uint16_t lineLen = (end != NULL) ? (end - line) : strlen(line);
+
+        if (0 == totalChars)
+        {
+            // Some devices return the response header in the first line instead of the data length, ignore this line
+            // Line containing the length is 3 hex chars only, longer first line will be a header.
+            if (lineLen > 0 && lineLen <= 3)
+            {
+                for (uint8_t i = 0; i < lineLen && isxdigit(line[i]); i++)
+                    totalChars = (totalChars << 4) | ctoi(line[i]);
+
+                totalChars *= 2;
+
+                if (debugMode) {
+                    Serial.print(F("totalChars = "));
+                    Serial.println(totalChars);
+                }
+            }
+        }
+        else
+        {
+            char* colon = (char*)memchr(line, ':', lineLen);
+
+            if (colon) {
+                // Frame index is a single hex digit that wraps after F
+                if (((colon - line) != 1) || !isxdigit(line[0]) || (ctoi(line[0]) != (nextFrame & 0xF)))
+                {
+                    if (debugMode) {
+                        Serial.print(F("Multiline response frame out of sequence, expected "));
+                        Serial.println(nextFrame & 0xF, HEX);
+                    }
+                    return false;
+                }
+
+                nextFrame++;
+
+                uint16_t dataLen = lineLen - (colon + 1 - line);
+
+                if (dataLen > totalChars - numChars)
+                    dataLen = totalChars - numChars;
+
+                memmove(data, colon + 1, dataLen);
+                data += dataLen;
+                numChars += dataLen;
+            }
+        }
+
+        if (end == NULL)
+            break;
+
+        line = end + 1;
+    }
+
+    *data = '\0';
+
+    if (debugMode) 
+    {
+        Serial.print(F("Parsed multiline response: "));
+        Serial.println(payload);
+    }
+
+    return true;
 }
 
+
 /*
- float ELM327::absLoad()
+ uint64_t ELM327::findResponse(const uint8_t& service, const uint8_t& pid)
 
  Description:
  ------------
-  *  Find absolute load value in %
+  * Parses the buffered ELM327's response and returns the queried data
 
  Inputs:
  -------
-  * void
+  * const uint8_t& service - The diagnostic service ID. 01 is "Show current data"
+  * const uint8_t& pid     - The Parameter ID (PID) from the service
 
  Return:
  -------
-  * float - Absolute load value in %
+  * void
 */
-float ELM327::absLoad()
+uint64_t ELM327::findResponse()
 {
-    return processPID(SERVICE_01, ABS_LOAD_VALUE, 1, 2, 100.0 / 255.0);
+    char header[7];
+
+    formatResponseHeader(header);
+
+    if (debugMode)
+    {
+        Serial.print(F("Expected response header: "));
+        Serial.println(header);
+    }
+
+    // The response to the query was already decoded while it arrived
+    if (stream.headerLen && !strcmp(header, expectedHeader))
+    {
+        if (finishStreamDecode())
+        {
+            printResponseData();
+            return response;
+        }
+
+        if (debugMode)
+            Serial.println(F("Response not detected"));
+
+        return 0;
+    }
+
+    const char* firstHead = strstr(payload, header);
+
+    if (firstHead)
+    {
+        const char* firstDatum = firstHead + strlen(header);
+
+        // Some ELM327s (such as my own) respond with two
+        // "responses" per query. The data ends where the
+        // second response starts, so only the rest of the
+        // payload needs to be searched. The second response
+        // starts a line or, if the lines are back to back,
+        // a byte after at least one data byte - the header
+        // bytes anywhere else are data
+        const char* secondHead = strstr(firstDatum, header);
+        uint16_t    numChars;
+
+        while (secondHead && (secondHead[-1] != '\r') && (secondHead[-1] != '\n') &&
+               ((secondHead == firstDatum) || ((secondHead - firstDatum) & 0x1)))
+            secondHead = strstr(secondHead + 1, header);
+
+        if (secondHead)
+        {
+            if (debugMode)
+                Serial.println(F("Double response detected"));
+
+            numChars = secondHead - firstDatum;
+        }
+        else
+        {
+            if (debugMode)
+                Serial.println(F("Single response detected"));
+
+            numChars = strlen(firstDatum);
+        }
+
+        decodeResponseData(firstDatum, numChars);
+        printResponseData();
+
+        return response;
+    }
+
+    if (debugMode)
+        Serial.println(F("Response not detected"));
+
+    return 0;
 }
 
 /*
- float ELM327::commandedAirFuelRatio()
+ void ELM327::printResponseData()
 
  Description:
  ------------
-  *  Find commanded air-fuel equivalence ratio
+  * Prints the decoded response data bytes if debug mode is on
 
  Inputs:
  -------
@@ -1810,39 +5232,76 @@ float ELM327::absLoad()
 
  Return:
  -------
-  * float - Commanded air-fuel equivalence ratio
+  * void
 */
-float ELM327::commandedAirFuelRatio()
+void ELM327::printResponseData()
 {
-    return processPID(SERVICE_01, FUEL_AIR_COMMANDED_EQUIV_RATIO, 1, 2, 2.0 / 65536.0);
+    if (!debugMode)
+        return;
+
+    Serial.print(F("Response data ("));
+    Serial.print(responseDataLen);
+    Serial.println(F(" bytes): "));
+
+    for (uint16_t i = 0; i < responseDataLen; i++)
+    {
+        Serial.print(F("\tbyte "));
+        Serial.print(i);
+        Serial.print(F(": "));
+        Serial.println(responseData[i]);
+    }
 }
 
 /*
- float ELM327::relativeThrottle()
+ uint8_t ELM327::decodeResponseData(const char* hex, const uint16_t& numChars)
 
  Description:
  ------------
-  *  Find relative throttle position in %
+  * Converts the hex chars of a response's data into responseData using a lookup table
+    (no 64-bit math per nibble) and sets responseDataLen to the exact number of bytes.
+    Decoding stops at the first char that isn't a hex digit. responseData holds up to
+    PAYLOAD_LEN / 2 bytes, which is all a payload can contain
+
+  * Also fills in the legacy fields - see setLegacyResponse()
 
  Inputs:
  -------
-  * void
+  * const char* hex          - First hex char of the data
+  * const uint16_t& numChars - Number of chars that belong to the data
 
  Return:
  -------
-  * float - Relative throttle position in %
+  * uint16_t - Number of decoded bytes (responseDataLen)
 */
-float ELM327::relativeThrottle()
+uint16_t ELM327::decodeResponseData(const char* hex, const uint16_t& numChars)
 {
-    return processPID(SERVICE_01, RELATIVE_THROTTLE_POSITION, 1, 1, 100.0 / 255.0);
+    uint16_t numBytes = 0;
+
+    for (uint16_t i = 0; (i + 1) < numChars; i += 2)
+    {
+        uint8_t msn = pgm_read_byte(&HEX_DIGIT_VALUES[(uint8_t)hex[i]]);
+        uint8_t lsn = pgm_read_byte(&HEX_DIGIT_VALUES[(uint8_t)hex[i + 1]]);
+
+        if (((msn | lsn) & 0xF0) || (numBytes >= (PAYLOAD_LEN / 2)))
+            break;
+
+        responseData[numBytes++] = (msn << 4) | lsn;
+    }
+
+    responseDataLen = numBytes;
+    setLegacyResponse();
+
+    return responseDataLen;
 }
 
 /*
- float ELM327::ambientAirTemp()
+ void ELM327::setLegacyResponse()
 
  Description:
  ------------
-  *  Find ambient air temperature in C
+  * Fills in the legacy fields from responseData: numPayChars, "response" (the last up
+    to 8 bytes, most significant first) and responseByte_0..7 (responseByte_0 = last byte).
+    Also sets responseBytes for user calculators
 
  Inputs:
  -------
@@ -1850,19 +5309,41 @@ float ELM327::relativeThrottle()
 
  Return:
  -------
-  * float - Ambient air temperature in C
+  * void
 */
-float ELM327::ambientAirTemp()
+void ELM327::setLegacyResponse()
 {
-    return processPID(SERVICE_01, AMBIENT_AIR_TEMP, 1, 1, 1, -40);
+    uint32_t high = 0; // Legacy "response" is kept as two 32-bit halves
+    uint32_t low  = 0;
+
+    for (uint16_t i = (responseDataLen > 8) ? (responseDataLen - 8) : 0; i < responseDataLen; i++)
+    {
+        high = (high << 8) | (low >> 24);
+        low  = (low << 8) | responseData[i];
+    }
+
+    numPayChars = responseDataLen * 2;
+    response    = ((uint64_t)high << 32) | low;
+
+    responseByte_0 =  low         & 0xFF;
+    responseByte_1 = (low  >> 8)  & 0xFF;
+    responseByte_2 = (low  >> 16) & 0xFF;
+    responseByte_3 = (low  >> 24) & 0xFF;
+    responseByte_4 =  high        & 0xFF;
+    responseByte_5 = (high >> 8)  & 0xFF;
+    responseByte_6 = (high >> 16) & 0xFF;
+    responseByte_7 = (high >> 24) & 0xFF;
+
+    // Data bytes for user calculators - see conditionResponse(double (*func)(const pidResponse&))
+    setResponseBytes(responseDataLen);
 }
 
 /*
- float ELM327::absThrottlePosB()
+ void ELM327::printError()
 
  Description:
  ------------
-  *  Find absolute throttle position B in %
+  * Prints appropriate error description if an error has occurred
 
  Inputs:
  -------
@@ -1870,59 +5351,142 @@ float ELM327::ambientAirTemp()
 
  Return:
  -------
-  * float - Absolute throttle position B in %
+  * void
 */
-float ELM327::absThrottlePosB()
+void ELM327::printError()
 {
-    return processPID(SERVICE_01, ABS_THROTTLE_POSITION_B, 1, 1, 100.0 / 255.0);
+    Serial.print(F("Received: "));
+    Serial.println(payload);
+
+    if (nb_rx_state == ELM_SUCCESS)
+        Serial.println(F("ELM_SUCCESS"));
+    else if (nb_rx_state == ELM_NO_RESPONSE)
+        Serial.println(F("ERROR: ELM_NO_RESPONSE"));
+    else if (nb_rx_state == ELM_BUFFER_OVERFLOW)
+        Serial.println(F("ERROR: ELM_BUFFER_OVERFLOW"));
+    else if (nb_rx_state == ELM_GARBAGE)
+        Serial.println(F("ERROR: ELM_GARBAGE"));
+    else if (nb_rx_state == ELM_UNABLE_TO_CONNECT)
+        Serial.println(F("ERROR: ELM_UNABLE_TO_CONNECT"));
+    else if (nb_rx_state == ELM_NO_DATA)
+        Serial.println(F("ERROR: ELM_NO_DATA"));
+    else if (nb_rx_state == ELM_STOPPED)
+        Serial.println(F("ERROR: ELM_STOPPED"));
+    else if (nb_rx_state == ELM_TIMEOUT)
+        Serial.println(F("ERROR: ELM_TIMEOUT"));
+    else if (nb_rx_state == ELM_BUFFER_OVERFLOW)
+        Serial.println(F("ERROR: BUFFER OVERFLOW"));
+    else if (nb_rx_state == ELM_GENERAL_ERROR)
+        Serial.println(F("ERROR: ELM_GENERAL_ERROR"));
+    else
+        Serial.println(F("No error detected"));
+
+    delay(100);
 }
 
 /*
- float ELM327::absThrottlePosC()
+ bool ELM327::schedulePID(const uint8_t& pid, const float& rate, const uint32_t& ecu)
 
  Description:
  ------------
-  *  Find absolute throttle position C in %
+  * Adds a service 01 PID to the scheduler (or changes its rate if it's already scheduled).
+    poll() then queries each scheduled PID at (up to) its requested rate, so bus time goes
+    to fast changing values instead of being spent on slow changing ones.
 
  Inputs:
  -------
-  * void
+  * uint8_t pid  - The Parameter ID (PID) from service 01 (must be in the PID descriptor table)
+  * float rate   - Requested number of samples per second (i.e. 20 for RPM, 0.05 for fuel level)
+  * uint32_t ecu - Response CAN ID of the ECU to query, i.e. 0x7E9 (see setECUDemux()), or 0
+                   to broadcast the query. A PID can be scheduled for several ECUs. Queries
+                   to an ECU are sent to it alone - see addressECU()
 
  Return:
  -------
-  * float - Absolute throttle position C in %
+  * bool - Whether or not the PID was scheduled
 */
-float ELM327::absThrottlePosC()
+bool ELM327::schedulePID(const uint8_t& pid, const float& rate, const uint32_t& ecu)
 {
-    return processPID(SERVICE_01, ABS_THROTTLE_POSITION_C, 1, 1, 100.0 / 255.0);
+    pidDescriptor descriptor;
+    int8_t index = findScheduledPID(pid, ecu);
+
+    if ((rate <= 0) || !getPidDescriptor(pid, descriptor))
+        return false;
+
+    if (index < 0)
+    {
+        if (numScheduled >= MAX_SCHEDULED_PIDS)
+            return false;
+
+        index = numScheduled++;
+        memset(&schedule[index], 0, sizeof(scheduledPID));
+        schedule[index].pid     = pid;
+        schedule[index].ecu     = ecu;
+        schedule[index].nextDue = millis();
+    }
+
+    schedule[index].rate      = rate;
+    schedule[index].period_ms = 1000.0 / rate;
+
+    return true;
 }
 
 /*
- float ELM327::absThrottlePosD()
+ bool ELM327::unschedulePID(const uint8_t& pid, const uint32_t& ecu)
 
  Description:
  ------------
-  *  Find absolute throttle position D in %
+  * Removes a PID from the scheduler
 
  Inputs:
  -------
-  * void
+  * uint8_t pid  - The Parameter ID (PID) to remove
+  * uint32_t ecu - Response CAN ID of the ECU the PID was scheduled for, 0 if broadcast
 
  Return:
  -------
-  * float - Absolute throttle position D in %
+  * bool - Whether or not the PID was scheduled
 */
-float ELM327::absThrottlePosD()
+bool ELM327::unschedulePID(const uint8_t& pid, const uint32_t& ecu)
 {
-    return processPID(SERVICE_01, ABS_THROTTLE_POSITION_D, 1, 1, 100.0 / 255.0);
+    int8_t index = findScheduledPID(pid, ecu);
+
+    if (index < 0)
+        return false;
+
+    // Don't leave a query of the removed PID in flight
+    if (activeSchedule == index)
+    {
+        activeSchedule = -1;
+        nb_query_state = SEND_COMMAND;
+    }
+    else if (activeSchedule > index)
+        activeSchedule--;
+
+    for (uint8_t i = index; i < (numScheduled - 1); i++)
+        schedule[i] = schedule[i + 1];
+
+    numScheduled--;
+    return true;
 }
 
 /*
- float ELM327::absThrottlePosE()
+ int8_t ELM327::poll()
 
  Description:
  ------------
-  *  Find absolute throttle position E in %
+  * Non-blocking scheduler for the PIDs added with schedulePID(). Must be called repeatedly.
+    If no query is in flight, the most overdue PID is queried. If no PID is due yet, nothing
+    is sent. Do not send other queries while the scheduler has a query in flight.
+
+  * Deadlines advance by each PID's period, so a PID that is served late is queried
+    earlier next time. Achieved rates are tracked in schedule[].achievedRate.
+
+  * PIDs scheduled for an ECU are sent to that ECU only, with its physical header (see
+    addressECU()). The header is changed back when a broadcast PID is due. The "AT SH"
+    is sent without blocking, like the queries. The due PIDs of the ECU the header
+    addresses are served first, so the header only changes when no such PID is due or
+    a PID of another ECU fell a whole period behind.
 
  Inputs:
  -------
@@ -1930,159 +5494,394 @@ float ELM327::absThrottlePosD()
 
  Return:
  -------
-  * float - Absolute throttle position E in %
+  * int8_t - Index into schedule[] of the PID that just got a new value, else -1
 */
-float ELM327::absThrottlePosE()
+int8_t ELM327::poll()
 {
-    return processPID(SERVICE_01, ABS_THROTTLE_POSITION_E, 1, 1, 100.0 / 255.0);
-}
+    uint32_t now = millis();
 
-/*
- float ELM327::absThrottlePosF()
+    if (activeSchedule < 0)
+    {
+        int32_t maxLateness   = -1;
+        int32_t maxSameECU    = -1;
+        int8_t  sameECU       = -1;
 
- Description:
- ------------
-  *  Find absolute throttle position F in %
+        for (uint8_t i = 0; i < numScheduled; i++)
+        {
+            int32_t lateness = (int32_t)(now - schedule[i].nextDue);
+
+            if (lateness > maxLateness)
+            {
+                maxLateness    = lateness;
+                activeSchedule = i;
+            }
+
+            if ((schedule[i].ecu == addressedECU) && (lateness > maxSameECU))
+            {
+                maxSameECU = lateness;
+                sameECU    = i;
+            }
+        }
+
+        if (activeSchedule < 0)
+            return -1; // Nothing due yet
+
+        // Every switch to another ECU costs an "AT SH" round trip, so the due PIDs of the
+        // ECU addressed now go first - unless a PID of another ECU is late by a whole period
+        if ((sameECU >= 0) && (maxLateness < (int32_t)schedule[activeSchedule].period_ms))
+            activeSchedule = sameECU;
+    }
+
+    scheduledPID& entry = schedule[activeSchedule];
+
+    // Set the header before the query is sent
+    if (nb_query_state == SEND_COMMAND)
+    {
+        int8_t status = addressECU(entry.ecu);
+
+        if (status == ELM_GETTING_MSG)
+            return -1;
+
+        if (status != ELM_SUCCESS)
+        {
+            entry.errors++;
+            entry.nextDue  = now + entry.period_ms;
+            activeSchedule = -1;
+            return -1;
+        }
+    }
+
+#if ELM_FIXED_POINT
+    int32_t fixed = readFixed(entry.pid);
+#else
+    double value = read(entry.pid);
+#endif
+
+    if (nb_rx_state == ELM_GETTING_MSG)
+        return -1;
+
+    int8_t index = activeSchedule;
+    activeSchedule = -1;
+
+    // Don't try to catch up on more than one missed period
+    if ((int32_t)(now - entry.nextDue) > (int32_t)entry.period_ms)
+        entry.nextDue = now + entry.period_ms;
+    else
+        entry.nextDue += entry.period_ms;
+
+    if (nb_rx_state != ELM_SUCCESS)
+    {
+        entry.errors++;
+        return -1;
+    }
 
- Inputs:
- -------
-  * void
+#if ELM_FIXED_POINT
+    entry.fixedValue = fixed;
+#else
+    entry.value      = value;
+    entry.fixedValue = fixedValue(entry.pid);
+#endif
+    recordSample(entry, now);
 
- Return:
- -------
-  * float - Absolute throttle position F in %
-*/
-float ELM327::absThrottlePosF()
-{
-    return processPID(SERVICE_01, ABS_THROTTLE_POSITION_F, 1, 1, 100.0 / 255.0);
+    return index;
 }
 
 /*
- float ELM327::commandedThrottleActuator()
+ float ELM327::achievedRate(const uint8_t& pid, const uint32_t& ecu)
 
  Description:
  ------------
-  *  Find commanded throttle actuator in %
+  * Gets the measured (smoothed) sample rate of a scheduled PID
 
  Inputs:
  -------
-  * void
+  * uint8_t pid - The Parameter ID (PID) to look up
 
  Return:
  -------
-  * float - Commanded throttle actuator in %
+  * float - Achieved rate in Hz, 0 if the PID isn't scheduled or has less than two samples
 */
-float ELM327::commandedThrottleActuator()
+float ELM327::achievedRate(const uint8_t& pid, const uint32_t& ecu)
 {
-    return processPID(SERVICE_01, COMMANDED_THROTTLE_ACTUATOR, 1, 1, 100.0 / 255.0);
+    int8_t index = findScheduledPID(pid, ecu);
+
+    if (index < 0)
+        return 0;
+
+#if ELM_FIXED_POINT
+    if (schedule[index].interval_ms == 0)
+        return 0;
+
+    return 1000.0 / schedule[index].interval_ms;
+#else
+    return schedule[index].achievedRate;
+#endif
 }
 
 /*
- uint16_t ELM327::timeRunWithMIL()
+ int8_t ELM327::findScheduledPID(const uint8_t& pid, const uint32_t& ecu)
 
  Description:
  ------------
-  *  Find time run with MIL on in min
+  * Finds a PID in the scheduler
 
  Inputs:
  -------
-  * void
+  * uint8_t pid  - The Parameter ID (PID) to look up
+  * uint32_t ecu - Response CAN ID of the ECU the PID is scheduled for, 0 if broadcast
 
  Return:
  -------
-  * uint16_t - Time run with MIL on in min
+  * int8_t - Index into schedule[], -1 if the PID isn't scheduled
 */
-uint16_t ELM327::timeRunWithMIL()
+int8_t ELM327::findScheduledPID(const uint8_t& pid, const uint32_t& ecu)
 {
-    return (uint16_t)processPID(SERVICE_01, TIME_RUN_WITH_MIL_ON, 1, 2);
+    for (uint8_t i = 0; i < numScheduled; i++)
+    {
+        if ((schedule[i].pid == pid) && (schedule[i].ecu == ecu))
+            return i;
+    }
+
+    return -1;
 }
 
 /*
- uint16_t ELM327::timeSinceCodesCleared()
+ int8_t ELM327::addressECU(const uint32_t& ecu)
 
  Description:
  ------------
-  *  Find time since trouble codes cleared in min
+  * Sets the header for a query of the scheduler: the physical request ID of an ECU
+    (its response ID - 8, or 18DAxxF1 for 29-bit response ID 18DAF1xx), or the header
+    that was active before the first ECU was addressed for broadcast queries. Only one
+    ECU answers a physically addressed query, so queryPID() doesn't wait for more.
+    The learned numbers of responses are kept: they belong to the broadcast header,
+    physically addressed queries don't use them
+
+  * Non-blocking: "AT SH" is only sent if the header changes, call again until the
+    return value isn't ELM_GETTING_MSG
 
  Inputs:
  -------
-  * void
+  * uint32_t ecu - Response CAN ID of the ECU, 0 to broadcast
 
  Return:
  -------
-  * uint16_t - Time since trouble codes cleared in min
+  * int8_t - ELM_SUCCESS once the header is set, ELM_GETTING_MSG while "AT SH" is in
+             flight, else the error of "AT SH"
 */
-uint16_t ELM327::timeSinceCodesCleared()
+int8_t ELM327::addressECU(const uint32_t& ecu)
 {
-    return (uint16_t)processPID(SERVICE_01, TIME_SINCE_CODES_CLEARED, 1, 2);
-}
+    char header[HEADER_LEN] = {'\0'};
 
-/*
- float ELM327::maxMafRate()
+    if (headerInFlight)
+    {
+        get_response();
 
- Description:
- ------------
-  *  Find maximum value for air flow rate from mass air flow sensor in g/s
+        if (nb_rx_state == ELM_GETTING_MSG)
+            return ELM_GETTING_MSG;
 
- Inputs:
- -------
-  * void
+        headerInFlight = false;
 
- Return:
- -------
-  * float - Maximum value for air flow rate from mass air flow sensor in g/s
-*/
-float ELM327::maxMafRate()
-{
-    return processPID(SERVICE_01, MAX_MAF_RATE, 1, 1, 10.0);
+        if ((nb_rx_state != ELM_SUCCESS) || (strstr(payload, RESPONSE_OK) == NULL))
+        {
+            // The header in effect is unknown now
+            activeHeader[0] = '\0';
+            return (nb_rx_state != ELM_SUCCESS) ? nb_rx_state : ELM_GENERAL_ERROR;
+        }
+
+        ecuHeader(pendingECU, activeHeader);
+        addressedECU = pendingECU;
+
+        // unschedulePID() may have dropped the PID the header was sent for
+        if (ecu != addressedECU)
+            return ELM_GETTING_MSG;
+
+        return ELM_SUCCESS;
+    }
+
+    if (ecu == addressedECU)
+        return ELM_SUCCESS;
+
+    if (addressedECU == 0)
+    {
+        if (activeHeader[0] != '\0')
+            strcpy(broadcastHeader, activeHeader);
+        else if ((activeProtocol == ISO_15765_29_BIT_500_KBAUD) || (activeProtocol == ISO_15765_29_BIT_250_KBAUD))
+            strcpy(broadcastHeader, "18DB33F1");
+        else
+            strcpy(broadcastHeader, "7DF");
+    }
+
+    ecuHeader(ecu, header);
+
+    if (!strcmp(header, activeHeader))
+    {
+        addressedECU = ecu;
+        return ELM_SUCCESS;
+    }
+
+    char command[20] = {'\0'};
+
+    snprintf(command, sizeof(command), SET_HEADER, header);
+    sendCommand(command);
+
+    pendingECU     = ecu;
+    headerInFlight = true;
+
+    return ELM_GETTING_MSG;
 }
 
 /*
- uint8_t ELM327::fuelType()
+ void ELM327::ecuHeader(const uint32_t& ecu, char header[])
 
  Description:
  ------------
-  *  Find fuel type (https://en.wikipedia.org/wiki/OBD-II_PIDs#Fuel_Type_Coding)
+  * Builds the header addressECU() sends to query an ECU
 
  Inputs:
  -------
-  * void
+  * uint32_t ecu  - Response CAN ID of the ECU, 0 for the broadcast header
+  * char header[] - Buffer of HEADER_LEN chars for the header
 
  Return:
  -------
-  * uint8_t - Bit encoded (https://en.wikipedia.org/wiki/OBD-II_PIDs#Fuel_Type_Coding)
+  * void
 */
-uint8_t ELM327::fuelType()
+void ELM327::ecuHeader(const uint32_t& ecu, char header[])
 {
-    return (uint8_t)processPID(SERVICE_01, FUEL_TYPE, 1, 1);
+    if (ecu == 0)
+        strcpy(header, broadcastHeader);
+    else if (ecu > 0x7FF)
+        snprintf(header, HEADER_LEN, "18DA%02X%02X", (uint8_t)ecu, (uint8_t)(ecu >> 8));
+    else
+        snprintf(header, HEADER_LEN, "%03X", (uint16_t)(ecu - 8));
 }
 
 /*
- float ELM327::ethanolPercent()
+ bool ELM327::startMonitor(canFrame frames[], const uint8_t& numFrames, const char* filter, const char* mask, const char* command)
 
  Description:
  ------------
-  *  Find ethanol fuel in %
+  * Starts passive monitoring of the bus ("AT MA" by default). The ELM327 sends every frame
+    it sees (headers on, CAN auto formatting off) until stopMonitor() is called - no
+    requests are sent on the bus. Call pollMonitor() often to parse the received lines into frames and
+    readFrame() to take them out of the ring buffer
+
+  * While monitoring, the ELM327 can't take other commands. sendCommand() stops the monitor
+    first if needed
+
+  * The filter and mask (CAN only) restrict the monitored IDs: a frame is shown if its ID
+    matches filter in every bit set in mask, i.e. filter "7E8" and mask "7F8" show 7E8 to 7EF
 
  Inputs:
  -------
-  * void
+  * canFrame frames[] - Ring buffer for the received frames, holds numFrames - 1 frames
+  * uint8_t numFrames - Size of frames, at least 2
+  * char* filter      - "AT CF" ID filter (3 or 8 hex chars), nullptr for none
+  * char* mask        - "AT CM" ID mask (3 or 8 hex chars), nullptr for none
+  * char* command     - Monitor command, i.e. MONITOR_ALL or "AT MP FECA" - see startJ1939Monitor()
 
  Return:
  -------
-  * float - Ethanol fuel in %
+  * bool - Whether or not monitoring started
 */
-float ELM327::ethanolPercent()
+bool ELM327::startMonitor(canFrame       frames[],
+                          const uint8_t& numFrames,
+                          const char*    filter,
+                          const char*    mask,
+                          const char*    command)
 {
-    return processPID(SERVICE_01, ETHANOL_FUEL_PERCENT, 1, 1, 100.0 / 255.0);
+    char filterCmd[16] = {'\0'};
+
+    if (!frames || (numFrames < 2))
+        return false;
+
+    if (monitoring)
+        stopMonitor();
+
+    // The protocol selects how lines are parsed into frames
+    if (activeProtocol == AUTOMATIC)
+        readProtocol();
+
+    if (activeProtocol == AUTOMATIC)
+        return false;
+
+    bool canBus = activeProtocol >= ISO_15765_11_BIT_500_KBAUD;
+
+    if (filter || mask)
+    {
+        if (!canBus)
+            return false;
+
+        monitorFiltered = true;
+
+        const char* formats[] = { SET_ID_FILTER, SET_ID_MASK };
+        const char* values[]  = { filter, mask };
+
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            if (!values[i])
+                continue;
+
+            snprintf(filterCmd, sizeof(filterCmd), formats[i], values[i]);
+
+            if ((sendCommand_Blocking(filterCmd) != ELM_SUCCESS) || (strstr(payload, RESPONSE_OK) == NULL))
+            {
+                sendCommand_Blocking(RESET_RECEIVE_FILTERS);
+                monitorFiltered = false;
+                return false;
+            }
+        }
+    }
+
+    // Every frame needs its ID, and the raw data bytes (PCI and padding included) are kept
+    sendCommand_Blocking(HEADERS_ON);
+
+    if (canBus)
+        sendCommand_Blocking(CAN_AUTO_FORMAT_OFF);
+
+    // The default J1939 header format ("6 0FEEE 00") splits the priority from the ID
+    if (activeProtocol == SAE_J1939_29_BIT_250_KBAUD)
+        sendCommand_Blocking(J1939_HEAD_FORMAT_OFF);
+
+    monitorFrames  = frames;
+    monitorSize    = numFrames;
+    monitorHead    = 0;
+    monitorTail    = 0;
+    monitorLineLen = 0;
+    monitorLineBad = false;
+    monitorStopped = false;
+    Monitor_Stats  = monitorStats();
+
+    if (debugMode)
+    {
+        Serial.print(F("Sending the following command/query: "));
+        Serial.println(command);
+    }
+
+    // There is no prompt until the monitor is stopped, so it isn't sent with sendCommand()
+    flushInputBuff();
+    elm_port->print(command);
+    elm_port->print('\r');
+    lastCommand[0] = '\0';
+    monitoring = true;
+
+    return true;
 }
 
 /*
- float ELM327::absEvapSysVapPressure()
+ uint8_t ELM327::pollMonitor()
 
  Description:
  ------------
-  *  Find absolute evap. system vapor pressure in kPa
+  * Parses the received monitor lines into frames and puts them in the ring buffer. Never
+    blocks - call it as often as possible, the serial RX buffer only holds a few frames.
+    When the ring buffer is full, new frames are dropped (see Monitor_Stats.dropped)
+
+  * pollMonitor() and readFrame() may run in different tasks (i.e. on both cores of an
+    ESP32) without a lock, as long as each is only called by one task. The ring indices
+    are stored with release and loaded with acquire order, so a frame is complete before
+    the other core sees its slot
 
  Inputs:
  -------
@@ -2090,39 +5889,58 @@ float ELM327::ethanolPercent()
 
  Return:
  -------
-  * float - Absolute evap. system vapor pressure in kPa
+  * uint8_t - Number of frames put in the ring buffer
 */
-float ELM327::absEvapSysVapPressure()
+uint8_t ELM327::pollMonitor()
 {
-    return processPID(SERVICE_01, ABS_EVAP_SYS_VAPOR_PRESSURE, 1, 2, 1.0 / 200.0);
+    uint8_t queued = 0;
+
+    while (monitoring && !monitorStopped && elm_port->available())
+    {
+        if (monitorChar(elm_port->read()))
+            queued++;
+    }
+
+    return queued;
 }
 
 /*
- float ELM327::evapSysVapPressure2()
+ bool ELM327::readFrame(canFrame& frame)
 
  Description:
  ------------
-  *  Find evap. system vapor pressure in Pa
+  * Takes the oldest frame out of the monitor ring buffer. Frames received before
+    stopMonitor() can still be read after it
 
  Inputs:
  -------
-  * void
+  * canFrame& frame - Set to the oldest frame
 
  Return:
  -------
-  * float - Evap. system vapor pressure in Pa
+  * bool - Whether or not a frame was available
 */
-float ELM327::evapSysVapPressure2()
+bool ELM327::readFrame(canFrame& frame)
 {
-    return processPID(SERVICE_01, EVAP_SYS_VAPOR_PRESSURE, 1, 2, 1, -32767);
+    uint8_t tail = monitorTail;
+
+    if (!monitorFrames || (tail == __atomic_load_n(&monitorHead, __ATOMIC_ACQUIRE)))
+        return false;
+
+    frame = monitorFrames[tail];
+
+    // Only free the slot once the frame is copied - pollMonitor() may be waiting for it
+    __atomic_store_n(&monitorTail, (uint8_t)((tail + 1) % monitorSize), __ATOMIC_RELEASE);
+
+    return true;
 }
 
 /*
- float ELM327::absFuelRailPressure()
+ uint8_t ELM327::framesAvailable()
 
  Description:
  ------------
-  *  Find absolute fuel rail pressure in kPa
+  * Gets the number of frames in the monitor ring buffer
 
  Inputs:
  -------
@@ -2130,19 +5948,27 @@ float ELM327::evapSysVapPressure2()
 
  Return:
  -------
-  * float - absolute fuel rail pressure in kPa
+  * uint8_t - Number of frames readFrame() can take
 */
-float ELM327::absFuelRailPressure()
+uint8_t ELM327::framesAvailable()
 {
-    return processPID(SERVICE_01, FUEL_RAIL_ABS_PRESSURE, 1, 2, 10.0);
+    if (!monitorSize)
+        return 0;
+
+    uint8_t head = __atomic_load_n(&monitorHead, __ATOMIC_ACQUIRE);
+    uint8_t tail = __atomic_load_n(&monitorTail, __ATOMIC_ACQUIRE);
+
+    return (head + monitorSize - tail) % monitorSize;
 }
 
 /*
- float ELM327::relativePedalPos()
+ bool ELM327::stopMonitor()
 
  Description:
  ------------
-  *  Find relative accelerator pedal position in %
+  * Stops monitoring and returns the ELM327 to command mode: waits for the prompt (the
+    frames received until then are still parsed) and restores headers off, CAN auto
+    formatting, the J1939 header format and the default receive filters
 
  Inputs:
  -------
@@ -2150,734 +5976,1064 @@ float ELM327::absFuelRailPressure()
 
  Return:
  -------
-  * float - Relative accelerator pedal position in %
+  * bool - Whether or not the ELM327 sent its prompt
 */
-float ELM327::relativePedalPos()
+bool ELM327::stopMonitor()
 {
-    return processPID(SERVICE_01, RELATIVE_ACCELERATOR_PEDAL_POS, 1, 1, 100.0 / 255.0);
+    if (!monitoring)
+        return true;
+
+    if (!monitorStopped)
+    {
+        // Any char stops the monitor. Not a CR: if the ELM327 just stopped on its own
+        // (i.e. "BUFFER FULL"), a CR would repeat "AT MA"
+        elm_port->write(' ');
+
+        uint32_t start = millis();
+
+        while (!monitorStopped && ((millis() - start) < timeout_ms))
+        {
+            if (elm_port->available())
+                monitorChar(elm_port->read());
+        }
+    }
+
+    bool prompt = monitorStopped;
+
+    // Cleared first - sendCommand() stops the monitor while it's set
+    monitoring = false;
+
+    if (debugMode)
+    {
+        Serial.print(F("Monitor stopped - frames: "));
+        Serial.print(Monitor_Stats.frames);
+        Serial.print(F(", dropped: "));
+        Serial.print(Monitor_Stats.dropped);
+        Serial.print(F(", bad lines: "));
+        Serial.println(Monitor_Stats.badLines);
+    }
+
+    sendCommand_Blocking(ecuDemux ? HEADERS_ON : HEADERS_OFF);
+
+    if (activeProtocol >= ISO_15765_11_BIT_500_KBAUD)
+        sendCommand_Blocking(CAN_AUTO_FORMAT_ON);
+
+    if (activeProtocol == SAE_J1939_29_BIT_250_KBAUD)
+        sendCommand_Blocking(J1939_HEAD_FORMAT_ON);
+
+    if (monitorFiltered)
+    {
+        sendCommand_Blocking(RESET_RECEIVE_FILTERS);
+        monitorFiltered = false;
+    }
+
+    return prompt;
 }
 
 /*
- float ELM327::hybridBatLife()
+ bool ELM327::startMonitor(canFrame frames[], const uint8_t& numFrames, const monitorWindow& window)
 
  Description:
  ------------
-  *  Find hybrid battery pack remaining life in %
+  * Starts monitoring with a filter/mask pair found by planMonitorFilters() - see
+    startMonitor(canFrame[], uint8_t, char*, char*)
 
  Inputs:
  -------
-  * void
+  * canFrame frames[]    - Ring buffer for the received frames, holds numFrames - 1 frames
+  * uint8_t numFrames    - Size of frames, at least 2
+  * monitorWindow window - Filter and mask to apply
 
  Return:
  -------
-  * float - Hybrid battery pack remaining life in %
+  * bool - Whether or not monitoring started
 */
-float ELM327::hybridBatLife()
+bool ELM327::startMonitor(canFrame frames[], const uint8_t& numFrames, const monitorWindow& window)
 {
-    return processPID(SERVICE_01, HYBRID_BATTERY_REMAINING_LIFE, 1, 1, 100.0 / 255.0);
+    char filter[HEADER_LEN] = {'\0'};
+    char mask[HEADER_LEN]   = {'\0'};
+
+    snprintf(filter, sizeof(filter), window.extended ? "%08lX" : "%03lX", (unsigned long)window.filter);
+    snprintf(mask,   sizeof(mask),   window.extended ? "%08lX" : "%03lX", (unsigned long)window.mask);
+
+    return startMonitor(frames, numFrames, filter, mask);
 }
 
 /*
- float ELM327::oilTemp()
+ bool ELM327::startJ1939Monitor(canFrame frames[], const uint8_t& numFrames, const uint32_t& pgn)
 
  Description:
  ------------
-  *  Find engine oil temperature in C
+  * Starts monitoring the J1939 messages of one PGN ("AT MP"), or the DM1 messages and the
+    transport protocol frames carrying them ("AT DM1") if pgn is J1939_PGN_DM1 - see
+    startMonitor() and processJ1939Frame()
 
  Inputs:
  -------
-  * void
+  * canFrame frames[] - Ring buffer for the received frames, holds numFrames - 1 frames
+  * uint8_t numFrames - Size of frames, at least 2
+  * uint32_t pgn      - PGN to monitor
 
  Return:
  -------
-  * float - Engine oil temperature in C
+  * bool - Whether or not monitoring started
 */
-float ELM327::oilTemp()
+bool ELM327::startJ1939Monitor(canFrame frames[], const uint8_t& numFrames, const uint32_t& pgn)
 {
-    return processPID(SERVICE_01, ENGINE_OIL_TEMP, 1, 1, 1, -40.0);
+    char command[16] = {'\0'};
+    char pgnHex[9]   = {'\0'};
+
+    if (pgn == J1939_PGN_DM1)
+        return startMonitor(frames, numFrames, nullptr, nullptr, MONITOR_FOR_DM1_MESSAGES);
+
+    snprintf(pgnHex, sizeof(pgnHex), "%06lX", (unsigned long)pgn);
+    snprintf(command, sizeof(command), MONITOR_FOR_PGN, pgnHex);
+
+    return startMonitor(frames, numFrames, nullptr, nullptr, command);
 }
 
 /*
- float ELM327::fuelInjectTiming()
+ void ELM327::setJ1939Transfers(j1939Transfer transfers[], const uint8_t& numTransfers)
 
  Description:
  ------------
-  *  Find fuel injection timing in degrees
+  * Sets the buffer processJ1939Frame() reassembles transport protocol transfers in. Each
+    transfer takes J1939_TP_MAX_LEN bytes, so the buffer is only needed (and allocated by
+    the caller) for J1939 - without one, multi-packet messages are dropped
 
  Inputs:
  -------
-  * void
+  * j1939Transfer transfers[] - Reassembly buffer, nullptr to stop reassembling
+  * uint8_t numTransfers      - Transfers reassembled at the same time, i.e. J1939_TP_SESSIONS
 
  Return:
  -------
-  * float - Fuel injection timing in degrees
+  * void
 */
-float ELM327::fuelInjectTiming()
+void ELM327::setJ1939Transfers(j1939Transfer transfers[], const uint8_t& numTransfers)
 {
-    return processPID(SERVICE_01, FUEL_INJECTION_TIMING, 1, 2, 1.0 / 128.0, -210.0);
+    tpTransfers    = transfers;
+    numTpTransfers = transfers ? numTransfers : 0;
+
+    for (uint8_t i = 0; i < numTpTransfers; i++)
+        tpTransfers[i].active = false;
 }
 
 /*
- float ELM327::fuelRate()
+ bool ELM327::processJ1939Frame(const canFrame& frame, j1939Message& message)
 
  Description:
  ------------
-  *  Find engine fuel rate in L/h
+  * Turns monitored J1939 frames into messages. Frames of a transport protocol transfer
+    (BAM or RTS/CTS, PGNs TP.CM and TP.DT) are reassembled in the buffer set with
+    setJ1939Transfers() - transfers of up to J1939_TP_MAX_LEN bytes. A transfer is dropped
+    if a packet is missing or late (J1939_TP_TIMEOUT) or if either side aborts it. All
+    other frames are complete messages
 
  Inputs:
  -------
-  * void
+  * canFrame frame       - Monitored frame, i.e. from readFrame()
+  * j1939Message message - Set to the complete message. Its data points into frame or
+                           into the reassembly buffer, valid until the next call
 
  Return:
  -------
-  * float - Engine fuel rate in L/h
+  * bool - Whether or not a message is complete
 */
-float ELM327::fuelRate()
+bool ELM327::processJ1939Frame(const canFrame& frame, j1939Message& message)
 {
-    return processPID(SERVICE_01, ENGINE_FUEL_RATE, 1, 2, 1.0 / 20.0);
+    if (!frame.extended)
+        return false;
+
+    uint32_t pgn         = j1939PGN(frame.id);
+    uint8_t  source      = frame.id & 0xFF;
+    uint8_t  destination = ((pgn & 0xFF00) < 0xF000) ? ((frame.id >> 8) & 0xFF) : 0xFF;
+    uint8_t  priority    = (frame.id >> 26) & 0x7;
+
+    // Transfer of the source to the destination, a free slot, or the least recently used slot
+    j1939Transfer* transfer = nullptr;
+
+    for (uint8_t i = 0; i < numTpTransfers; i++)
+    {
+        if (tpTransfers[i].active && (tpTransfers[i].source == source) && (tpTransfers[i].destination == destination))
+        {
+            transfer = &tpTransfers[i];
+            break;
+        }
+    }
+
+    if (pgn == J1939_PGN_TP_CM)
+    {
+        if (frame.len < 8)
+            return false;
+
+        uint8_t control = frame.data[0];
+
+        if (((control == J1939_TP_CM_BAM) || (control == J1939_TP_CM_RTS)) && numTpTransfers)
+        {
+            uint16_t len        = frame.data[1] | (frame.data[2] << 8);
+            uint8_t  numPackets = frame.data[3];
+
+            if (!transfer)
+            {
+                transfer = &tpTransfers[0];
+
+                for (uint8_t i = 0; i < numTpTransfers; i++)
+                {
+                    if (!tpTransfers[i].active)
+                    {
+                        transfer = &tpTransfers[i];
+                        break;
+                    }
+
+                    if ((int32_t)(tpTransfers[i].lastFrame_ms - transfer->lastFrame_ms) < 0)
+                        transfer = &tpTransfers[i];
+                }
+            }
+
+            transfer->active = false;
+
+            if ((len > J1939_TP_MAX_LEN) || (numPackets == 0) || (numPackets != ((len + 6) / 7)))
+            {
+                if (debugMode)
+                {
+                    Serial.print(F("J1939 transfer of "));
+                    Serial.print(len);
+                    Serial.println(F(" bytes dropped"));
+                }
+
+                return false;
+            }
+
+            transfer->active       = true;
+            transfer->source       = source;
+            transfer->destination  = destination;
+            transfer->priority     = priority;
+            transfer->pgn          = frame.data[5] | ((uint32_t)frame.data[6] << 8) | ((uint32_t)frame.data[7] << 16);
+            transfer->len          = len;
+            transfer->numPackets   = numPackets;
+            transfer->nextPacket   = 1;
+            transfer->lastFrame_ms = frame.timestamp_ms;
+        }
+        else if (control == J1939_TP_CM_ABORT)
+        {
+            uint32_t abortedPgn = frame.data[5] | ((uint32_t)frame.data[6] << 8) | ((uint32_t)frame.data[7] << 16);
+
+            // Either side may abort - the receiver's abort goes back to the transfer's source
+            for (uint8_t i = 0; i < numTpTransfers; i++)
+            {
+                if (tpTransfers[i].active && (tpTransfers[i].pgn == abortedPgn) &&
+                    (((tpTransfers[i].source == source) && (tpTransfers[i].destination == destination)) ||
+                     ((tpTransfers[i].source == destination) && (tpTransfers[i].destination == source))))
+                    tpTransfers[i].active = false;
+            }
+        }
+
+        // The transfer's responses (CTS, end of message ACK) come from the destination and
+        // don't carry data
+        return false;
+    }
+
+    if (pgn == J1939_PGN_TP_DT)
+    {
+        if (!transfer || (frame.len < 1))
+            return false;
+
+        uint8_t sequence = frame.data[0];
+
+        // A packet sent again after a CTS is already in the buffer
+        if ((sequence != 0) && (sequence < transfer->nextPacket) &&
+            ((frame.timestamp_ms - transfer->lastFrame_ms) <= J1939_TP_TIMEOUT))
+            return false;
+
+        if ((sequence != transfer->nextPacket) || ((frame.timestamp_ms - transfer->lastFrame_ms) > J1939_TP_TIMEOUT))
+        {
+            if (debugMode)
+            {
+                Serial.print(F("J1939 transfer from "));
+                Serial.print(source, HEX);
+                Serial.println(F(" lost a packet"));
+            }
+
+            transfer->active = false;
+            return false;
+        }
+
+        uint16_t offset = (sequence - 1) * 7;
+
+        for (uint8_t i = 1; (i < frame.len) && ((offset + i - 1) < transfer->len); i++)
+            transfer->data[offset + i - 1] = frame.data[i];
+
+        transfer->nextPacket++;
+        transfer->lastFrame_ms = frame.timestamp_ms;
+
+        if (transfer->nextPacket <= transfer->numPackets)
+            return false;
+
+        transfer->active     = false;
+        message.pgn          = transfer->pgn;
+        message.source       = transfer->source;
+        message.priority     = transfer->priority;
+        message.len          = transfer->len;
+        message.data         = transfer->data;
+        message.timestamp_ms = frame.timestamp_ms;
+
+        return true;
+    }
+
+    message.pgn          = pgn;
+    message.source       = source;
+    message.priority     = priority;
+    message.len          = frame.len;
+    message.data         = frame.data;
+    message.timestamp_ms = frame.timestamp_ms;
+
+    return true;
 }
 
 /*
- uint8_t ELM327::emissionRqmts()
+ uint8_t ELM327::decodeSPNs(const j1939Message& message, sampledValue values[])
 
  Description:
  ------------
-  *  Find emission requirements to which vehicle is designed
+  * Decodes the SPNs of spnTable a message carries. Values the sender marks as not
+    available or erroneous (raw values above 0xFA, 0xFAFF or 0xFAFFFFFF) are skipped.
+    fixedValue is the raw value, value is raw * scale + offset (not updated if ELM_FIXED_POINT)
 
  Inputs:
  -------
-  * void
+  * j1939Message message - Message to decode, i.e. from processJ1939Frame()
+  * sampledValue values[] - NUM_J1939_SPNS values, indexed by J1939_XXX (i.e. J1939_ENGINE_SPEED)
 
  Return:
  -------
-  * uint8_t - Bit encoded (?)
+  * uint8_t - Number of values updated
 */
-uint8_t ELM327::emissionRqmts()
+uint8_t ELM327::decodeSPNs(const j1939Message& message, sampledValue values[])
 {
-    return (uint8_t)processPID(SERVICE_01, EMISSION_REQUIREMENTS, 1, 1);
+    uint8_t decoded = 0;
+
+    for (uint8_t i = 0; i < NUM_J1939_SPNS; i++)
+    {
+        spnDescriptor descriptor;
+        memcpy_P(&descriptor, &spnTable[i], sizeof(spnDescriptor));
+
+        if ((descriptor.pgn != message.pgn) || ((descriptor.startByte + descriptor.numBytes) > message.len))
+            continue;
+
+        uint32_t raw = 0;
+
+        for (uint8_t j = 0; j < descriptor.numBytes; j++)
+            raw |= (uint32_t)message.data[descriptor.startByte + j] << (8 * j);
+
+        // The top byte of a parameter above 0xFA means "error" or "not available"
+        if ((raw >> (8 * (descriptor.numBytes - 1))) > 0xFA)
+            continue;
+
+        values[i].fixedValue = raw;
+#if !ELM_FIXED_POINT
+        values[i].value      = raw * descriptor.scale + descriptor.offset;
+#endif
+        recordSample(values[i], message.timestamp_ms);
+        decoded++;
+    }
+
+    return decoded;
 }
 
 /*
- uint32_t ELM327::supportedPIDs_61_80()
+ uint8_t ELM327::parseDM1(const j1939Message& message, j1939DTC dtcs[], const uint8_t& maxDtcs, uint16_t& lamps)
 
  Description:
  ------------
-  * Determine which of PIDs 0x61 through 0x80 are supported (bit encoded)
+  * Parses the active faults of a DM1 message (PGN J1939_PGN_DM1). A DM1 without faults
+    holds a single all zero DTC
 
  Inputs:
  -------
-  * void
+  * j1939Message message - DM1 message, i.e. from processJ1939Frame()
+  * j1939DTC dtcs[]      - Set to the faults
+  * uint8_t maxDtcs      - Size of dtcs
+  * uint16_t& lamps      - Set to the lamp status bytes (byte 1 in the low byte)
 
  Return:
  -------
-  * uint32_t - Bit encoded booleans of supported PIDs 0x61-0x80
+  * uint8_t - Number of faults found, up to maxDtcs
 */
-uint32_t ELM327::supportedPIDs_61_80()
+uint8_t ELM327::parseDM1(const j1939Message& message, j1939DTC dtcs[], const uint8_t& maxDtcs, uint16_t& lamps)
 {
-    return (uint32_t)processPID(SERVICE_01, SUPPORTED_PIDS_61_80, 1, 4);
+    uint8_t numDtcs = 0;
+
+    if ((message.pgn != J1939_PGN_DM1) || (message.len < 2))
+        return 0;
+
+    lamps = message.data[0] | (message.data[1] << 8);
+
+    for (uint16_t i = 2; ((i + 3) < message.len) && (numDtcs < maxDtcs); i += 4)
+    {
+        const uint8_t* dtc = message.data + i;
+        uint32_t       spn = dtc[0] | (dtc[1] << 8) | ((uint32_t)(dtc[2] & 0xE0) << 11);
+        uint8_t        fmi = dtc[2] & 0x1F;
+
+        // No fault, or padding of the last packet
+        if (((spn == 0) && (fmi == 0)) || (spn == 0x7FFFF))
+            continue;
+
+        dtcs[numDtcs].spn         = spn;
+        dtcs[numDtcs].fmi         = fmi;
+        dtcs[numDtcs].occurrences = dtc[3] & 0x7F;
+        numDtcs++;
+    }
+
+    return numDtcs;
 }
 
 /*
- float ELM327::demandedTorque()
+ void ELM327::requestPGN(const uint32_t& pgn, j1939Message& message)
 
  Description:
  ------------
-  *  Find driver's demanded engine torque in %
+  * Non-blocking J1939 request of a PGN (PGN 59904 sent by the ELM327). Call it until
+    nb_rx_state isn't ELM_GETTING_MSG. On success, message holds the data of the first
+    response, decoded into responseData. Headers are off, so the source address isn't
+    known (0xFF). Uses the "AT JE" data format (the default): the PGN is sent MSB first
+    and reversed by the ELM327
 
  Inputs:
  -------
-  * void
+  * uint32_t pgn         - PGN to request
+  * j1939Message message - Set to the response
 
  Return:
  -------
-  * float - Driver's demanded engine torque in %
+  * void
 */
-float ELM327::demandedTorque()
+void ELM327::requestPGN(const uint32_t& pgn, j1939Message& message)
 {
-    return processPID(SERVICE_01, DEMANDED_ENGINE_PERCENT_TORQUE, 1, 1, 1, -125.0);
+    char command[9] = {'\0'};
+
+    if (nb_query_state == SEND_COMMAND)
+    {
+        snprintf(command, sizeof(command), "%06lX", (unsigned long)pgn);
+        sendCommand(command);
+        nb_query_state = WAITING_RESP;
+    }
+    else if (nb_query_state == WAITING_RESP)
+    {
+        get_response();
+
+        if (nb_rx_state == ELM_SUCCESS)
+        {
+            nb_query_state = SEND_COMMAND; // Reset the query state machine for next command
+
+            // Responses of several ECUs follow each other in payload - keep the first frame
+            decodeResponseData(payload, (recBytes < (MONITOR_MAX_DATA * 2)) ? recBytes : (MONITOR_MAX_DATA * 2));
+
+            message.pgn          = pgn;
+            message.source       = 0xFF;
+            message.priority     = 0;
+            message.len          = responseDataLen;
+            message.data         = responseData;
+            message.timestamp_ms = millis();
+        }
+        else if (nb_rx_state != ELM_GETTING_MSG)
+            nb_query_state = SEND_COMMAND; // Error or timeout, so reset the query state machine for next command
+    }
 }
 
 /*
- float ELM327::torque()
+ uint32_t ELM327::j1939PGN(const uint32_t& id)
 
  Description:
  ------------
-  *  Find actual engine torque in %
+  * Extracts the PGN from a 29-bit J1939 CAN ID. The destination address of PDU1 messages
+    (PDU format below 240) isn't part of the PGN
 
  Inputs:
  -------
-  * void
+  * uint32_t id - 29-bit CAN ID
 
  Return:
  -------
-  * float - Actual engine torque in %
+  * uint32_t - PGN
 */
-float ELM327::torque()
+uint32_t ELM327::j1939PGN(const uint32_t& id)
 {
-    return processPID(SERVICE_01, ACTUAL_ENGINE_TORQUE, 1, 1, 1, -125.0);
+    uint32_t pgn = (id >> 8) & 0x3FFFF;
+
+    if ((pgn & 0xFF00) < 0xF000)
+        pgn &= 0x3FF00;
+
+    return pgn;
 }
 
 /*
- uint16_t ELM327::referenceTorque()
+ uint8_t ELM327::planMonitorFilters(const uint32_t ids[], const uint8_t& numIds, const bool& extended, monitorWindow windows[], const uint8_t& maxWindows, const uint32_t busIds[], const uint16_t& numBusIds)
 
  Description:
  ------------
-  *  Find engine reference torque in Nm
+  * Finds the "AT CF"/"AT CM" filter/mask pairs that pass the given CAN IDs with the least
+    extra traffic. The ELM327 only holds one pair, so with more than one window the monitor
+    has to be restarted with each of them in turn (see startMonitor(canFrame[], uint8_t,
+    monitorWindow))
+
+  * Each ID starts in its own window. The two windows whose merged filter lets the least
+    extra traffic through are merged until at most maxWindows are left - windows are also
+    merged while it costs nothing (i.e. 7E8 and 7E9 become 7E8/7FE)
+
+  * Extra traffic is measured with busIds: the IDs of frames sampled from the bus without a
+    filter (repeats weight the busy IDs). Ties, and plans without a sample, go to the windows
+    that pass the fewest possible IDs - as if every ID was on the bus at the same rate
 
  Inputs:
  -------
-  * void
+  * uint32_t ids[]      - CAN IDs to pass
+  * uint8_t numIds      - Number of IDs, up to FILTER_PLAN_MAX_IDS
+  * bool extended       - Whether the IDs are 29-bit
+  * monitorWindow windows[] - Set to the planned windows
+  * uint8_t maxWindows  - Size of windows
+  * uint32_t busIds[]   - IDs of sampled bus frames, nullptr if unknown
+  * uint16_t numBusIds  - Number of sampled frames
 
  Return:
  -------
-  * uint16_t - Engine reference torque in Nm
+  * uint8_t - Number of windows planned, 0 if the IDs are invalid
 */
-uint16_t ELM327::referenceTorque()
+uint8_t ELM327::planMonitorFilters(const uint32_t  ids[],
+                                   const uint8_t&  numIds,
+                                   const bool&     extended,
+                                   monitorWindow   windows[],
+                                   const uint8_t&  maxWindows,
+                                   const uint32_t  busIds[],
+                                   const uint16_t& numBusIds)
 {
-    return processPID(SERVICE_01, ENGINE_REFERENCE_TORQUE, 1, 2);
+    uint32_t idMask = extended ? 0x1FFFFFFF : 0x7FF;
+    uint32_t andBits[FILTER_PLAN_MAX_IDS];
+    uint32_t orBits[FILTER_PLAN_MAX_IDS];
+    uint32_t space[FILTER_PLAN_MAX_IDS];   // Possible IDs the window passes
+    uint32_t traffic[FILTER_PLAN_MAX_IDS]; // Sampled frames the window passes
+    uint8_t  groupIds[FILTER_PLAN_MAX_IDS];
+    uint8_t  numGroups = numIds;
+
+    if (!ids || !windows || (numIds == 0) || (numIds > FILTER_PLAN_MAX_IDS) || (maxWindows == 0))
+        return 0;
+
+    if (numBusIds == 0)
+        busIds = nullptr;
+
+    for (uint8_t i = 0; i < numIds; i++)
+    {
+        if (ids[i] & ~idMask)
+            return 0;
+
+        andBits[i]  = ids[i];
+        orBits[i]   = ids[i];
+        groupIds[i] = 1;
+        space[i]    = 1;
+        traffic[i]  = filterTraffic(andBits[i], orBits[i], idMask, busIds, numBusIds);
+    }
+
+    while (numGroups > 1)
+    {
+        uint8_t  bestA       = 0;
+        uint8_t  bestB       = 0;
+        uint32_t bestSpace   = 0;
+        uint32_t bestTraffic = 0;
+        int64_t  bestDelta   = 0;
+        bool     found       = false;
+
+        for (uint8_t a = 0; a < numGroups; a++)
+        {
+            for (uint8_t b = a + 1; b < numGroups; b++)
+            {
+                uint32_t mergedAnd     = andBits[a] & andBits[b];
+                uint32_t mergedOr      = orBits[a] | orBits[b];
+                uint32_t mergedSpace   = 1UL << countBits(mergedAnd ^ mergedOr);
+                uint32_t mergedTraffic = filterTraffic(mergedAnd, mergedOr, idMask, busIds, numBusIds);
+
+                // Sampled traffic first, the number of possible IDs breaks ties
+                int64_t delta = (((int64_t)mergedTraffic - traffic[a] - traffic[b]) << 31) +
+                                ((int64_t)mergedSpace - space[a] - space[b]);
+
+                if (!found || (delta < bestDelta))
+                {
+                    found       = true;
+                    bestA       = a;
+                    bestB       = b;
+                    bestSpace   = mergedSpace;
+                    bestTraffic = mergedTraffic;
+                    bestDelta   = delta;
+                }
+            }
+        }
+
+        if ((bestDelta > 0) && (numGroups <= maxWindows))
+            break;
+
+        andBits[bestA]  &= andBits[bestB];
+        orBits[bestA]   |= orBits[bestB];
+        groupIds[bestA] += groupIds[bestB];
+        space[bestA]     = bestSpace;
+        traffic[bestA]   = bestTraffic;
+
+        numGroups--;
+        andBits[bestB]  = andBits[numGroups];
+        orBits[bestB]   = orBits[numGroups];
+        groupIds[bestB] = groupIds[numGroups];
+        space[bestB]    = space[numGroups];
+        traffic[bestB]  = traffic[numGroups];
+    }
+
+    for (uint8_t i = 0; i < numGroups; i++)
+    {
+        windows[i].mask      = idMask & ~(andBits[i] ^ orBits[i]);
+        windows[i].filter    = andBits[i] & windows[i].mask;
+        windows[i].extended  = extended;
+        windows[i].numIds    = groupIds[i];
+        windows[i].passRatio = busIds ? ((float)traffic[i] / numBusIds) : (space[i] / (idMask + 1.0));
+
+        if (debugMode)
+        {
+            Serial.print(F("Monitor window: AT CF "));
+            Serial.print(windows[i].filter, HEX);
+            Serial.print(F(", AT CM "));
+            Serial.print(windows[i].mask, HEX);
+            Serial.print(F(" - "));
+            Serial.print(windows[i].numIds);
+            Serial.print(F(" ID(s), pass ratio "));
+            Serial.println(windows[i].passRatio, 4);
+        }
+    }
+
+    return numGroups;
 }
 
 /*
- uint16_t ELM327::auxSupported()
+ uint32_t ELM327::filterTraffic(const uint32_t& andBits, const uint32_t& orBits, const uint32_t& idMask, const uint32_t busIds[], const uint16_t& numBusIds)
 
  Description:
  ------------
-  *  Find auxiliary input/output supported
+  * Counts the sampled bus frames the filter/mask pair covering a group of IDs passes
 
  Inputs:
  -------
-  * void
+  * uint32_t andBits   - Bitwise AND of the IDs of the group
+  * uint32_t orBits    - Bitwise OR of the IDs of the group
+  * uint32_t idMask    - 0x7FF for 11-bit IDs, 0x1FFFFFFF for 29-bit IDs
+  * uint32_t busIds[]  - IDs of sampled bus frames, nullptr if unknown
+  * uint16_t numBusIds - Number of sampled frames
 
  Return:
  -------
-  * uint16_t - Bit encoded (?)
+  * uint32_t - Number of sampled frames that pass, 0 without a sample
 */
-uint16_t ELM327::auxSupported()
+uint32_t ELM327::filterTraffic(const uint32_t& andBits,
+                               const uint32_t& orBits,
+                               const uint32_t& idMask,
+                               const uint32_t  busIds[],
+                               const uint16_t& numBusIds)
 {
-    return (uint16_t)processPID(SERVICE_01, AUX_INPUT_OUTPUT_SUPPORTED, 1, 2);
+    uint32_t mask   = idMask & ~(andBits ^ orBits);
+    uint32_t filter = andBits & mask;
+    uint32_t count  = 0;
+
+    for (uint16_t i = 0; busIds && (i < numBusIds); i++)
+    {
+        if ((busIds[i] & mask) == filter)
+            count++;
+    }
+
+    return count;
 }
 
 /*
- void ELM327::sendCommand(const char *cmd)
+ uint8_t ELM327::countBits(uint32_t value)
 
  Description:
  ------------
-  * Sends a command/query for Non-Blocking PID queries
+  * Counts the set bits of a value
 
  Inputs:
  -------
-  * const char *cmd - Command/query to send to ELM327
+  * uint32_t value - Value to count the bits of
 
  Return:
  -------
-  * void
+  * uint8_t - Number of set bits
 */
-void ELM327::sendCommand(const char *cmd)
+uint8_t ELM327::countBits(uint32_t value)
 {
-    // clear payload buffer
-    memset(payload, '\0', PAYLOAD_LEN + 1);
-
-    // reset input serial buffer and number of received bytes
-    recBytes = 0;
-    flushInputBuff();
-    connected = false;
+    uint8_t count = 0;
 
-    // Reset the receive state ready to start receiving a response message
-    nb_rx_state = ELM_GETTING_MSG;
-
-    if (debugMode)
+    while (value)
     {
-        Serial.print(F("Sending the following command/query: "));
-        Serial.println(cmd);
+        value &= value - 1;
+        count++;
     }
 
-    elm_port->print(cmd);
-    elm_port->print('\r');
-
-    // prime the timeout timer
-    previousTime = millis();
-    currentTime = previousTime;
+    return count;
 }
 
 /*
- obd_rx_states ELM327::sendCommand_Blocking(const char* cmd)
+ bool ELM327::isMonitoring()
 
  Description:
  ------------
-    * Sends a command/query and waits for a respoonse (blocking function)
-    Sometimes it's desirable to use a blocking command, e.g when sending an AT command.
-    This function removes the need for the caller to set up a loop waiting for the command to finish.
-    Caller is free to parse the payload string if they need to use the response.
+  * Checks if the ELM327 is monitoring. It stops on its own when its internal buffer
+    overflows ("BUFFER FULL") - call stopMonitor() to restore command mode either way
 
  Inputs:
  -------
-  * const char *cmd - Command/query to send to ELM327
+  * void
 
  Return:
  -------
-  * int8_t - the ELM_XXX status of getting the OBD response
+  * bool - Whether or not frames are being received
 */
-int8_t ELM327::sendCommand_Blocking(const char *cmd)
+bool ELM327::isMonitoring()
 {
-    sendCommand(cmd);
-    uint32_t startTime = millis();
-    while (get_response() == ELM_GETTING_MSG) {
-        if (millis() - startTime > timeout_ms) break;
-    }
-    return nb_rx_state;
+    return monitoring && !monitorStopped;
 }
 
 /*
- obd_rx_states ELM327::get_response(void)
+ bool ELM327::monitorChar(const char& recChar)
 
  Description:
  ------------
-  * Non Blocking (NB) receive OBD scanner response. Must be called repeatedly until
-    the status progresses past ELM_GETTING_MSG.
+  * Adds a received char to the monitor line, parsing the line into a frame at its end
 
  Inputs:
  -------
-  * void
+  * char recChar - Received char
 
  Return:
  -------
-  * int8_t - the ELM_XXX status of getting the OBD response
+  * bool - Whether or not a frame was put in the ring buffer
 */
-int8_t ELM327::get_response(void)
+bool ELM327::monitorChar(const char& recChar)
 {
-    // buffer the response of the ELM327 until either the
-    // end marker is read or a timeout has occurred
-    // last valid idx is PAYLOAD_LEN but want to keep one free for terminating '\0'
-    // so limit counter to < PAYLOAD_LEN
-    if (!elm_port->available())
+    bool queued = false;
+
+    if (recChar == '>')
+        monitorStopped = true;
+    else if ((recChar == '\r') || (recChar == '\n'))
     {
-        nb_rx_state = ELM_GETTING_MSG;
-        if (timeout())
-            nb_rx_state = ELM_TIMEOUT;
+        if (monitorLineLen || monitorLineBad)
+            queued = queueMonitorLine();
     }
     else
     {
-        char recChar = elm_port->read();
-
-        if (debugMode)
-        {
-            Serial.print(F("\tReceived char: "));
-            // display each received character, make non-printables printable
-            if (recChar == '\f')
-                Serial.println(F("\\f"));
-            else if (recChar == '\n')
-                Serial.println(F("\\n"));
-            else if (recChar == '\r')
-                Serial.println(F("\\r"));
-            else if (recChar == '\t')
-                Serial.println(F("\\t"));
-            else if (recChar == '\v')
-                Serial.println(F("\\v"));
-            // convert spaces to underscore, easier to see in debug output
-            else if (recChar == ' ')
-                Serial.println(F("_"));
-            // display regular printable
-            else
-                Serial.println(recChar);
-        }
-
-        // this is the end of the OBD response
-        if (recChar == '>')
+        // Spaces are only received if "AT S1" was sent by the user
+        if (recChar != ' ')
         {
-            if (debugMode)
-                Serial.println(F("Delimiter found."));
+            uint8_t value = pgm_read_byte(&HEX_DIGIT_VALUES[(uint8_t)recChar]);
 
-            nb_rx_state = ELM_MSG_RXD;
-        }
-        else if (!isalnum(recChar) && (recChar != ':') && (recChar != '.') && (recChar != '\r'))
-            // Keep only alphanumeric, decimal, colon, CR. These are needed for response parsing
-            // decimal places needed to extract floating point numbers, e.g. battery voltage
-            nb_rx_state = ELM_GETTING_MSG; // Discard this character
-        else
-        {
-            if (recBytes < PAYLOAD_LEN)
-            {
-                payload[recBytes] = recChar;
-                recBytes++;
-                nb_rx_state = ELM_GETTING_MSG;
-            }
+            if ((value > 0xF) || (monitorLineLen >= MONITOR_LINE_LEN))
+                monitorLineBad = true;
             else
-                nb_rx_state = ELM_BUFFER_OVERFLOW;
+                monitorLine[monitorLineLen++] = value;
         }
+
+        return false;
     }
 
-    // Message is still being received (or is timing out), so exit early without doing all the other checks
-    if (nb_rx_state == ELM_GETTING_MSG)
-        return nb_rx_state;
+    monitorLineLen = 0;
+    monitorLineBad = false;
 
-    // End of response delimiter was found
-    if (debugMode && nb_rx_state == ELM_MSG_RXD)
-    {
-        Serial.print(F("All chars received: "));
-        Serial.println(payload);
-    }
+    return queued;
+}
 
-    if (nb_rx_state == ELM_TIMEOUT)
-    {
-        if (debugMode)
-        {
-            Serial.print(F("Timeout detected with overflow of "));
-            Serial.print((currentTime - previousTime) - timeout_ms);
-            Serial.println(F("ms"));
-        }
-        return nb_rx_state;
-    }
+/*
+ bool ELM327::queueMonitorLine()
 
-    if (nb_rx_state == ELM_BUFFER_OVERFLOW)
-    {
-        if (debugMode)
-        {
-            Serial.print(F("OBD receive buffer overflow (> "));
-            Serial.print(PAYLOAD_LEN);
-            Serial.println(F(" bytes)"));
-        }
-        return nb_rx_state;
-    }
+ Description:
+ ------------
+  * Parses a complete monitor line (hex digit values in monitorLine) into a frame at the
+    head of the ring buffer. The ID is 6 hex chars (3 header bytes) on non-CAN protocols.
+    On CAN, data bytes are whole, so an odd number of chars means an 11-bit ID (3 chars),
+    an even number a 29-bit ID (8 chars)
 
-    // Now we have successfully received OBD response, check if the payload indicates any OBD errors
-    if (nextIndex(payload, RESPONSE_UNABLE_TO_CONNECT) >= 0)
-    {
-        if (debugMode)
-            Serial.println(F("ELM responded with error \"UNABLE TO CONNECT\""));
+ Inputs:
+ -------
+  * void
 
-        nb_rx_state = ELM_UNABLE_TO_CONNECT;
-        return nb_rx_state;
-    }
+ Return:
+ -------
+  * bool - Whether or not a frame was put in the ring buffer
+*/
+bool ELM327::queueMonitorLine()
+{
+    uint8_t idChars;
 
-    connected = true;
+    if (activeProtocol >= ISO_15765_11_BIT_500_KBAUD)
+        idChars = (monitorLineLen % 2) ? 3 : 8;
+    else
+        idChars = 6;
 
-    if (nextIndex(payload, RESPONSE_NO_DATA) >= 0)
+    if (monitorLineBad || (monitorLineLen < idChars) || ((monitorLineLen - idChars) % 2) ||
+        ((monitorLineLen - idChars) > (MONITOR_MAX_DATA * 2)))
     {
-        if (debugMode)
-            Serial.println(F("ELM responded with error \"NO DATA\""));
-
-        nb_rx_state = ELM_NO_DATA;
-        return nb_rx_state;
+        Monitor_Stats.badLines++;
+        return false;
     }
 
-    if (nextIndex(payload, RESPONSE_STOPPED) >= 0)
-    {
-        if (debugMode)
-            Serial.println(F("ELM responded with error \"STOPPED\""));
+    uint8_t head = monitorHead;
+    uint8_t next = (head + 1) % monitorSize;
 
-        nb_rx_state = ELM_STOPPED;
-        return nb_rx_state;
+    if (next == __atomic_load_n(&monitorTail, __ATOMIC_ACQUIRE))
+    {
+        Monitor_Stats.dropped++;
+        return false;
     }
 
-    if (nextIndex(payload, RESPONSE_ERROR) >= 0)
-    {
-        if (debugMode)
-            Serial.println(F("ELM responded with \"ERROR\""));
+    canFrame& frame = monitorFrames[head];
+    uint8_t   len   = (monitorLineLen - idChars) / 2; // At most MONITOR_MAX_DATA, checked above
 
-        nb_rx_state = ELM_GENERAL_ERROR;
-        return nb_rx_state;
-    }
+    frame.id           = 0;
+    frame.timestamp_ms = millis();
+    frame.extended     = (idChars == 8);
+    frame.len          = len;
+
+    for (uint8_t i = 0; i < idChars; i++)
+        frame.id = (frame.id << 4) | monitorLine[i];
 
-    nb_rx_state = ELM_SUCCESS;
-    // Need to process multiline repsonses, remove '\r' from non multiline resp
-    if (NULL != strchr(payload, ':')) {
-        parseMultiLineResponse();
-    } 
-    else {
-        removeChar(payload, " \r");
-    }
-    recBytes = strlen(payload); 
-    return nb_rx_state;
+    for (uint8_t i = 0; (i < len) && (i < MONITOR_MAX_DATA); i++)
+        frame.data[i] = (monitorLine[idChars + i * 2] << 4) | monitorLine[idChars + i * 2 + 1];
+
+    // Publish the frame only once it's complete - readFrame() may be reading concurrently
+    __atomic_store_n(&monitorHead, next, __ATOMIC_RELEASE);
+    Monitor_Stats.frames++;
+
+    return true;
 }
 
 /*
- void ELM327::parseMultilineResponse()
- 
+ bool ELM327::setSignalTable(const canMessage messages[], const uint8_t& numMessages, const canSignal signals[], sampledValue values[])
+
  Description:
  ------------
-  * Parses a buffered multiline response into a single line with the specified data
-  * Modifies the value of payload for further processing and removes the '\r' chars
+  * Sets the signal definitions decodeFrame() uses, i.e. as generated from a DBC file by
+    extras/dbc2elmduino.py. The tables aren't copied - they must stay valid while in use.
+    The CAN IDs are hashed into a fixed size index, so looking a frame's ID up doesn't
+    depend on the size of the table. An 11-bit and a 29-bit message may have the same ID
 
  Inputs:
  -------
-  * void
+  * canMessage messages[] - CAN IDs and their signals, nullptr to clear the table
+  * uint8_t numMessages   - Number of messages, up to SIGNAL_MAX_MESSAGES
+  * canSignal signals[]   - Signal definitions of all messages
+  * sampledValue values[] - Decoded values, one per signal (same index as signals[])
 
  Return:
  -------
-  * void
+  * bool - Whether or not the table is valid and in use
 */
-void ELM327::parseMultiLineResponse() {
-    uint8_t totalBytes = 0;
-    uint8_t bytesReceived = 0;
-    char newResponse[PAYLOAD_LEN];
-    memset(newResponse, 0, PAYLOAD_LEN * sizeof(char)); // Initialize newResponse to empty string
-    char line[256] = "";
-    char* start = payload;
-    char* end = strchr(start, '\r');
-  
-   do 
-    {   //Step 1: Get a line from the response
-        memset(line, '\0', 256); 
-        if (end != NULL) {
-            strncpy(line, start, end - start);
-            line[end - start] = '\0';
-        } else {
-            strncpy(line, start, strlen(start));
-            line[strlen(start)] = '\0';
-    
-            // Exit when there's no more data
-            if (strlen(line) == 0) break;
+bool ELM327::setSignalTable(const canMessage   messages[],
+                            const uint8_t&     numMessages,
+                            const canSignal    signals[],
+                            sampledValue       values[])
+{
+    signalMessages = nullptr;
+    memset(signalIndex, 0, sizeof(signalIndex));
+
+    if (!messages || !signals || !values || (numMessages > SIGNAL_MAX_MESSAGES))
+        return false;
+
+    for (uint8_t i = 0; i < numMessages; i++)
+    {
+        for (uint8_t j = 0; j < messages[i].numSignals; j++)
+        {
+            const canSignal& signal = signals[messages[i].firstSignal + j];
+
+            if ((signal.length == 0) || (signal.length > 32) || ((signal.shift + signal.length) > 64))
+                return false;
+
+            memset(&values[messages[i].firstSignal + j], 0, sizeof(sampledValue));
         }
-    
-        if (debugMode) {
-            Serial.print(F("Found line in response: "));
-            Serial.println(line);
-        }
-        // Step 2: Check if this is the first line of the response
-        if (0 == totalBytes)
-        // Some devices return the response header in the first line instead of the data length, ignore this line
-        // Line containing totalBytes indicator is 3 hex chars only, longer first line will be a header.
-        { 
-            if (strlen(line) > 3) {
-                if (debugMode)
-                {
-                    Serial.print(F("Found header in response line: "));
-                    Serial.println(line); 
-                }
-            }
-            else {
-                if (strlen(line) > 0) {
-                    totalBytes = strtol(line, NULL, 16) * 2;
-                    if (debugMode) {
-                        Serial.print(F("totalBytes = "));
-                        Serial.println(totalBytes);
-                    }
-                }
-            }
-        } 
-        // Step 3: Process data response lines 
-        else { 
-            if (strchr(line, ':')) {
-                char* dataStart = strchr(line, ':') + 1;
-                uint8_t dataLength = strlen(dataStart);
-                uint8_t bytesToCopy = (bytesReceived + dataLength > totalBytes) ? (totalBytes - bytesReceived) : dataLength;
-                if (bytesReceived + bytesToCopy > PAYLOAD_LEN - 1) {
-                    bytesToCopy = (PAYLOAD_LEN - 1) - bytesReceived;
-                }
-                strncat(newResponse, dataStart, bytesToCopy);
-                bytesReceived += bytesToCopy;
 
-                if (debugMode) {
-                    Serial.print(F("Response data: "));
-                    Serial.println(dataStart);
-                }
+        // Open addressing - the index is at most half full, so probing stays short
+        uint8_t slot = signalSlot(messages[i].id);
+
+        while (signalIndex[slot])
+        {
+            const canMessage& other = messages[signalIndex[slot] - 1];
+
+            if ((other.id == messages[i].id) && (other.extended == messages[i].extended))
+            {
+                memset(signalIndex, 0, sizeof(signalIndex));
+                return false;
             }
-        }
-        if (*(end + 1) == '\0') {  
-            start = NULL;  
-        } else {
-            start = end + 1;
-        }
-        end = (start != NULL) ? strchr(start, '\r') : NULL;
 
-    } while ((bytesReceived < totalBytes || 0 == totalBytes) && start != NULL);
+            slot = (slot + 1) % SIGNAL_INDEX_SLOTS;
+        }
 
-    // Replace payload with parsed response, null-terminate after totalBytes
-    int nullTermPos = (totalBytes < PAYLOAD_LEN - 1) ? totalBytes : PAYLOAD_LEN - 1;
-    strncpy(payload, newResponse, nullTermPos);
-    payload[nullTermPos] = '\0'; // Ensure null termination
-    if (debugMode) 
-    {
-        Serial.print(F("Parsed multiline response: "));
-        Serial.println(payload);
+        signalIndex[slot] = i + 1;
     }
-}
 
+    signalMessages = messages;
+    signalTable    = signals;
+    signalValues   = values;
+
+    return true;
+}
 
 /*
- uint64_t ELM327::findResponse(const uint8_t& service, const uint8_t& pid)
+ uint8_t ELM327::decodeFrame(const canFrame& frame)
 
  Description:
  ------------
-  * Parses the buffered ELM327's response and returns the queried data
+  * Decodes all signals of a frame into their sampledValue (see setSignalTable()). The
+    data bytes are assembled into a 64-bit word once per byte order, then each signal is
+    a shift and a mask. fixedValue is the raw (sign extended) signal value, value is
+    raw * scale + offset (not updated if ELM_FIXED_POINT). lastUpdate is the frame's
+    timestamp. Bits past the end of a short frame read as 0
 
  Inputs:
  -------
-  * const uint8_t& service - The diagnostic service ID. 01 is "Show current data"
-  * const uint8_t& pid     - The Parameter ID (PID) from the service
+  * canFrame frame - Frame to decode, i.e. from readFrame()
 
  Return:
  -------
-  * void
+  * uint8_t - Number of signals decoded, 0 if the frame's ID isn't in the table
 */
-uint64_t ELM327::findResponse()
+uint8_t ELM327::decodeFrame(const canFrame& frame)
 {
-    uint8_t firstDatum = 0;
-    char header[7] = {'\0'};
+    if (!signalMessages)
+        return 0;
 
-    if (longQuery)
-    {
-        header[0] = query[0] + 4;
-        header[1] = query[1];
-        header[2] = query[2];
-        header[3] = query[3];
-        header[4] = query[4];
-        header[5] = query[5];
-    }
-    else
-    {
-        header[0] = query[0] + 4;
-        header[1] = query[1];
+    uint8_t slot = signalSlot(frame.id);
 
-        if (isMode0x22Query) // mode 0x22 responses always zero-pad the pid to 4 chars, even for a 2-char pid
-        {
-            header[2] = '0';
-            header[3] = '0';
-            header[4] = query[2];
-            header[5] = query[3];
-        }
-        else
-        {
-            header[2] = query[2];
-            header[3] = query[3];
-        }
-    }
+    while (signalIndex[slot] &&
+           ((signalMessages[signalIndex[slot] - 1].id != frame.id) || (signalMessages[signalIndex[slot] - 1].extended != frame.extended)))
+        slot = (slot + 1) % SIGNAL_INDEX_SLOTS;
 
-    if (debugMode)
+    if (!signalIndex[slot])
+        return 0;
+
+    const canMessage& message  = signalMessages[signalIndex[slot] - 1];
+    uint64_t          intel    = 0;
+    uint64_t          motorola = 0;
+
+    for (uint8_t i = 0; (i < frame.len) && (i < MONITOR_MAX_DATA); i++)
     {
-        Serial.print(F("Expected response header: "));
-        Serial.println(header);
+        intel    |= (uint64_t)frame.data[i] << (8 * i);
+        motorola |= (uint64_t)frame.data[i] << (56 - 8 * i);
     }
 
-    int8_t firstHeadIndex  = nextIndex(payload, header, 1);
-    int8_t secondHeadIndex = nextIndex(payload, header, 2);
-
-    if (firstHeadIndex >= 0)
+    for (uint8_t i = 0; i < message.numSignals; i++)
     {
-        if (longQuery | isMode0x22Query)
-            firstDatum = firstHeadIndex + 6;
-        else
-            firstDatum = firstHeadIndex + 4;
+        const canSignal& signal = signalTable[message.firstSignal + i];
+        sampledValue&    sample = signalValues[message.firstSignal + i];
 
-        // Some ELM327s (such as my own) respond with two
-        // "responses" per query. "numPayChars" represents the
-        // correct number of bytes returned by the ELM327
-        // regardless of how many "responses" were returned
-        if (secondHeadIndex >= 0)
-        {
-            if (debugMode)
-                Serial.println(F("Double response detected"));
+        uint64_t word    = (signal.flags & SIGNAL_BIG_ENDIAN) ? motorola : intel;
+        uint32_t raw     = (uint32_t)(word >> signal.shift) & (0xFFFFFFFFUL >> (32 - signal.length));
 
-            numPayChars = secondHeadIndex - firstDatum;
-        }
-        else
-        {
-            if (debugMode)
-                Serial.println(F("Single response detected"));
+        // Sign extension without a branch - signBit is 0 for unsigned signals
+        uint32_t signBit = (uint32_t)((signal.flags & SIGNAL_SIGNED) ? 1 : 0) << (signal.length - 1);
+        int64_t  value   = (int64_t)(raw ^ signBit) - signBit;
 
-            numPayChars = strlen(payload) - firstDatum;
-        }
+        sample.fixedValue = value;
+#if !ELM_FIXED_POINT
+        sample.value      = value * signal.scale + signal.offset;
+#endif
+        recordSample(sample, frame.timestamp_ms);
+    }
 
-        response = 0;
-        for (uint8_t i = 0; i < numPayChars; i++)
-        {
-            uint8_t payloadIndex = firstDatum + i;
-            uint8_t bitsOffset   = 4 * (numPayChars - i - 1);
+    return message.numSignals;
+}
 
-            if (debugMode)
-            {
-                Serial.print(F("\tProcessing hex nibble: "));
-                Serial.println(payload[payloadIndex]);
-            }
-            response = response | ((uint64_t)ctoi(payload[payloadIndex]) << bitsOffset);
-        }
+/*
+ uint8_t ELM327::decodeFrames()
 
-        // It is useful to have the response bytes
-        // broken-out because some PID algorithms (standard
-        // and custom) require special operations for each
-        // byte returned
+ Description:
+ ------------
+  * Takes all frames out of the monitor ring buffer and decodes their signals - see
+    readFrame() and decodeFrame()
 
-        responseByte_0 =  response        & 0xFF; 
-        responseByte_1 = (response >> 8)  & 0xFF;
-        responseByte_2 = (response >> 16) & 0xFF;
-        responseByte_3 = (response >> 24) & 0xFF;
-        responseByte_4 = (response >> 32) & 0xFF;
-        responseByte_5 = (response >> 40) & 0xFF;
-        responseByte_6 = (response >> 48) & 0xFF;
-        responseByte_7 = (response >> 56) & 0xFF;
+ Inputs:
+ -------
+  * void
 
-        if (debugMode)
-        {
-            Serial.println(F("64-bit response: "));
-            Serial.print(F("\tresponseByte_0: "));
-            Serial.println(responseByte_0);
-            Serial.print(F("\tresponseByte_1: "));
-            Serial.println(responseByte_1);
-            Serial.print(F("\tresponseByte_2: "));
-            Serial.println(responseByte_2);
-            Serial.print(F("\tresponseByte_3: "));
-            Serial.println(responseByte_3);
-            Serial.print(F("\tresponseByte_4: "));
-            Serial.println(responseByte_4);
-            Serial.print(F("\tresponseByte_5: "));
-            Serial.println(responseByte_5);
-            Serial.print(F("\tresponseByte_6: "));
-            Serial.println(responseByte_6);
-            Serial.print(F("\tresponseByte_7: "));
-            Serial.println(responseByte_7);
-        }
+ Return:
+ -------
+  * uint8_t - Number of frames with signals in the table
+*/
+uint8_t ELM327::decodeFrames()
+{
+    canFrame frame;
+    uint8_t  decoded = 0;
 
-        return response;
+    while (readFrame(frame))
+    {
+        if (decodeFrame(frame))
+            decoded++;
     }
 
-    if (debugMode)
-        Serial.println(F("Response not detected"));
+    return decoded;
+}
 
-    return 0;
+/*
+ uint8_t ELM327::signalSlot(const uint32_t& id)
+
+ Description:
+ ------------
+  * Hashes a CAN ID into the signal index (Fibonacci hashing)
+
+ Inputs:
+ -------
+  * uint32_t id - CAN ID
+
+ Return:
+ -------
+  * uint8_t - First slot of signalIndex to probe
+*/
+uint8_t ELM327::signalSlot(const uint32_t& id)
+{
+    // The top bits of the product depend on all bits of the ID
+    return (uint32_t)(id * 2654435761UL) >> (32 - SIGNAL_INDEX_BITS);
 }
 
 /*
- void ELM327::printError()
+ void ELM327::recordSample(sampledValue& sample, const uint32_t& now)
 
  Description:
  ------------
-  * Prints appropriate error description if an error has occurred
+  * Updates the sample count, time and measured rate of a value that was just sampled.
+    The value itself is set by the caller
 
  Inputs:
  -------
-  * void
+  * sampledValue& sample - Sampled value
+  * uint32_t now         - millis() of the sample
 
  Return:
  -------
   * void
 */
-void ELM327::printError()
+void ELM327::recordSample(sampledValue& sample, const uint32_t& now)
 {
-    Serial.print(F("Received: "));
-    Serial.println(payload);
+    if (sample.samples > 0)
+    {
+        uint32_t interval = now - sample.lastUpdate;
 
-    if (nb_rx_state == ELM_SUCCESS)
-        Serial.println(F("ELM_SUCCESS"));
-    else if (nb_rx_state == ELM_NO_RESPONSE)
-        Serial.println(F("ERROR: ELM_NO_RESPONSE"));
-    else if (nb_rx_state == ELM_BUFFER_OVERFLOW)
-        Serial.println(F("ERROR: ELM_BUFFER_OVERFLOW"));
-    else if (nb_rx_state == ELM_UNABLE_TO_CONNECT)
-        Serial.println(F("ERROR: ELM_UNABLE_TO_CONNECT"));
-    else if (nb_rx_state == ELM_NO_DATA)
-        Serial.println(F("ERROR: ELM_NO_DATA"));
-    else if (nb_rx_state == ELM_STOPPED)
-        Serial.println(F("ERROR: ELM_STOPPED"));
-    else if (nb_rx_state == ELM_TIMEOUT)
-        Serial.println(F("ERROR: ELM_TIMEOUT"));
-    else if (nb_rx_state == ELM_BUFFER_OVERFLOW)
-        Serial.println(F("ERROR: BUFFER OVERFLOW"));
-    else if (nb_rx_state == ELM_GENERAL_ERROR)
-        Serial.println(F("ERROR: ELM_GENERAL_ERROR"));
-    else
-        Serial.println(F("No error detected"));
+        if (sample.interval_ms == 0)
+            sample.interval_ms = interval;
+        else
+            sample.interval_ms += ((int32_t)interval - (int32_t)sample.interval_ms) / 8;
 
-    delay(100);
+#if !ELM_FIXED_POINT
+        if (interval > 0)
+        {
+            if (sample.achievedRate == 0)
+                sample.achievedRate = 1000.0 / interval;
+            else
+                sample.achievedRate += ((1000.0 / interval) - sample.achievedRate) / 8;
+        }
+#endif
+    }
+
+    sample.lastUpdate = now;
+    sample.samples++;
 }
 
 /*
@@ -2939,10 +7095,7 @@ float ELM327::batteryVoltage()
 */
 int8_t ELM327::get_vin_blocking(char vin[])
 {
-    char temp[3] = {0};
     char *idx;
-    uint8_t vin_counter = 0;
-    uint8_t ascii_val;
 
     if (debugMode)
         Serial.println(F("Getting VIN..."));
@@ -2951,7 +7104,6 @@ int8_t ELM327::get_vin_blocking(char vin[])
     while (get_response() == ELM_GETTING_MSG)
         ;
 
-    // strcpy(payload, "0140:4902013144341:475030305235352:42313233343536");
     if (nb_rx_state == ELM_SUCCESS)
     {
         memset(vin, 0, 18);
@@ -2964,23 +7116,13 @@ int8_t ELM327::get_vin_blocking(char vin[])
             // 1: 47 50 30 30 52 35 35    ==> 47->35 next 7 VIN digits
             // 2: 42 31 32 33 34 35 36    ==> 42->36 next 7 VIN digits
             //
-            // The resulitng payload buffer is:
-            // "0140:4902013144341:475030305235352:42313233343536" ==> VIN="1D4GP00R55B123456" (17-digits)
+            // which the streaming parser reassembles into the payload:
+            // "4902013144344750303052353542313233343536" ==> VIN="1D4GP00R55B123456" (17-digits)
             idx = strstr(payload, "490201") + 6; // Pointer to first ASCII code digit of first VIN digit
-            // Loop over each pair of ASCII code digits. 17 VIN digits + 2 skipped line numbers = 19 loops
-            for (int i = 0; i < (19 * 2); i += 2)
-            {
-                temp[0] = *(idx + i);     // Get first digit of ASCII code
-                temp[1] = *(idx + i + 1); // Get second digit of ASCII code
-                // No need to add string termination, temp[3] always == 0
-
-                if (strstr(temp, ":"))
-                    continue;                                  // Skip the second "1:" and third "2:" line numbers
-                
-                ascii_val = strtol(temp, 0, 16);               // Convert ASCII code to integer
-                snprintf(vin + vin_counter++, sizeof(uint8_t), "%c", ascii_val); // Convert ASCII code integer back to character
-                                                               // Serial.printf("Chars %s, ascii_val=%d[dec] 0x%02hhx[hex] ==> VIN=%s\n", temp, ascii_val, ascii_val, vin);
-            }
+
+            // Convert each pair of ASCII code digits back to a character
+            for (uint8_t i = 0; (i < 17) && isxdigit(idx[2 * i]) && isxdigit(idx[2 * i + 1]); i++)
+                vin[i] = (ctoi(idx[2 * i]) << 4) | ctoi(idx[2 * i + 1]);
         }
         if (debugMode)
         {
@@ -3226,10 +7368,14 @@ void ELM327::currentDTCCodes(const bool& isBlocking)
 
  Description:
  ------------
-  * Checks if a particular PID is supported by the connected ECU.
+  * Checks if a particular service 01 PID is supported by the connected ECU.
+
+  * If the supported PIDs were cached (see refreshSupportedPIDs()), this is a simple bit test
+    without any I/O and nb_rx_state is set to ELM_SUCCESS right away.
 
-  * This is a convenience method that selects the correct supportedPIDS_xx_xx() query and parses
-    the bit-encoded result, returning a simple Boolean value indicating PID support from the ECU.
+  * Otherwise, this is a convenience method that selects the correct supportedPIDS_xx_xx()
+    query and parses the bit-encoded result, returning a simple Boolean value indicating PID
+    support from the ECU.
 
  Inputs:
  -------
@@ -3241,7 +7387,20 @@ void ELM327::currentDTCCodes(const bool& isBlocking)
 */
 bool ELM327::isPidSupported(uint8_t pid)
 {
-    uint8_t pidInterval = (pid / PID_INTERVAL_OFFSET) * PID_INTERVAL_OFFSET;
+    if (supportedPidMapValid[pidMapIndex(SERVICE_01)])
+    {
+        nb_rx_state = ELM_SUCCESS;
+        return isPidSupported(SERVICE_01, pid);
+    }
+
+    uint8_t pidInterval = ((pid - 1) / PID_INTERVAL_OFFSET) * PID_INTERVAL_OFFSET;
+    uint8_t pidBit      = pid - pidInterval;
+
+    if (pid == 0)
+    {
+        nb_rx_state = ELM_SUCCESS;
+        return true;
+    }
 
     switch (pidInterval)
     {
@@ -3251,108 +7410,352 @@ bool ELM327::isPidSupported(uint8_t pid)
 
     case SUPPORTED_PIDS_21_40:
         supportedPIDs_21_40();
-        pid = (pid - SUPPORTED_PIDS_21_40);
         break;
 
     case SUPPORTED_PIDS_41_60:
         supportedPIDs_41_60();
-        pid = (pid - SUPPORTED_PIDS_41_60);
         break;
 
     case SUPPORTED_PIDS_61_80:
         supportedPIDs_61_80();
-        pid = (pid - SUPPORTED_PIDS_61_80);
         break;
 
     default:
-        break;
+        return false;
     }
 
     if (nb_rx_state == ELM_SUCCESS)
     {
-        return ((response >> (32 - pid)) & 0x1);
+        return ((response >> (32 - pidBit)) & 0x1);
     }
     return false;
 }
 
-double ELM327::calculator_0C() {
-    return (double)((response_A << 8) | response_B)/4;
+/*
+ bool ELM327::isPidSupported(const uint8_t& service, const uint8_t& pid)
+
+ Description:
+ ------------
+  * Checks if a particular PID is supported by the connected ECU using only the cached
+    supported PID bitmap of the service (see refreshSupportedPIDs()). This never does any I/O.
+
+ Inputs:
+ -------
+  * uint8_t service - the service of the PID (SERVICE_01 or SERVICE_09)
+  * uint8_t pid     - the PID to check for support.
+
+ Return:
+ -------
+  * bool - Whether or not the PID is supported by the ECU. Always false if the supported
+           PIDs of the service are not cached.
+*/
+bool ELM327::isPidSupported(const uint8_t& service, const uint8_t& pid)
+{
+    int8_t mapIndex = pidMapIndex(service);
+
+    if ((mapIndex < 0) || !supportedPidMapValid[mapIndex])
+        return false;
+
+    // The "supported PIDs" PIDs themselves are always supported
+    if (pid == 0)
+        return true;
+
+    uint8_t block = (pid - 1) / 32;
+    uint8_t bit   = 31 - ((pid - 1) % 32);
+
+    return (supportedPidMap[mapIndex][block] >> bit) & 0x1;
+}
+
+/*
+ bool ELM327::refreshSupportedPIDs(const uint8_t& service)
+
+ Description:
+ ------------
+  * Walks the "supported PIDs" chain of the service (PIDs 0x00, 0x20, 0x40, ..., 0xE0) and
+    caches the result as a 256-bit bitmap. After this, isPidSupported() answers from the
+    cache without any I/O. This is a blocking function. It is called automatically for
+    SERVICE_01 by begin() unless "cacheSupportedPIDs" is false.
+
+ Inputs:
+ -------
+  * uint8_t service - the service to discover (SERVICE_01 or SERVICE_09)
+
+ Return:
+ -------
+  * bool - Whether or not at least the first block of supported PIDs was received
+*/
+bool ELM327::refreshSupportedPIDs(const uint8_t& service)
+{
+    int8_t mapIndex = pidMapIndex(service);
+
+    if (mapIndex < 0)
+        return false;
+
+    supportedPidMapValid[mapIndex] = false;
+    memset(supportedPidMap[mapIndex], 0, sizeof(supportedPidMap[mapIndex]));
+
+    for (uint8_t block = 0; block < PID_MAP_BLOCKS; block++)
+    {
+        formatQueryArray(service, block * PID_INTERVAL_OFFSET, 1);
+
+        if (sendCommand_Blocking(query) != ELM_SUCCESS)
+            break;
+
+        findResponse();
+
+        if (responseDataLen < 4)
+            break;
+
+        // Only keep the first 4 bytes if the ELM327 returned more
+        supportedPidMap[mapIndex][block] = ((uint32_t)responseData[0] << 24) | ((uint32_t)responseData[1] << 16) |
+                                           ((uint32_t)responseData[2] << 8)  |  (uint32_t)responseData[3];
+        supportedPidMapValid[mapIndex]   = true;
+
+        // The last bit of each block tells if the next block is supported
+        if (!(supportedPidMap[mapIndex][block] & 0x1))
+            break;
+    }
+
+    if (debugMode)
+    {
+        Serial.print(F("Supported PIDs of service "));
+        Serial.print(service);
+        Serial.println(supportedPidMapValid[mapIndex] ? F(" cached") : F(" could not be read"));
+    }
+
+    return supportedPidMapValid[mapIndex];
+}
+
+/*
+ int8_t ELM327::pidMapIndex(const uint8_t& service)
+
+ Description:
+ ------------
+  * Finds the index of a service in supportedPidMap
+
+ Inputs:
+ -------
+  * uint8_t service - the service to look up
+
+ Return:
+ -------
+  * int8_t - Index into supportedPidMap, -1 if the service's PIDs are not cached
+*/
+int8_t ELM327::pidMapIndex(const uint8_t& service)
+{
+    if (service == SERVICE_01)
+        return 0;
+    else if (service == SERVICE_09)
+        return 1;
+
+    return -1;
+}
+
+/*
+ Descriptor table of the standard service 01 PIDs, indexed by PID number. Stored in flash on
+ AVR (PROGMEM), read with getPidDescriptor().
+
+ { numBytes, scaleFactor, bias, calculator, unit, fixedBias, fixedFlags }
+*/
+const ELM327::pidDescriptor ELM327::pidTable[NUM_PID_DESCRIPTORS] PROGMEM = {
+    { 4, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x00 - SUPPORTED_PIDS_1_20
+    { 4, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x01 - MONITOR_STATUS_SINCE_DTC_CLEARED
+    { 2, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x02 - FREEZE_DTC
+    { 2, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x03 - FUEL_SYSTEM_STATUS
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x04 - ENGINE_LOAD
+    { 1, 1,             -40.0,  nullptr,       UNIT_CELSIUS,      -40,    0                }, // 0x05 - ENGINE_COOLANT_TEMP
+    { 1, 100.0 / 128.0, -100.0, nullptr,       UNIT_PERCENT,      -128,   0                }, // 0x06 - SHORT_TERM_FUEL_TRIM_BANK_1
+    { 1, 100.0 / 128.0, -100.0, nullptr,       UNIT_PERCENT,      -128,   0                }, // 0x07 - LONG_TERM_FUEL_TRIM_BANK_1
+    { 1, 100.0 / 128.0, -100.0, nullptr,       UNIT_PERCENT,      -128,   0                }, // 0x08 - SHORT_TERM_FUEL_TRIM_BANK_2
+    { 1, 100.0 / 128.0, -100.0, nullptr,       UNIT_PERCENT,      -128,   0                }, // 0x09 - LONG_TERM_FUEL_TRIM_BANK_2
+    { 1, 3.0,           0,      nullptr,       UNIT_KPA,          0,      0                }, // 0x0A - FUEL_PRESSURE
+    { 1, 1,             0,      nullptr,       UNIT_KPA,          0,      0                }, // 0x0B - INTAKE_MANIFOLD_ABS_PRESSURE
+    { 2, 1.0 / 4.0,     0,      calculator_0C, UNIT_RPM,          0,      0                }, // 0x0C - ENGINE_RPM
+    { 1, 1,             0,      nullptr,       UNIT_KPH,          0,      0                }, // 0x0D - VEHICLE_SPEED
+    { 1, 1.0 / 2.0,     -64.0,  nullptr,       UNIT_DEGREES,      -128,   0                }, // 0x0E - TIMING_ADVANCE
+    { 1, 1,             -40.0,  nullptr,       UNIT_CELSIUS,      -40,    0                }, // 0x0F - INTAKE_AIR_TEMP
+    { 2, 1.0 / 100.0,   0,      calculator_10, UNIT_GRAMS_SEC,    0,      0                }, // 0x10 - MAF_FLOW_RATE
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x11 - THROTTLE_POSITION
+    { 1, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x12 - COMMANDED_SECONDARY_AIR_STATUS
+    { 1, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x13 - OXYGEN_SENSORS_PRESENT_2_BANKS
+    { 2, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x14 - OXYGEN_SENSOR_1_A
+    { 2, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x15 - OXYGEN_SENSOR_2_A
+    { 2, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x16 - OXYGEN_SENSOR_3_A
+    { 2, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x17 - OXYGEN_SENSOR_4_A
+    { 2, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x18 - OXYGEN_SENSOR_5_A
+    { 2, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x19 - OXYGEN_SENSOR_6_A
+    { 2, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x1A - OXYGEN_SENSOR_7_A
+    { 2, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x1B - OXYGEN_SENSOR_8_A
+    { 1, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x1C - OBD_STANDARDS
+    { 1, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x1D - OXYGEN_SENSORS_PRESENT_4_BANKS
+    { 1, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x1E - AUX_INPUT_STATUS
+    { 2, 1,             0,      calculator_1F, UNIT_SECONDS,      0,      0                }, // 0x1F - RUN_TIME_SINCE_ENGINE_START
+
+    { 4, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x20 - SUPPORTED_PIDS_21_40
+    { 2, 1,             0,      calculator_1F, UNIT_KM,           0,      0                }, // 0x21 - DISTANCE_TRAVELED_WITH_MIL_ON
+    { 2, 0.079,         0,      calculator_22, UNIT_KPA,          0,      0                }, // 0x22 - FUEL_RAIL_PRESSURE
+    { 2, 10.0,          0,      calculator_23, UNIT_KPA,          0,      0                }, // 0x23 - FUEL_RAIL_GUAGE_PRESSURE
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x24 - OXYGEN_SENSOR_1_B
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x25 - OXYGEN_SENSOR_2_B
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x26 - OXYGEN_SENSOR_3_B
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x27 - OXYGEN_SENSOR_4_B
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x28 - OXYGEN_SENSOR_5_B
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x29 - OXYGEN_SENSOR_6_B
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x2A - OXYGEN_SENSOR_7_B
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_VOLTS,        0,      FIXED_FIRST_BYTE }, // 0x2B - OXYGEN_SENSOR_8_B
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x2C - COMMANDED_EGR
+    { 1, 100.0 / 128.0, -100.0, nullptr,       UNIT_PERCENT,      -128,   0                }, // 0x2D - EGR_ERROR
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x2E - COMMANDED_EVAPORATIVE_PURGE
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x2F - FUEL_TANK_LEVEL_INPUT
+    { 1, 1,             0,      nullptr,       UNIT_COUNT,        0,      0                }, // 0x30 - WARM_UPS_SINCE_CODES_CLEARED
+    { 2, 1,             0,      calculator_1F, UNIT_KM,           0,      0                }, // 0x31 - DIST_TRAV_SINCE_CODES_CLEARED
+    { 2, 1.0 / 4.0,     0,      calculator_32, UNIT_PA,           0,      FIXED_SIGNED     }, // 0x32 - EVAP_SYSTEM_VAPOR_PRESSURE
+    { 1, 1,             0,      nullptr,       UNIT_KPA,          0,      0                }, // 0x33 - ABS_BAROMETRIC_PRESSURE
+    // The value is A / 200 (see calculator_14), not the sensor current in bytes C and D
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_NONE,         0,      FIXED_FIRST_BYTE }, // 0x34 - OXYGEN_SENSOR_1_C
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_NONE,         0,      FIXED_FIRST_BYTE }, // 0x35 - OXYGEN_SENSOR_2_C
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_NONE,         0,      FIXED_FIRST_BYTE }, // 0x36 - OXYGEN_SENSOR_3_C
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_NONE,         0,      FIXED_FIRST_BYTE }, // 0x37 - OXYGEN_SENSOR_4_C
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_NONE,         0,      FIXED_FIRST_BYTE }, // 0x38 - OXYGEN_SENSOR_5_C
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_NONE,         0,      FIXED_FIRST_BYTE }, // 0x39 - OXYGEN_SENSOR_6_C
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_NONE,         0,      FIXED_FIRST_BYTE }, // 0x3A - OXYGEN_SENSOR_7_C
+    { 4, 1.0 / 200.0,   0,      calculator_14, UNIT_NONE,         0,      FIXED_FIRST_BYTE }, // 0x3B - OXYGEN_SENSOR_8_C
+    { 2, 1.0 / 10.0,    -40.0,  calculator_3C, UNIT_CELSIUS,      -400,   0                }, // 0x3C - CATALYST_TEMP_BANK_1_SENSOR_1
+    { 2, 1.0 / 10.0,    -40.0,  calculator_3C, UNIT_CELSIUS,      -400,   0                }, // 0x3D - CATALYST_TEMP_BANK_2_SENSOR_1
+    { 2, 1.0 / 10.0,    -40.0,  calculator_3C, UNIT_CELSIUS,      -400,   0                }, // 0x3E - CATALYST_TEMP_BANK_1_SENSOR_2
+    { 2, 1.0 / 10.0,    -40.0,  calculator_3C, UNIT_CELSIUS,      -400,   0                }, // 0x3F - CATALYST_TEMP_BANK_2_SENSOR_2
+
+    { 4, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x40 - SUPPORTED_PIDS_41_60
+    { 4, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x41 - MONITOR_STATUS_THIS_DRIVE_CYCLE
+    { 2, 1.0 / 1000.0,  0,      calculator_42, UNIT_VOLTS,        0,      0                }, // 0x42 - CONTROL_MODULE_VOLTAGE
+    { 2, 100.0 / 255.0, 0,      calculator_43, UNIT_PERCENT,      0,      0                }, // 0x43 - ABS_LOAD_VALUE
+    { 2, 2.0 / 65536.0, 0,      calculator_44, UNIT_RATIO,        0,      0                }, // 0x44 - FUEL_AIR_COMMANDED_EQUIV_RATIO
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x45 - RELATIVE_THROTTLE_POSITION
+    { 1, 1,             -40.0,  nullptr,       UNIT_CELSIUS,      -40,    0                }, // 0x46 - AMBIENT_AIR_TEMP
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x47 - ABS_THROTTLE_POSITION_B
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x48 - ABS_THROTTLE_POSITION_C
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x49 - ABS_THROTTLE_POSITION_D
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x4A - ABS_THROTTLE_POSITION_E
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x4B - ABS_THROTTLE_POSITION_F
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x4C - COMMANDED_THROTTLE_ACTUATOR
+    { 2, 1,             0,      calculator_1F, UNIT_MINUTES,      0,      0                }, // 0x4D - TIME_RUN_WITH_MIL_ON
+    { 2, 1,             0,      calculator_1F, UNIT_MINUTES,      0,      0                }, // 0x4E - TIME_SINCE_CODES_CLEARED
+    { 4, 1,             0,      calculator_4F, UNIT_RATIO,        0,      FIXED_FIRST_BYTE }, // 0x4F - MAX_VALUES_EQUIV_V_I_PRESSURE
+    { 1, 10.0,          0,      calculator_50, UNIT_GRAMS_SEC,    0,      0                }, // 0x50 - MAX_MAF_RATE
+    { 1, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x51 - FUEL_TYPE
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x52 - ETHANOL_FUEL_PERCENT
+    { 2, 1.0 / 200.0,   0,      calculator_53, UNIT_KPA,          0,      0                }, // 0x53 - ABS_EVAP_SYS_VAPOR_PRESSURE
+    { 2, 1,             -32767, nullptr,       UNIT_PA,           -32767, 0                }, // 0x54 - EVAP_SYS_VAPOR_PRESSURE
+    { 2, 100.0 / 128.0, -100.0, calculator_55, UNIT_PERCENT,      -128,   FIXED_FIRST_BYTE }, // 0x55 - SHORT_TERM_SEC_OXY_SENS_TRIM_1_3
+    { 2, 100.0 / 128.0, -100.0, calculator_55, UNIT_PERCENT,      -128,   FIXED_FIRST_BYTE }, // 0x56 - LONG_TERM_SEC_OXY_SENS_TRIM_1_3
+    { 2, 100.0 / 128.0, -100.0, calculator_55, UNIT_PERCENT,      -128,   FIXED_FIRST_BYTE }, // 0x57 - SHORT_TERM_SEC_OXY_SENS_TRIM_2_4
+    { 2, 100.0 / 128.0, -100.0, calculator_55, UNIT_PERCENT,      -128,   FIXED_FIRST_BYTE }, // 0x58 - LONG_TERM_SEC_OXY_SENS_TRIM_2_4
+    { 2, 10.0,          0,      calculator_23, UNIT_KPA,          0,      0                }, // 0x59 - FUEL_RAIL_ABS_PRESSURE
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x5A - RELATIVE_ACCELERATOR_PEDAL_POS
+    { 1, 100.0 / 255.0, 0,      nullptr,       UNIT_PERCENT,      0,      0                }, // 0x5B - HYBRID_BATTERY_REMAINING_LIFE
+    { 1, 1,             -40.0,  nullptr,       UNIT_CELSIUS,      -40,    0                }, // 0x5C - ENGINE_OIL_TEMP
+    { 2, 1.0 / 128.0,   -210.0, calculator_5D, UNIT_DEGREES,      -26880, 0                }, // 0x5D - FUEL_INJECTION_TIMING
+    { 2, 1.0 / 20.0,    0,      calculator_5E, UNIT_LITERS_HOUR,  0,      0                }, // 0x5E - ENGINE_FUEL_RATE
+    { 1, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x5F - EMISSION_REQUIREMENTS
+
+    { 4, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }, // 0x60 - SUPPORTED_PIDS_61_80
+    { 1, 1,             -125.0, nullptr,       UNIT_PERCENT,      -125,   0                }, // 0x61 - DEMANDED_ENGINE_PERCENT_TORQUE
+    { 1, 1,             -125.0, nullptr,       UNIT_PERCENT,      -125,   0                }, // 0x62 - ACTUAL_ENGINE_TORQUE
+    { 2, 1,             0,      calculator_1F, UNIT_NEWTON_METER, 0,      0                }, // 0x63 - ENGINE_REFERENCE_TORQUE
+    { 5, 1,             0,      calculator_61, UNIT_PERCENT,      -125,   FIXED_FIRST_BYTE }, // 0x64 - ENGINE_PERCENT_TORQUE_DATA (idle torque, A - 125)
+    { 2, 1,             0,      nullptr,       UNIT_NONE,         0,      0                }  // 0x65 - AUX_INPUT_OUTPUT_SUPPORTED
+};
+
+// J1939-71 parameters, indexed by J1939_XXX
+const ELM327::spnDescriptor ELM327::spnTable[NUM_J1939_SPNS] PROGMEM = {
+    { 0xF004, 190, 3, 2, 0.125,         0,      UNIT_RPM         }, // J1939_ENGINE_SPEED   - EEC1
+    { 0xF004, 513, 2, 1, 1,             -125.0, UNIT_PERCENT     }, // J1939_ENGINE_TORQUE  - EEC1
+    { 0xF003, 91,  1, 1, 0.4,           0,      UNIT_PERCENT     }, // J1939_PEDAL_POSITION - EEC2
+    { 0xFEEE, 110, 0, 1, 1,             -40.0,  UNIT_CELSIUS     }, // J1939_COOLANT_TEMP   - ET1
+    { 0xFEEE, 175, 2, 2, 0.03125,       -273.0, UNIT_CELSIUS     }, // J1939_OIL_TEMP       - ET1
+    { 0xFEEF, 100, 3, 1, 4,             0,      UNIT_KPA         }, // J1939_OIL_PRESSURE   - EFL/P1
+    { 0xFEF2, 183, 0, 2, 0.05,          0,      UNIT_LITERS_HOUR }, // J1939_FUEL_RATE      - LFE1
+    { 0xFEF1, 84,  1, 2, 1.0 / 256.0,   0,      UNIT_KPH         }, // J1939_VEHICLE_SPEED  - CCVS1
+    { 0xFEFC, 96,  1, 1, 0.4,           0,      UNIT_PERCENT     }, // J1939_FUEL_LEVEL     - DD1
+};
+
+double ELM327::calculator_0C(const pidResponse& r) {
+    return (double)((r.A << 8) | r.B)/4;
 }
 
-double ELM327::calculator_10() {
-    return (double)((response_A << 8) | response_B)/100;
+double ELM327::calculator_10(const pidResponse& r) {
+    return (double)((r.A << 8) | r.B)/100;
 }
 
-double ELM327::calculator_14(){
-    return (double)(response_A/200) ;
+double ELM327::calculator_14(const pidResponse& r) {
+    return (double)(r.A / 200.0);
 }
 
-double ELM327::calculator_1F() {
-    return (double)((response_A << 8) | response_B);
+double ELM327::calculator_1F(const pidResponse& r) {
+    return (double)((r.A << 8) | r.B);
 }
 
-double ELM327::calculator_22() {
-    return (double) ((response_A << 8) | response_B) * 0.079;
+double ELM327::calculator_22(const pidResponse& r) {
+    return (double) ((r.A << 8) | r.B) * 0.079;
 }
 
-double ELM327::calculator_23() {
-    return (double) ((response_A << 8) | response_B) * 10;
+double ELM327::calculator_23(const pidResponse& r) {
+    return (double) ((r.A << 8) | r.B) * 10;
 }
 
-double ELM327::calculator_32()
-{
-    return (double) ((int16_t)((response_A << 8) | response_B)) / 4.0;
+double ELM327::calculator_32(const pidResponse& r) {
+    return (double) ((int16_t)((r.A << 8) | r.B)) / 4.0;
 }
 
-double ELM327::calculator_3C() {
-    return (double) (((response_A << 8) | response_B) / 10) - 40;
+double ELM327::calculator_3C(const pidResponse& r) {
+    return (double) (((r.A << 8) | r.B) / 10) - 40;
 }
 
-double ELM327::calculator_42() {
-    return (double) ((response_A << 8) | response_B) / 1000;
+double ELM327::calculator_42(const pidResponse& r) {
+    return (double) ((r.A << 8) | r.B) / 1000;
 }
 
-double ELM327::calculator_43() {
-    return (double) ((response_A << 8) | response_B) * (100.0 / 255.0);
+double ELM327::calculator_43(const pidResponse& r) {
+    return (double) ((r.A << 8) | r.B) * (100.0 / 255.0);
 }
 
-double ELM327::calculator_44() {
-    return ((double) ((response_A << 8) | response_B) * 2.0) / 65536.0;
+double ELM327::calculator_44(const pidResponse& r) {
+    return ((double) ((r.A << 8) | r.B) * 2.0) / 65536.0;
 }
 
-double ELM327::calculator_4F() {
-    return (double) (response_A);
+double ELM327::calculator_4F(const pidResponse& r) {
+    return (double) (r.A);
 }
 
-double ELM327::calculator_50() {
-    return (double) (response_A * 10.0);
+double ELM327::calculator_50(const pidResponse& r) {
+    return (double) (r.A * 10.0);
 }
 
-double ELM327::calculator_53() {
-    return (double) ((response_A << 8) | response_B) / 200;
+double ELM327::calculator_53(const pidResponse& r) {
+    return (double) ((r.A << 8) | r.B) / 200;
 }
 
-double ELM327::calculator_54() {
-    return (double) ((int16_t)((response_A << 8) | response_B));
+double ELM327::calculator_54(const pidResponse& r) {
+    return (double) ((int16_t)((r.A << 8) | r.B));
 }
 
-double ELM327::calculator_55() {
-    return ((double) response_A * (100.0 / 128.0)) - 100.0;
+double ELM327::calculator_55(const pidResponse& r) {
+    return ((double) r.A * (100.0 / 128.0)) - 100.0;
 }
 
 //calc 23
-double ELM327::calculator_59() {
-    return (double) ((response_A << 8) | response_B) * 10;
+double ELM327::calculator_59(const pidResponse& r) {
+    return (double) ((r.A << 8) | r.B) * 10;
 }
 
-double ELM327::calculator_5D() {
-    return (double) (((response_A << 8) | response_B) / 128) - 210;
+double ELM327::calculator_5D(const pidResponse& r) {
+    return (double) (((r.A << 8) | r.B) / 128) - 210;
 } 
 
-double ELM327::calculator_5E() {
-    return (double) ((response_A << 8) | response_B) / 20;
+double ELM327::calculator_5E(const pidResponse& r) {
+    return (double) ((r.A << 8) | r.B) / 20;
 }
 
-double ELM327::calculator_61() {
-    return (double) response_A  - 125;
+double ELM327::calculator_61(const pidResponse& r) {
+    return (double) r.A  - 125;
 }
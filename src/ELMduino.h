@@ -1,6 +1,32 @@
 #pragma once
 #include "Arduino.h"
 
+// Set to 1 (i.e. with the build flag -DELM_FIXED_POINT=1) to keep floating point math
+// out of the scheduler's hot path: poll() then only decodes scheduled PIDs with the
+// integer readFixed() path and leaves scheduledPID::value untouched. decodeFrame() then
+// only updates the raw fixedValue of CAN signals
+#ifndef ELM_FIXED_POINT
+#define ELM_FIXED_POINT 0
+#endif
+
+// Set to 1 (i.e. with the build flag -DELM_SMALL_RAM=1) to shrink the fixed size tables of
+// each ELM327: scheduled PIDs, learned numbers of responses and ECU responses. On by
+// default on AVR, where an Uno or Nano has 2 KB of RAM in total
+#ifndef ELM_SMALL_RAM
+#if defined(__AVR__)
+#define ELM_SMALL_RAM 1
+#else
+#define ELM_SMALL_RAM 0
+#endif
+#endif
+
+// Set to 0 (i.e. with the build flag -DELM_METRICS=0) to leave the per-PID latency
+// statistics (Metrics.pids) out - the status counters are always kept. Off by default
+// with ELM_SMALL_RAM
+#ifndef ELM_METRICS
+#define ELM_METRICS (!ELM_SMALL_RAM)
+#endif
+
 //-------------------------------------------------------------------------------------//
 // Protocol IDs
 //-------------------------------------------------------------------------------------//
@@ -24,6 +50,7 @@ const char USER_2_CAN                 = 'C';
 constexpr uint8_t SERVICE_01                       = 1;
 constexpr uint8_t SERVICE_02                       = 2;
 constexpr uint8_t SERVICE_03                       = 3;
+constexpr uint8_t SERVICE_09                       = 9;
 constexpr uint8_t PID_INTERVAL_OFFSET              = 0x20;
 
 
@@ -130,7 +157,7 @@ constexpr uint8_t SUPPORTED_PIDS_61_80             = 96;  // 0x60 - bit encoded
 constexpr uint8_t DEMANDED_ENGINE_PERCENT_TORQUE   = 97;  // 0x61 - %
 constexpr uint8_t ACTUAL_ENGINE_TORQUE             = 98;  // 0x62 - %
 constexpr uint8_t ENGINE_REFERENCE_TORQUE          = 99;  // 0x63 - Nm
-constexpr uint8_t ENGINE_PERCENT_TORQUE_DATA       = 100; // 0x64 - %
+constexpr uint8_t ENGINE_PERCENT_TORQUE_DATA       = 100; // 0x64 - % (idle torque, the first of the 5 bytes)
 constexpr uint8_t AUX_INPUT_OUTPUT_SUPPORTED       = 101; // 0x65 - bit encoded
 
 //-------------------------------------------------------------------------------------//
@@ -147,8 +174,8 @@ const char * const ADAPTIVE_TIMING_AUTO_1     = "AT AT1";      // OBD
 const char * const ADAPTIVE_TIMING_AUTO_2     = "AT AT2";      // OBD
 const char * const DUMP_BUFFER                = "AT BD";       // OBD
 const char * const BYPASS_INIT_SEQUENCE       = "AT BI";       // OBD
-const char * const TRY_BAUD_DIVISOR           = "AT BRD %02d"; // General
-const char * const SET_HANDSHAKE_TIMEOUT      = "AT BRT %02d"; // General
+const char * const TRY_BAUD_DIVISOR           = "AT BRD %02X"; // General
+const char * const SET_HANDSHAKE_TIMEOUT      = "AT BRT %02X"; // General
 const char * const CAN_AUTO_FORMAT_OFF        = "AT CAF0";     // CAN
 const char * const CAN_AUTO_FORMAT_ON         = "AT CAF1";     // CAN
 const char * const CAN_EXTENDED_ADDRESS_OFF   = "AT CEA";      // CAN
@@ -158,6 +185,7 @@ const char * const CAN_FLOW_CONTROL_OFF       = "AT CFC0";     // CAN
 const char * const CAN_FLOW_CONTROL_ON        = "AT CFC1";     // CAN
 const char * const SET_ID_MASK                = "AT CM %s";    // CAN
 const char * const SET_CAN_PRIORITY           = "AT CP %02d";  // CAN
+const char * const RESET_RECEIVE_FILTERS      = "AT CRA";      // CAN
 const char * const SHOW_CAN_STATUS            = "AT CS";       // CAN
 const char * const CAN_SILENT_MODE_OFF        = "AT CSM0";     // CAN
 const char * const CAN_SILENT_MODE_ON         = "AT CSM1";     // CAN
@@ -232,7 +260,7 @@ const char * const SET_PROTOCOL_TO_H_SAVE     = "AT SP %c";    // OBD
 const char * const SET_PROTOCOL_TO_AUTO_SAVE  = "AT SP 00";    // OBD
 const char * const SET_REC_ADDRESS            = "AT SR %02d";  // OBD
 const char * const SET_STANDARD_SEARCH_ORDER  = "AT SS";       // OBD
-const char * const SET_TIMEOUT_TO_H_X_4MS     = "AT ST %02d";  // OBD
+const char * const SET_TIMEOUT_TO_H_X_4MS     = "AT ST %02X";  // OBD
 const char * const SET_WAKEUP_TO_H_X_20MS     = "AT SW %02d";  // ISO
 const char * const SET_TESTER_ADDRESS_TO      = "AT TA %02d";  // OBD
 const char * const TRY_PROT_H_AUTO_SEARCH     = "AT TP A%c";   // OBD
@@ -247,7 +275,11 @@ const char * const RESET_ALL                  = "AT Z";        // General
 // Class constants
 //-------------------------------------------------------------------------------------//
 constexpr float  KPH_MPH_CONVERT       = 0.6213711922;
-constexpr int8_t QUERY_LEN             = 9;
+constexpr int8_t QUERY_LEN             = 17; // service + up to 6 PIDs + num responses + '\0'
+constexpr uint8_t MAX_PIDS_PER_QUERY   = 6;
+constexpr uint8_t NUM_PID_DESCRIPTORS  = AUX_INPUT_OUTPUT_SUPPORTED + 1;
+constexpr uint8_t NUM_PID_MAP_SERVICES = 2; // SERVICE_01 and SERVICE_09
+constexpr uint8_t PID_MAP_BLOCKS       = 8; // 8 x 32 bits = PIDs 0x01 - 0x100
 constexpr int8_t ELM_SUCCESS           = 0;
 constexpr int8_t ELM_NO_RESPONSE       = 1;
 constexpr int8_t ELM_BUFFER_OVERFLOW   = 2;
@@ -259,8 +291,59 @@ constexpr int8_t ELM_TIMEOUT           = 7;
 constexpr int8_t ELM_GETTING_MSG       = 8;
 constexpr int8_t ELM_MSG_RXD           = 9;
 constexpr int8_t ELM_GENERAL_ERROR     = -1;
+constexpr uint8_t NUM_ELM_STATUS_CODES = ELM_MSG_RXD - ELM_GENERAL_ERROR + 1;
+constexpr uint16_t INIT_PROBE_TIMEOUT  = 250; // ms to wait for "AT I" before doing a full reset
+constexpr uint8_t ADAPTER_ID_LEN       = 16;
+constexpr uint8_t HEADER_LEN           = 9;   // Up to 8 hex chars (29-bit CAN ID) + '\0'
+constexpr uint8_t ECHO_CMD_LEN         = 20;  // Longest command echo the streaming parser drops + '\0'
+constexpr uint8_t LAST_COMMAND_LEN     = 20;  // Longest command sent in a single write + '\r' + '\0'
+constexpr uint8_t SESSION_VERSION      = 2;
+constexpr uint8_t MAX_SCHEDULED_PIDS   = ELM_SMALL_RAM ? 4 : 8;
+constexpr uint8_t METRICS_PID_SLOTS    = 8;
 constexpr uint8_t DTC_CODE_LEN         = 6;
 constexpr uint8_t DTC_MAX_CODES        = 16;
+constexpr uint8_t NUM_RESPONSES_AUTO   = 0;   // Use the learned number of responses - see ELM327::queryPID()
+constexpr uint8_t RESPONSE_HINT_SLOTS  = ELM_SMALL_RAM ? 4 : 16;
+constexpr uint8_t RESPONSE_HINT_RECHECK = 200; // Queries with a learned count before it is learned again
+constexpr uint8_t DEFAULT_DATA_TIMEOUT  = 0x32; // "AT ST" default of the ELM327 (200ms)
+constexpr uint8_t TIMING_PROBE_PIDS     = 4;    // PIDs queried by ELM327::calibrateTiming()
+constexpr uint8_t TIMING_MARGIN_PERCENT = 150;  // "AT ST" relative to the slowest measured response
+constexpr uint8_t TIMING_WATCH_WINDOW   = 50;   // Queries per NO DATA watch window
+constexpr uint8_t TIMING_BACKOFF_NO_DATA = 3;   // NO DATA responses per window that back the timing off
+constexpr uint8_t BAUD_HANDSHAKE_TIMEOUT = 0x28; // "AT BRT" value in units of 5ms (200ms) - see ELM327::negotiateBaud()
+constexpr uint8_t BAUD_TOLERANCE_PERCENT = 3;    // Largest difference between a baud rate and 4000000 / "AT BRD" divisor
+constexpr uint8_t MONITOR_LINE_LEN     = 24;  // Longest monitored line: 29-bit CAN ID + 8 data bytes (hex chars)
+constexpr uint8_t MONITOR_MAX_DATA     = 8;   // Data bytes per monitored frame
+constexpr uint8_t FILTER_PLAN_MAX_IDS  = 32;  // Most CAN IDs ELM327::planMonitorFilters() can cover
+constexpr uint8_t ECU_MAX_RESPONSES    = ELM_SMALL_RAM ? 2 : 4; // ECUs whose responses are kept per query - see ELM327::setECUDemux()
+constexpr uint8_t ECU_RESPONSE_LEN     = 7;   // Data bytes of a single frame response
+constexpr uint8_t SIGNAL_INDEX_BITS    = 6;
+constexpr uint8_t SIGNAL_INDEX_SLOTS   = 1 << SIGNAL_INDEX_BITS; // Hash slots of the CAN ID lookup - see ELM327::setSignalTable()
+constexpr uint8_t SIGNAL_MAX_MESSAGES  = SIGNAL_INDEX_SLOTS / 2;
+
+// J1939 - see ELM327::processJ1939Frame()
+constexpr uint32_t J1939_PGN_REQUEST   = 0xEA00;  // 59904
+constexpr uint32_t J1939_PGN_TP_CM     = 0xEC00;  // 60416 - transport protocol connection management
+constexpr uint32_t J1939_PGN_TP_DT     = 0xEB00;  // 60160 - transport protocol data transfer
+constexpr uint32_t J1939_PGN_DM1       = 0xFECA;  // 65226 - active diagnostic trouble codes
+constexpr uint8_t  J1939_TP_CM_RTS     = 16;
+constexpr uint8_t  J1939_TP_CM_BAM     = 32;
+constexpr uint8_t  J1939_TP_CM_ABORT   = 255;
+constexpr uint8_t  J1939_TP_SESSIONS   = 2;       // Suggested number of transfers reassembled at the same time - see ELM327::setJ1939Transfers()
+constexpr uint8_t  J1939_TP_MAX_LEN    = 64;      // Longest reassembled message (a DM1 with 15 DTCs)
+constexpr uint16_t J1939_TP_TIMEOUT    = 750;     // ms between data transfer packets (T1) before a transfer is dropped
+
+// Index of the SPNs of ELM327::spnTable, and of the values decodeSPNs() updates
+constexpr uint8_t J1939_ENGINE_SPEED    = 0;  // SPN 190
+constexpr uint8_t J1939_ENGINE_TORQUE   = 1;  // SPN 513
+constexpr uint8_t J1939_PEDAL_POSITION  = 2;  // SPN 91
+constexpr uint8_t J1939_COOLANT_TEMP    = 3;  // SPN 110
+constexpr uint8_t J1939_OIL_TEMP        = 4;  // SPN 175
+constexpr uint8_t J1939_OIL_PRESSURE    = 5;  // SPN 100
+constexpr uint8_t J1939_FUEL_RATE       = 6;  // SPN 183
+constexpr uint8_t J1939_VEHICLE_SPEED   = 7;  // SPN 84
+constexpr uint8_t J1939_FUEL_LEVEL      = 8;  // SPN 96
+constexpr uint8_t NUM_J1939_SPNS        = 9;
 
 const char * const RESPONSE_OK                = "OK";
 const char * const RESPONSE_UNABLE_TO_CONNECT = "UNABLETOCONNECT";
@@ -275,32 +358,244 @@ typedef enum { SEND_COMMAND,
                DECODED_OK,
                ERROR } obd_cmd_states;
 
-// Pointers to existing response bytes, to be used for new calculators without breaking 
-// backward compatability with code that may use the above response bytes. 
-static byte response_A;
-static byte response_B;
-static byte response_C;
-static byte response_D;
-static byte response_E;
-static byte response_F;
-static byte response_G;
-static byte response_H;
+// Connection state of an ELM327 session that can be stored (i.e. EEPROM/NVS) and restored at the
+// next boot to skip the protocol search - see ELM327::saveSession() and ELM327::restoreSession()
+struct elmSession {
+    uint8_t  version;
+    char     protocol;                    // Protocol ID reported by "AT DPN"
+    char     adapterId[ADAPTER_ID_LEN];   // Response to "AT I"
+    char     header[HEADER_LEN];          // Header set with ELM327::setHeader(), "" for default
+    uint16_t timeout_ms;
+    byte     dataTimeout;
+    uint8_t  calibratedTimeout;           // "AT ST" value found by ELM327::calibrateTiming(), 0 if not calibrated
+    uint8_t  adaptiveTiming;              // "AT AT" mode found by ELM327::calibrateTiming()
+    uint8_t  supportedPidMapValid;        // Bit n set if supportedPidMap[n] is valid
+    uint32_t supportedPidMap[NUM_PID_MAP_SERVICES][PID_MAP_BLOCKS];
+    uint16_t checksum;
+};
+
+// Last value of a sampled quantity and when it was updated - kept for scheduled PIDs (see
+// ELM327::poll()) and decoded CAN signals (see ELM327::decodeFrame()) alike
+struct sampledValue {
+    uint32_t lastUpdate;   // millis() of the last successful sample
+    double   value;        // Last successfully decoded value (not updated if ELM_FIXED_POINT)
+    int32_t  fixedValue;   // Last successfully decoded value in fixed-point form - see ELM327::readFixed()
+    uint32_t samples;      // Number of successful samples
+    float    achievedRate; // Measured rate in Hz (smoothed, not updated if ELM_FIXED_POINT)
+    uint32_t interval_ms;  // Measured time between samples (smoothed)
+};
+
+// A PID polled at a fixed rate by the scheduler - see ELM327::schedulePID() and ELM327::poll()
+struct scheduledPID : sampledValue {
+    uint8_t  pid;          // Service 01 PID
+    uint32_t ecu;          // Response CAN ID of the ECU the PID is requested from, 0 to broadcast
+    float    rate;         // Requested rate in Hz
+    uint32_t period_ms;    // Requested time between samples
+    uint32_t nextDue;      // millis() when the next query is due
+    uint32_t errors;       // Number of failed queries
+};
+
+// Running statistics (count, min, max and mean) of a measured quantity
+struct runningStat {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    float    mean;
+};
+
+// Latency and size statistics of the queries of one service/PID - see ELM327::Metrics
+struct queryMetrics {
+    uint8_t     service;
+    uint16_t    pid;
+    runningStat firstByte_us; // Time from sending the query to the first received char
+    runningStat prompt_us;    // Time from sending the query to the '>' prompt
+    runningStat rxBytes;      // Number of chars buffered per response
+};
+
+// A frame received in monitor mode - see ELM327::startMonitor()
+struct canFrame {
+    uint32_t id;                      // CAN ID, or the 3 header bytes of non-CAN protocols
+    uint32_t timestamp_ms;            // millis() when the end of the frame's line was received
+    bool     extended;                // Whether id is a 29-bit CAN ID
+    uint8_t  len;                     // Number of data bytes
+    uint8_t  data[MONITOR_MAX_DATA];
+};
+
+// Response of one ECU to the last query, with headers on - see ELM327::setECUDemux()
+struct ecuResponse {
+    uint32_t id;                      // Response CAN ID, i.e. 0x7E8 or 0x18DAF110
+    uint8_t  len;                     // Number of data bytes after the response header
+    uint8_t  data[ECU_RESPONSE_LEN];
+};
+
+// An "AT CF"/"AT CM" filter/mask pair that passes a group of CAN IDs - see ELM327::planMonitorFilters()
+struct monitorWindow {
+    uint32_t filter;
+    uint32_t mask;       // Bits of the ID that must match filter
+    bool     extended;   // Whether filter and mask are for 29-bit IDs
+    uint8_t  numIds;     // Requested IDs the window passes
+    float    passRatio;  // Expected share of the bus traffic that passes (0 to 1)
+};
+
+// One signal of a broadcast CAN frame, precompiled from its DBC definition (see
+// extras/dbc2elmduino.py). The frame's data bytes are read as a 64-bit word - little endian
+// for Intel signals, big endian (data[0] first) for Motorola signals - and the signal is
+// (word >> shift) & (2 ^ length - 1). The physical value is raw * scale + offset
+struct canSignal {
+    uint8_t shift;   // Position of the signal's LSB in the word - see dbcShift()
+    uint8_t length;  // Number of bits (1 to 32)
+    uint8_t flags;   // SIGNAL_XXX flags
+    float   scale;
+    float   offset;
+};
+
+// Signal flags - see canSignal
+constexpr uint8_t SIGNAL_BIG_ENDIAN = 0x01; // Motorola byte order
+constexpr uint8_t SIGNAL_SIGNED     = 0x02; // Raw value is two's complement
+
+// A CAN ID and its signals, signals[firstSignal] to signals[firstSignal + numSignals - 1] -
+// see ELM327::setSignalTable()
+struct canMessage {
+    uint32_t id;
+    uint8_t  firstSignal;
+    uint8_t  numSignals;
+    bool     extended;    // Whether id is a 29-bit CAN ID - 11-bit and 29-bit IDs are distinct
+};
+
+// canSignal::shift of a signal with the given DBC start bit (the LSB for Intel signals, the
+// MSB in DBC's sawtooth numbering for Motorola signals)
+constexpr uint8_t dbcShift(const uint8_t startBit, const uint8_t length, const bool bigEndian)
+{
+    return bigEndian ? (64 - ((startBit / 8) * 8 + (7 - startBit % 8)) - length) : startBit;
+}
+
+// A complete J1939 message: a single frame or a reassembled transport protocol transfer -
+// see ELM327::processJ1939Frame()
+struct j1939Message {
+    uint32_t       pgn;
+    uint8_t        source;       // Source address
+    uint8_t        priority;
+    uint16_t       len;
+    const uint8_t* data;
+    uint32_t       timestamp_ms; // Time the last frame of the message was received
+};
+
+// A J1939 transport protocol transfer (BAM or RTS/CTS) being reassembled - see
+// ELM327::setJ1939Transfers()
+struct j1939Transfer {
+    bool     active;
+    uint8_t  source;
+    uint8_t  destination;   // 0xFF for BAM
+    uint8_t  priority;
+    uint32_t pgn;           // PGN of the transferred message
+    uint16_t len;
+    uint8_t  numPackets;
+    uint8_t  nextPacket;    // Sequence number of the next data transfer packet
+    uint32_t lastFrame_ms;
+    uint8_t  data[J1939_TP_MAX_LEN];
+};
+
+// An active fault of a DM1 message - see ELM327::parseDM1()
+struct j1939DTC {
+    uint32_t spn;         // Suspect Parameter Number
+    uint8_t  fmi;         // Failure Mode Identifier
+    uint8_t  occurrences;
+};
+
+// Units of the standard PIDs - see ELM327::pidDescriptor
+typedef enum { UNIT_NONE,
+               UNIT_PERCENT,
+               UNIT_CELSIUS,
+               UNIT_KPA,
+               UNIT_PA,
+               UNIT_RPM,
+               UNIT_KPH,
+               UNIT_DEGREES,
+               UNIT_GRAMS_SEC,
+               UNIT_VOLTS,
+               UNIT_MILLIAMPS,
+               UNIT_SECONDS,
+               UNIT_MINUTES,
+               UNIT_KM,
+               UNIT_COUNT,
+               UNIT_RATIO,
+               UNIT_LITERS_HOUR,
+               UNIT_NEWTON_METER } pid_units;
+
+// Fixed-point decoding flags of the standard PIDs - see ELM327::pidDescriptor
+constexpr uint8_t FIXED_SIGNED     = 0x01; // Data bytes are a two's complement value
+constexpr uint8_t FIXED_FIRST_BYTE = 0x02; // Only the first data byte holds the value
+
+// A single PID of a multi-PID (batch) query - see ELM327::processPIDs()
+struct pidRequest {
+    uint8_t pid;              // PID to query
+    uint8_t numExpectedBytes; // Number of data bytes the PID returns
+    double  scaleFactor;      // Amount to scale the response by
+    float   bias;             // Amount to bias the response by
+    double  value;            // Decoded value (only meaningful if valid == true)
+    bool    valid;            // Whether or not value was updated by the last batch
+};
+
+// Data bytes of a decoded PID response, passed to the calculator functions. Each ELM327
+// instance has its own copy, so several instances can decode at the same time.
+// A to H are the first 8 bytes, data/len span all decoded bytes (see ELM327::responseData)
+struct pidResponse {
+    byte A;
+    byte B;
+    byte C;
+    byte D;
+    byte E;
+    byte F;
+    byte G;
+    byte H;
+    const uint8_t* data;
+    uint16_t       len;
+};
 
 
 class ELM327
 {
 public:
+    // Decoding information of a standard service 01 PID (see pidTable)
+    struct pidDescriptor {
+        uint8_t numBytes;         // Number of data bytes the PID returns
+        float   scaleFactor;      // Amount to scale the response by
+        float   bias;             // Amount to bias the response by
+        double  (*calculator)(const pidResponse&); // Custom calculator, nullptr to use scaleFactor + bias
+        uint8_t unit;             // pid_units
+        int16_t fixedBias;        // Bias in units of scaleFactor, see readFixed()
+        uint8_t fixedFlags;       // FIXED_XXX flags
+    };
+
+    // Decoding information of a J1939 SPN (see spnTable)
+    struct spnDescriptor {
+        uint32_t pgn;       // PGN the SPN is sent in
+        uint16_t spn;
+        uint8_t  startByte; // First data byte (0 based), multi-byte SPNs are little endian
+        uint8_t  numBytes;  // 1, 2 or 4
+        float    scale;
+        float    offset;
+        uint8_t  unit;      // pid_units
+    };
+
     Stream* elm_port;
 
     bool connected = false;
+    char activeProtocol = AUTOMATIC;
+    char activeHeader[HEADER_LEN] = { '\0' };
+    char adapterId[ADAPTER_ID_LEN] = { '\0' };
     bool specifyNumResponses = true;
+    bool learnNumResponses = true;
+    bool cacheSupportedPIDs = true;
+    bool bulkReceive = true;
+    bool repeatQueries = false;
     bool debugMode;
-    char* payload;
-    uint16_t PAYLOAD_LEN;
+    char* payload = nullptr;
+    uint16_t PAYLOAD_LEN = 0;
     int8_t nb_rx_state = ELM_GETTING_MSG;
     uint64_t response = 0;
     uint16_t recBytes;
-    uint8_t numPayChars;
+    uint16_t numPayChars;
     uint16_t timeout_ms;
     byte responseByte_0;
     byte responseByte_1;
@@ -310,34 +605,125 @@ public:
     byte responseByte_5;
     byte responseByte_6;
     byte responseByte_7;
+    pidResponse responseBytes;
+    uint8_t* responseData = nullptr; // Decoded data bytes after the response header - room for PAYLOAD_LEN / 2 bytes
+    uint16_t responseDataLen = 0;
     
     
     struct dtcResponse {
         uint8_t codesFound = 0;
         char    codes[DTC_MAX_CODES][DTC_CODE_LEN];
     } DTC_Response;
+
+    // Query outcomes and latencies, updated each time a response is complete
+    struct elmMetrics {
+        uint32_t     statusCounts[NUM_ELM_STATUS_CODES] = { 0 }; // Indexed by ELM_XXX status - ELM_GENERAL_ERROR
+        uint32_t     untracked = 0;                              // Queries that didn't fit in pids[] (all if !ELM_METRICS)
+#if ELM_METRICS
+        uint8_t      numPids   = 0;
+        queryMetrics pids[METRICS_PID_SLOTS];
+#endif
+    } Metrics;
+
+    // Duration of each phase of the last initializeELM() call
+    struct initTimes {
+        bool     warmStart   = false; // Whether "AT WS" was used instead of "AT Z"
+        uint16_t probe_ms    = 0;     // Checking if the ELM327 already responds
+        uint16_t reset_ms    = 0;     // "AT WS" or "AT Z"
+        uint16_t config_ms   = 0;     // Echo, spaces, long messages and data timeout
+        uint16_t protocol_ms = 0;     // Protocol selection and search
+        uint16_t total_ms    = 0;
+    } Init_Times;
+
+    // Response timing of the ELM327 - found by calibrateTiming() and backed off when
+    // supported PIDs start returning NO DATA
+    struct elmTiming {
+        bool     calibrated     = false;
+        uint8_t  dataTimeout    = 0;     // "AT ST" value in units of 4ms, 0 for the ELM327 default
+        uint8_t  adaptiveTiming = 1;     // "AT AT" mode, 1 is the ELM327 default
+        uint16_t maxLatency_ms  = 0;     // Slowest response measured by calibrateTiming()
+        uint8_t  backoffs       = 0;     // Times the timing was backed off since calibrateTiming()
+        bool     backoffPending = false; // Backed off timing is sent before the next service 01 query
+        uint8_t  backoffStep    = 0;     // 1 while "AT ST", 2 while "AT AT" of the back off is in flight
+        uint8_t  windowQueries  = 0;
+        uint8_t  windowNoData   = 0;
+    } Timing;
+
+    // Monitor mode counters, reset by startMonitor()
+    struct monitorStats {
+        uint32_t frames   = 0; // Frames put in the ring buffer
+        uint32_t dropped  = 0; // Frames lost because the ring buffer was full
+        uint32_t badLines = 0; // Lines that weren't frames, i.e. "BUFFER FULL" or "CAN ERROR"
+    } Monitor_Stats;
+
+    // Single frame responses of the last query by ECU, in the order they arrived. Only
+    // filled while setECUDemux() is on
+    struct ecuResponses {
+        uint8_t     numECUs = 0;
+        ecuResponse ecus[ECU_MAX_RESPONSES];
+    } ECU_Responses;
     
-    bool begin(Stream& stream, const bool& debug = false, const uint16_t& timeout = 1000, const char& protocol = '0', const uint16_t& payloadLen = 128, const byte& dataTimeout = 0);
+    ELM327() {}
+    bool begin(Stream& stream, const bool& debug = false, const uint16_t& timeout = 1000, const char& protocol = '0', const uint16_t& payloadLen = 128, const byte& dataTimeout = 0, bool (*loadSession)(uint8_t* data, uint16_t len) = nullptr);
     ~ELM327();
     bool initializeELM(const char& protocol = '0', const byte& dataTimeout = 0);
+    bool saveSession(bool (*writeSession)(const uint8_t* data, uint16_t len));
+    bool restoreSession(bool (*loadSession)(uint8_t* data, uint16_t len), const char& protocol = '0', const byte& dataTimeout = 0);
+    bool setHeader(const char* header);
+    bool setECUDemux(const bool& enable);
+    double ecuValue(const uint32_t& id);
+    bool calibrateTiming(const uint8_t& numRounds = 3);
+    bool setTiming(const uint8_t& dataTimeout, const uint8_t& adaptiveTiming);
+    bool negotiateBaud(const uint32_t& currentBaud, const uint32_t& baud, bool (*setHostBaud)(const uint32_t& baud));
+    bool startMonitor(canFrame frames[], const uint8_t& numFrames, const char* filter = nullptr, const char* mask = nullptr, const char* command = MONITOR_ALL);
+    bool startJ1939Monitor(canFrame frames[], const uint8_t& numFrames, const uint32_t& pgn);
+    bool startMonitor(canFrame frames[], const uint8_t& numFrames, const monitorWindow& window);
+    bool setSignalTable(const canMessage messages[], const uint8_t& numMessages, const canSignal signals[], sampledValue values[]);
+    uint8_t decodeFrame(const canFrame& frame);
+    uint8_t decodeFrames();
+    void setJ1939Transfers(j1939Transfer transfers[], const uint8_t& numTransfers);
+    bool processJ1939Frame(const canFrame& frame, j1939Message& message);
+    uint8_t decodeSPNs(const j1939Message& message, sampledValue values[]);
+    uint8_t parseDM1(const j1939Message& message, j1939DTC dtcs[], const uint8_t& maxDtcs, uint16_t& lamps);
+    void requestPGN(const uint32_t& pgn, j1939Message& message);
+    static uint32_t j1939PGN(const uint32_t& id);
+    uint8_t planMonitorFilters(const uint32_t ids[], const uint8_t& numIds, const bool& extended, monitorWindow windows[], const uint8_t& maxWindows, const uint32_t busIds[] = nullptr, const uint16_t& numBusIds = 0);
+    uint8_t pollMonitor();
+    bool readFrame(canFrame& frame);
+    uint8_t framesAvailable();
+    bool stopMonitor();
+    bool isMonitoring();
     void flushInputBuff();
     uint64_t findResponse();
     void queryPID(const uint8_t& service, const uint16_t& pid, const uint8_t& num_responses = 1);
+    uint8_t numResponsesHint(const uint8_t& service, const uint16_t& pid);
+    void clearResponseHints();
     void queryPID(char queryStr[]);
     double processPID(const uint8_t& service, const uint16_t& pid, const uint8_t& num_responses, const uint8_t& numExpectedBytes, const double& scaleFactor = 1, const float& bias = 0);
+    void processPIDs(const uint8_t& service, pidRequest requests[], const uint8_t& numRequests);
     void sendCommand(const char *cmd);
     int8_t sendCommand_Blocking(const char *cmd);
     int8_t get_response();
+    uint32_t statusCount(const int8_t& status);
+    queryMetrics* getPidMetrics(const uint8_t& service, const uint16_t& pid);
+    void resetMetrics();
     bool timeout();
     double conditionResponse(const uint8_t& numExpectedBytes, const double& scaleFactor = 1, const double& bias = 0);
     double conditionResponse(double (*func)());
-    double (*selectCalculator(uint16_t pid))();
+    double conditionResponse(double (*func)(const pidResponse&));
+    double (*selectCalculator(uint16_t pid))(const pidResponse&);
+    bool   getPidDescriptor(const uint16_t& pid, pidDescriptor& descriptor);
+    double read(const uint8_t& pid);
+    int32_t readFixed(const uint8_t& pid);
+    int32_t fixedValue(const uint8_t& pid);
     float  batteryVoltage(void);
     int8_t get_vin_blocking(char vin[]);
     bool   resetDTC();
     void   currentDTCCodes(const bool& isBlocking = true);
     bool   isPidSupported(uint8_t pid);
-    void parseMultiLineResponse();
+    bool   isPidSupported(const uint8_t& service, const uint8_t& pid);
+    bool   refreshSupportedPIDs(const uint8_t& service = SERVICE_01);
+    bool parseMultiLineResponse();
     
     uint32_t supportedPIDs_1_20();
 
@@ -423,41 +809,192 @@ public:
     uint16_t auxSupported();
     void     printError();
 
+    bool     schedulePID(const uint8_t& pid, const float& rate, const uint32_t& ecu = 0);
+    bool     unschedulePID(const uint8_t& pid, const uint32_t& ecu = 0);
+    int8_t   poll();
+    float    achievedRate(const uint8_t& pid, const uint32_t& ecu = 0);
+
+    scheduledPID schedule[MAX_SCHEDULED_PIDS];
+    uint8_t      numScheduled = 0;
+
+
+
+
+protected:
+    ELM327(char* payloadBuffer, const uint16_t& payloadLen);
+
 
 
 
 private:
+    bool        staticBuffers = false;
     char        query[QUERY_LEN] = { '\0' };
     bool        longQuery = false;
     bool        isMode0x22Query = false;
+    byte        dataTimeout_ms = 0;
+    uint32_t    supportedPidMap[NUM_PID_MAP_SERVICES][PID_MAP_BLOCKS] = { { 0 } };
+    bool        supportedPidMapValid[NUM_PID_MAP_SERVICES] = { false };
+    int8_t      activeSchedule = -1;
+    bool        ecuDemux = false;       // Headers on, responses attributed to their ECU - see setECUDemux()
+    uint32_t    addressedECU = 0;       // Response ID of the ECU the scheduler's header addresses, 0 if broadcast - see addressECU()
+    char        broadcastHeader[HEADER_LEN] = { '\0' }; // Header addressECU() restores for broadcast PIDs
+    uint32_t    pendingECU = 0;         // ECU of the "AT SH" in flight
+    bool        headerInFlight = false; // addressECU() waits for the response to "AT SH"
+    bool        queryInFlight = false;
+    bool        firstByteRxd = false;
+    int16_t     metricsService = -1;
+    uint16_t    metricsPid = 0;
+    uint32_t    queryStart_us = 0;
+    uint32_t    firstByte_us = 0;
+    uint8_t     batchIndex = 0;
+    uint8_t     batchCount = 0;
+
+    // Number of responses (ECUs) seen for a PID on a protocol - see queryPID()
+    struct responseHint {
+        uint8_t  service;
+        uint16_t pid;
+        char     protocol;     // activeProtocol the count was learned on
+        uint8_t  numResponses; // 0 until learned
+        uint8_t  uses;         // Queries sent with the count since it was learned
+    };
+
+    responseHint responseHints[RESPONSE_HINT_SLOTS];
+    uint8_t      numResponseHints = 0;
+    int8_t       hintIndex = -1; // Slot of the query in flight, -1 if it doesn't use a hint
+    uint8_t      hintSent = 0;   // Number of responses appended to the query in flight, 0 if learning
+    char        echoCmd[ECHO_CMD_LEN] = { '\0' };   // Command as its echo appears in payload
+    char        lastCommand[LAST_COMMAND_LEN] = { '\0' }; // OBD command a lone CR repeats, "" if none
+    bool        lastCommandDone = false;            // Whether the prompt after lastCommand was received
+    char        expectedHeader[7] = { '\0' };       // Response header of the query in flight
+
+    // Monitor mode ring buffer - written by pollMonitor(), read by readFrame()
+    canFrame*        monitorFrames = nullptr;
+    uint8_t          monitorSize = 0;
+    uint8_t          monitorHead = 0;             // Next slot pollMonitor() writes, published with release order
+    uint8_t          monitorTail = 0;             // Next slot readFrame() reads, published with release order
+    bool             monitoring = false;          // Between startMonitor() and stopMonitor()
+    bool             monitorStopped = false;      // The ELM327 sent its prompt, i.e. after "BUFFER FULL"
+    bool             monitorFiltered = false;     // Whether startMonitor() set "AT CF"/"AT CM"
+    uint8_t          monitorLine[MONITOR_LINE_LEN]; // Hex digit values of the line being received
+    uint8_t          monitorLineLen = 0;
+    bool             monitorLineBad = false;      // Line has chars that can't be part of a frame
+
+    // Signal table of the broadcast CAN frames - see setSignalTable()
+    const canMessage* signalMessages = nullptr;
+    const canSignal*  signalTable = nullptr;
+    sampledValue*     signalValues = nullptr;
+    uint8_t           signalIndex[SIGNAL_INDEX_SLOTS]; // Index into signalMessages + 1, 0 if empty
+
+    // J1939 transport protocol reassembly buffer - see setJ1939Transfers()
+    j1939Transfer* tpTransfers = nullptr;
+    uint8_t        numTpTransfers = 0;
+
+    // State of the streaming parser for the response being received - see streamChar()
+    struct streamState {
+        uint16_t lineStart;     // Index of the current line in payload
+        uint16_t prevLineStart;
+        uint16_t prevLineLen;
+        uint16_t totalChars;    // Declared length of a multiline response, 0 if unknown
+        uint16_t firstDatum;    // Index of the first char after expectedHeader, 0 if not found yet
+        uint16_t dataEnd;       // Index of a second response header, 0 if none
+        uint16_t headerOffset;  // Index of expectedHeader in the line of the first response
+        uint16_t decodedBytes;  // Bytes decoded into responseData so far
+        uint8_t  numResponses;  // Lines with expectedHeader
+        bool     lineHasHeader;
+        uint8_t  numLines;
+        uint8_t  nextFrame;     // Sequence number the next multiline frame must have
+        uint8_t  echoLen;       // 0 to keep the first line
+        uint8_t  headerLen;     // 0 if the command isn't a PID query
+        uint8_t  keywordMatch[4];
+        uint8_t  keywordsFound; // KEYWORD_XXX bits
+        bool     multiLine;
+        bool     lineIsFrame;
+        bool     frameError;
+        bool     decodeStopped;
+        uint8_t  idChars;       // Hex chars of the CAN ID that starts each line, 0 if headers are off
+        uint8_t  linePos;       // Chars of the current line so far
+        uint8_t  prefixLen;     // Chars of the CAN ID and PCI of the current line, 0 until known
+        char     prefix[12];    // CAN ID and PCI chars of the current line
+        uint8_t  lineType;      // ISO-TP frame type of the current line (PCI high nibble)
+        uint8_t  lineDataChars; // Data chars the current line may add to payload, 0xFF for no limit
+        bool     linePlain;     // The current line isn't a frame, i.e. "NO DATA"
+        uint32_t lineId;        // CAN ID of the current line
+        uint32_t frameId;       // CAN ID of the ECU sending the multiline response
+    } stream = {};
     uint32_t    currentTime;
     uint32_t    previousTime;
     double*     calculator;
 
-    static double calculator_0C();
-    static double calculator_10();
-    static double calculator_14();
-    static double calculator_1F();
-    static double calculator_22();
-    static double calculator_23();
-    static double calculator_24();
-    static double calculator_32();
-    static double calculator_3C();
-    static double calculator_42();
-    static double calculator_43();
-    static double calculator_44();
-    static double calculator_4F();
-    static double calculator_50();
-    static double calculator_53();
-    static double calculator_54();
-    static double calculator_55();
-    static double calculator_59();
-    static double calculator_5D(); 
-    static double calculator_5E();
-    static double calculator_61();
+    static const pidDescriptor pidTable[NUM_PID_DESCRIPTORS];
+    static const spnDescriptor spnTable[NUM_J1939_SPNS];
+
+    static double calculator_0C(const pidResponse& r);
+    static double calculator_10(const pidResponse& r);
+    static double calculator_14(const pidResponse& r);
+    static double calculator_1F(const pidResponse& r);
+    static double calculator_22(const pidResponse& r);
+    static double calculator_23(const pidResponse& r);
+    static double calculator_32(const pidResponse& r);
+    static double calculator_3C(const pidResponse& r);
+    static double calculator_42(const pidResponse& r);
+    static double calculator_43(const pidResponse& r);
+    static double calculator_44(const pidResponse& r);
+    static double calculator_4F(const pidResponse& r);
+    static double calculator_50(const pidResponse& r);
+    static double calculator_53(const pidResponse& r);
+    static double calculator_54(const pidResponse& r);
+    static double calculator_55(const pidResponse& r);
+    static double calculator_59(const pidResponse& r);
+    static double calculator_5D(const pidResponse& r); 
+    static double calculator_5E(const pidResponse& r);
+    static double calculator_61(const pidResponse& r);
 
     obd_cmd_states nb_query_state = SEND_COMMAND; // Non-blocking query state
 
+    double  decodePID(const uint16_t& pid,
+                      const uint8_t&  numExpectedBytes,
+                      const double&   scaleFactor,
+                      const float&    bias);
+    void    setResponseBytes(const uint8_t& numBytes);
+    void    formatBatchQueryArray(const uint8_t&   service,
+                                  const pidRequest requests[],
+                                  const uint8_t&   numRequests);
+    void    parseBatchResponse(const uint8_t& service,
+                               pidRequest     requests[],
+                               const uint8_t& numRequests);
+    void    resetELM(const byte& dataTimeout);
+    bool    connectProtocol(const char& protocol);
+    void    printInitTimes();
+    static uint16_t sessionChecksum(const elmSession& session);
+    bool    isCANProtocol();
+    int8_t  pidMapIndex(const uint8_t& service);
+    int8_t  findScheduledPID(const uint8_t& pid, const uint32_t& ecu);
+    int8_t  addressECU(const uint32_t& ecu);
+    void    ecuHeader(const uint32_t& ecu, char header[]);
+    bool    sendHeader(const char* header);
+    int8_t  receiveResponse();
+    void    recordMetrics(const int8_t& status);
+    void    watchTiming(const int8_t& status);
+    int8_t  applyBackoff();
+    bool    readLine(char line[], const uint8_t& lineLen, const char& end, const uint16_t& wait_ms);
+    bool    monitorChar(const char& recChar);
+    bool    queueMonitorLine();
+    static uint32_t filterTraffic(const uint32_t& andBits,
+                                  const uint32_t& orBits,
+                                  const uint32_t& idMask,
+                                  const uint32_t  busIds[],
+                                  const uint16_t& numBusIds);
+    static uint8_t countBits(uint32_t value);
+    static uint8_t signalSlot(const uint32_t& id);
+    static void recordSample(sampledValue& sample, const uint32_t& now);
+    bool    verifyTiming(const uint8_t pids[],
+                         const uint8_t numResponses[],
+                         const uint8_t& numPids,
+                         const uint8_t& numRounds);
+    int8_t  findResponseHint(const uint8_t& service, const uint16_t& pid);
+    void    updateResponseHint(const int8_t& status);
+    static void updateStat(runningStat& stat, const uint32_t& value);
+    void    readProtocol();
     void    upper(char    string[],
                   uint8_t buflen);
     void    formatQueryArray(const uint8_t&  service,
@@ -469,4 +1006,27 @@ private:
                       char const *target,
                       uint8_t     numOccur = 1);
     void    removeChar(char *from, const char *remove);
+    uint16_t decodeResponseData(const char* hex, const uint16_t& numChars);
+    void    setLegacyResponse();
+    void    printResponseData();
+    bool    streamChar(const char& recChar);
+    bool    streamStore(const char& recChar);
+    bool    demuxChar(const char& recChar);
+    void    recordECUResponse();
+    void    streamRewind(const uint16_t& length);
+    bool    finishStreamDecode();
+    uint8_t formatResponseHeader(char header[]);
+};
+
+// ELM327 with compile time sized buffers - doesn't use the heap. The payloadLen
+// argument of begin() is ignored, PayloadLen is used instead. The buffer holds
+// the payload followed by the decoded responseData
+template <uint16_t PayloadLen = 128>
+class ELM327Static : public ELM327
+{
+public:
+    ELM327Static() : ELM327(payloadBuffer, PayloadLen) {}
+
+private:
+    char payloadBuffer[PayloadLen + 1 + PayloadLen / 2]; // allow for terminating '\0'
 };